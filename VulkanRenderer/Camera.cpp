@@ -8,7 +8,7 @@
 
 std::atomic<uint32_t> Vulkan::Camera::globalID = 0;
 
-Vulkan::Camera::Camera(VkExtent2D extent, bool perspective, CameraCallback callback) : id(++globalID)
+Vulkan::Camera::Camera(VkExtent2D extent, bool perspective, CameraCallback callback, CameraCallback onDepthPrepass) : id(++globalID)
 {
 	m_swapChainExtent = extent;
 	m_viewPort = {};
@@ -32,6 +32,7 @@ Vulkan::Camera::Camera(VkExtent2D extent, bool perspective, CameraCallback callb
 	else
 		SetOrthographic();
 	m_onDestroy = callback;
+	m_onDepthPrepass = onDepthPrepass;
 }
 
 void Vulkan::Camera::ComputeViewMatrix(glm::vec3 position, glm::vec3 rotation, glm::mat4 & viewMatrix)
@@ -98,3 +99,10 @@ void Vulkan::Camera::LookAt(glm::vec3 target)
 	m_rotation.x = glm::degrees(glm::atan(-m_viewMatrix[1][2], m_viewMatrix[2][2]));
 	m_rotation.z = 0;
 }
+
+void Vulkan::Camera::SetDepthPrepass(bool enabled)
+{
+	if (enabled && m_onDepthPrepass)
+		m_onDepthPrepass(this);
+	m_depthPrepass = enabled;
+}
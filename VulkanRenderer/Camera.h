@@ -31,14 +31,17 @@ namespace Vulkan
 		void SetPositionRotation(glm::vec3 position, glm::vec3 rotation);
 		void SetViewport(glm::vec2 screenCoords, glm::vec2 scale);
 		void LookAt(glm::vec3 target);
+		///Lay down depth with a position only pass first, the forward pass then only shades the front most fragment of every pixel
+		void SetDepthPrepass(bool enabled);
 		glm::vec3 m_position;
 		glm::vec3 m_rotation;
 	private:
-		Camera(VkExtent2D extent, bool perspective, CameraCallback callback);
+		Camera(VkExtent2D extent, bool perspective, CameraCallback callback, CameraCallback onDepthPrepass);
 		void ComputeViewMatrix(glm::vec3 position, glm::vec3 rotation, glm::mat4& viewMatrix);
 
 	private:
 		bool m_bound = false;
+		bool m_depthPrepass = false;
 		float m_fov;
 		float m_zNear;
 		float m_zFar;
@@ -49,6 +52,8 @@ namespace Vulkan
 		glm::mat4 m_projectionMatrix;
 		static std::atomic<uint32_t> globalID;
 		CameraCallback m_onDestroy;
+		//lets the renderer build the pre-pass pipelines as soon as they are asked for
+		CameraCallback m_onDepthPrepass;
 		friend class VulkanRenderUnit;
 		friend class KojinRenderer;
 	};
@@ -0,0 +1,54 @@
+#include "DrawSortKey.h"
+#include <algorithm>
+#include <assert.h>
+
+uint64_t Vulkan::DrawSortKey::Make(uint32_t pipeline, uint32_t material, uint32_t mesh, float viewDepth, float zNear, float zFar)
+{
+	const uint64_t depthMax = (1ull << k_depthBits) - 1;
+	float range = zFar > zNear ? zFar - zNear : 1.0f;
+	float normalized = std::min(std::max((viewDepth - zNear) / range, 0.0f), 1.0f);
+	uint64_t depth = static_cast<uint64_t>(normalized * depthMax);
+
+	uint64_t key = pipeline & ((1ull << k_pipelineBits) - 1);
+	key = (key << k_materialBits) | (material & ((1ull << k_materialBits) - 1));
+	key = (key << k_meshBits) | (mesh & ((1ull << k_meshBits) - 1));
+	key = (key << k_depthBits) | depth;
+	return key;
+}
+
+void Vulkan::RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values)
+{
+	assert(keys.size() == values.size());
+	size_t count = keys.size();
+	if (count < 2)
+		return;
+
+	std::vector<uint64_t> keyScratch(count);
+	std::vector<uint32_t> valueScratch(count);
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		size_t histogram[256] = { 0 };
+		for (uint64_t key : keys)
+			histogram[(key >> shift) & 0xff]++;
+
+		//a byte shared by every key doesn't change the order, most keys leave the upper pipeline bits empty
+		if (histogram[(keys[0] >> shift) & 0xff] == count)
+			continue;
+
+		size_t offset = 0;
+		for (size_t& bucket : histogram)
+		{
+			size_t bucketCount = bucket;
+			bucket = offset;
+			offset += bucketCount;
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			size_t destination = histogram[(keys[i] >> shift) & 0xff]++;
+			keyScratch[destination] = keys[i];
+			valueScratch[destination] = values[i];
+		}
+		keys.swap(keyScratch);
+		values.swap(valueScratch);
+	}
+}
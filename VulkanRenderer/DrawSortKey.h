@@ -0,0 +1,27 @@
+/*=========================================================
+DrawSortKey.h - 64 bit draw ordering keys and the radix sort
+used to order draw lists before recording. The most
+significant fields hold the state that is most expensive to
+change, the quantized view depth comes last so draws sharing
+all state are recorded front to back.
+==========================================================*/
+
+#pragma once
+#include <vector>
+#include <stdint.h>
+
+namespace Vulkan
+{
+	struct DrawSortKey
+	{
+		static const uint32_t k_pipelineBits = 8;
+		static const uint32_t k_materialBits = 16;
+		static const uint32_t k_meshBits = 16;
+		static const uint32_t k_depthBits = 24;
+		///Pack the fields, ids wider than their field are truncated and depth is clamped to [zNear, zFar]
+		static uint64_t Make(uint32_t pipeline, uint32_t material, uint32_t mesh, float viewDepth, float zNear, float zFar);
+	};
+
+	///Stable LSD radix sort on the keys, values are permuted along with them
+	void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values);
+}
@@ -0,0 +1,213 @@
+#include "FrustumCulling.h"
+#include <algorithm>
+#include <cmath>
+#include <float.h>
+#include <assert.h>
+#if defined(__AVX__) || defined(__AVX2__) || defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <immintrin.h>
+#define FRUSTUM_CULLING_SSE 1
+#endif
+
+namespace
+{
+	//limits of one cull call, disabled tests get values that always pass
+	struct CullLimits
+	{
+		float maxDistance;
+		float minScreenRadius;
+		float screenScale;
+		bool perspective;
+	};
+
+	bool SphereVisible(const Vulkan::Frustum& frustum, float x, float y, float z, float r, const CullLimits& limits)
+	{
+		for (uint32_t p = 0; p < 6; ++p)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+			if (plane.x * x + plane.y * y + plane.z * z + plane.w < -r)
+				return false;
+		}
+		const glm::vec4& nearPlane = frustum.planes[Vulkan::Frustum::k_nearPlane];
+		float nearDistance = nearPlane.x * x + nearPlane.y * y + nearPlane.z * z + nearPlane.w;
+		if (nearDistance - r > limits.maxDistance)
+			return false;
+		float screenLimit = limits.perspective ? limits.minScreenRadius * std::max(nearDistance, 0.0f) : limits.minScreenRadius;
+		return r * limits.screenScale >= screenLimit;
+	}
+
+#ifdef FRUSTUM_CULLING_SSE
+	//4 spheres per iteration, returns the first sphere left for the scalar tail
+	size_t CullSSE(const Vulkan::Frustum& frustum, const Vulkan::CullingSpheres& spheres, size_t first, const CullLimits& limits, std::vector<uint32_t>& visible)
+	{
+		size_t count = spheres.Size();
+		const __m128 maxDistance = _mm_set1_ps(limits.maxDistance);
+		const __m128 minScreen = _mm_set1_ps(limits.minScreenRadius);
+		const __m128 screenScale = _mm_set1_ps(limits.screenScale);
+		const __m128 zero = _mm_setzero_ps();
+		size_t i = first;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(&spheres.x[i]);
+			__m128 y = _mm_loadu_ps(&spheres.y[i]);
+			__m128 z = _mm_loadu_ps(&spheres.z[i]);
+			__m128 r = _mm_loadu_ps(&spheres.radius[i]);
+			__m128 negR = _mm_sub_ps(zero, r);
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			__m128 nearDistance = zero;
+			for (uint32_t p = 0; p < 6; ++p)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+					_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negR));
+				if (p == Vulkan::Frustum::k_nearPlane)
+					nearDistance = distance;
+			}
+			inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_sub_ps(nearDistance, r), maxDistance));
+			__m128 screenLimit = limits.perspective ? _mm_mul_ps(minScreen, _mm_max_ps(nearDistance, zero)) : minScreen;
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_mul_ps(r, screenScale), screenLimit));
+
+			//compact the passing lanes into the visible list
+			int mask = _mm_movemask_ps(inside);
+			while (mask != 0)
+			{
+				int lane = 0;
+				while (((mask >> lane) & 1) == 0)
+					lane++;
+				visible.push_back(static_cast<uint32_t>(i + lane));
+				mask &= mask - 1;
+			}
+		}
+		return i;
+	}
+#endif
+
+#if defined(__AVX__) || defined(__AVX2__)
+	//8 spheres per iteration when the build targets AVX
+	size_t CullAVX(const Vulkan::Frustum& frustum, const Vulkan::CullingSpheres& spheres, const CullLimits& limits, std::vector<uint32_t>& visible)
+	{
+		size_t count = spheres.Size();
+		const __m256 maxDistance = _mm256_set1_ps(limits.maxDistance);
+		const __m256 minScreen = _mm256_set1_ps(limits.minScreenRadius);
+		const __m256 screenScale = _mm256_set1_ps(limits.screenScale);
+		const __m256 zero = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(&spheres.x[i]);
+			__m256 y = _mm256_loadu_ps(&spheres.y[i]);
+			__m256 z = _mm256_loadu_ps(&spheres.z[i]);
+			__m256 r = _mm256_loadu_ps(&spheres.radius[i]);
+			__m256 negR = _mm256_sub_ps(zero, r);
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			__m256 nearDistance = zero;
+			for (uint32_t p = 0; p < 6; ++p)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_mul_ps(y, _mm256_set1_ps(plane.y))),
+					_mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negR, _CMP_GE_OQ));
+				if (p == Vulkan::Frustum::k_nearPlane)
+					nearDistance = distance;
+			}
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_sub_ps(nearDistance, r), maxDistance, _CMP_LE_OQ));
+			__m256 screenLimit = limits.perspective ? _mm256_mul_ps(minScreen, _mm256_max_ps(nearDistance, zero)) : minScreen;
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_mul_ps(r, screenScale), screenLimit, _CMP_GE_OQ));
+
+			int mask = _mm256_movemask_ps(inside);
+			while (mask != 0)
+			{
+				int lane = 0;
+				while (((mask >> lane) & 1) == 0)
+					lane++;
+				visible.push_back(static_cast<uint32_t>(i + lane));
+				mask &= mask - 1;
+			}
+		}
+		return i;
+	}
+#endif
+}
+
+Vulkan::Frustum Vulkan::Frustum::FromViewProjection(const glm::mat4 & viewProjection)
+{
+	//rows of the matrix, glm stores columns
+	glm::vec4 rows[4];
+	for (uint32_t i = 0; i < 4; ++i)
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	//clip depth goes from 0 to w, so the near plane is the third row alone
+	frustum.planes[k_nearPlane] = rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+	for (glm::vec4& plane : frustum.planes)
+	{
+		float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+		if (length > 0.0f)
+			plane /= length;
+	}
+	return frustum;
+}
+
+void Vulkan::CullingSpheres::Resize(size_t count)
+{
+	x.resize(count);
+	y.resize(count);
+	z.resize(count);
+	radius.resize(count);
+}
+
+size_t Vulkan::CullingSpheres::Size() const
+{
+	return x.size();
+}
+
+void Vulkan::CullingSpheres::Set(size_t index, const glm::mat4 & transform, const glm::vec3 & center, float boundsRadius)
+{
+	glm::vec4 world = transform * glm::vec4(center, 1.0f);
+	float scale = 0.0f;
+	for (uint32_t axis = 0; axis < 3; ++axis)
+	{
+		glm::vec3 column = glm::vec3(transform[axis]);
+		scale = std::max(scale, column.x * column.x + column.y * column.y + column.z * column.z);
+	}
+	x[index] = world.x;
+	y[index] = world.y;
+	z[index] = world.z;
+	radius[index] = boundsRadius * std::sqrt(scale);
+}
+
+void Vulkan::CullingSpheres::Move(size_t to, size_t from)
+{
+	x[to] = x[from];
+	y[to] = y[from];
+	z[to] = z[from];
+	radius[to] = radius[from];
+}
+
+void Vulkan::CullSpheres(const Frustum & frustum, const CullingSpheres & spheres, float screenScale, bool perspective, const CullingSettings & settings, std::vector<uint32_t>& visible)
+{
+	assert(spheres.y.size() == spheres.Size() && spheres.z.size() == spheres.Size() && spheres.radius.size() == spheres.Size());
+	CullLimits limits;
+	limits.maxDistance = settings.maxDistance > 0.0f ? settings.maxDistance : FLT_MAX;
+	limits.minScreenRadius = std::max(settings.minScreenRadius, 0.0f);
+	limits.screenScale = screenScale;
+	limits.perspective = perspective;
+
+	size_t i = 0;
+#if defined(__AVX__) || defined(__AVX2__)
+	i = CullAVX(frustum, spheres, limits, visible);
+#endif
+#ifdef FRUSTUM_CULLING_SSE
+	i = CullSSE(frustum, spheres, i, limits, visible);
+#endif
+	for (; i < spheres.Size(); ++i)
+	{
+		if (SphereVisible(frustum, spheres.x[i], spheres.y[i], spheres.z[i], spheres.radius[i], limits))
+			visible.push_back(static_cast<uint32_t>(i));
+	}
+}
@@ -0,0 +1,54 @@
+/*=========================================================
+FrustumCulling.h - Bounding sphere visibility tests run on
+the CPU before draws are built. Spheres are kept in SoA
+arrays so the kernel tests several of them against the six
+frustum planes at once, distance and screen size limits are
+applied in the same pass.
+==========================================================*/
+
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <glm\matrix.hpp>
+
+namespace Vulkan
+{
+	struct CullingSettings
+	{
+		///Spheres further than this from the near plane are culled, 0 disables the test
+		float maxDistance = 0.0f;
+		///Spheres with a smaller projected radius in pixels are culled, 0 disables the test
+		float minScreenRadius = 0.0f;
+		///Depth an object has to be behind the Hi-Z depth of an earlier frame before it is culled, raise it when objects pop in
+		float hiZDepthBias = 0.0f;
+		///Camera travel after which an earlier frame's Hi-Z depth is ignored instead of trusted, 0 disables the test
+		float hiZMaxCameraMove = 0.0f;
+		///Retained proxies need at least this many triangles to be tested with occlusion queries, 0 queries every proxy
+		uint32_t queryMinTriangles = 0;
+	};
+
+	struct Frustum
+	{
+		static const uint32_t k_nearPlane = 4;
+		//left, right, bottom, top, near, far with normalized inward normals in xyz and the distance in w
+		glm::vec4 planes[6];
+		///Extract the planes of a zero to one depth range view projection matrix
+		static Frustum FromViewProjection(const glm::mat4& viewProjection);
+	};
+
+	struct CullingSpheres
+	{
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		std::vector<float> radius;
+		void Resize(size_t count);
+		size_t Size() const;
+		///Store the world space sphere of local bounds placed by transform, the radius grows with the largest axis scale
+		void Set(size_t index, const glm::mat4& transform, const glm::vec3& center, float boundsRadius);
+		void Move(size_t to, size_t from);
+	};
+
+	///Append the indices of the spheres passing every test to visible. screenScale is the pixels covered by one unit at distance one
+	void CullSpheres(const Frustum& frustum, const CullingSpheres& spheres, float screenScale, bool perspective, const CullingSettings& settings, std::vector<uint32_t>& visible);
+}
@@ -0,0 +1,80 @@
+#include "GpuCulling.h"
+#include "VkManagedDevice.h"
+#include "VkManagedPipeline.h"
+#include "VkManagedDescriptorSet.h"
+#include <float.h>
+#include <algorithm>
+#include <assert.h>
+
+Vulkan::GpuCulling::GpuCulling(VkManagedDevice * device)
+{
+	assert(device != nullptr);
+	std::vector<VkDescriptorSetLayoutBinding> bindings(k_bindingCount);
+	for (uint32_t i = 0; i < k_bindingCount; ++i)
+	{
+		bindings[i] = {};
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		bindings[i].pImmutableSamplers = nullptr;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	VkPushConstantRange range;
+	range.offset = 0;
+	range.size = sizeof(GpuCullingConstants);
+	range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	m_pipeline = new VkManagedPipeline(device);
+	try
+	{
+		m_pipeline->BuildCompute("shaders/cull.comp.spv", bindings, { range });
+	}
+	catch (...)
+	{
+		delete m_pipeline;
+		throw;
+	}
+}
+
+Vulkan::GpuCulling::~GpuCulling()
+{
+	delete m_pipeline;
+}
+
+VkDescriptorSetLayout Vulkan::GpuCulling::SetLayout()
+{
+	return m_pipeline->GetComputeLayout();
+}
+
+void Vulkan::GpuCulling::LoadDescriptors(VkManagedDescriptorSet * set, uint32_t setIndex, VkBuffer buffer, uint32_t capacity)
+{
+	//there is never more than one draw per object, so capacity bounds every region
+	set->LoadStorageBufferDynamic(setIndex, buffer, capacity * sizeof(GpuCullRecord), 0);
+	set->LoadStorageBufferDynamic(setIndex, buffer, capacity * sizeof(uint32_t), 1);
+	set->LoadStorageBufferDynamic(setIndex, buffer, capacity * sizeof(VkDrawIndexedIndirectCommand), 2);
+	set->LoadStorageBufferDynamic(setIndex, buffer, capacity * sizeof(uint32_t), 3);
+}
+
+void Vulkan::GpuCulling::Dispatch(VkCommandBuffer commandBuffer, VkManagedDescriptorSet * set, uint32_t setIndex, const uint32_t offsets[k_bindingCount], const GpuCullingConstants & constants)
+{
+	if (constants.recordCount == 0)
+		return;
+	VkDescriptorSet descSet = set->Set(setIndex);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, *m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, *m_pipeline, 0, 1, &descSet, k_bindingCount, offsets);
+	vkCmdPushConstants(commandBuffer, *m_pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GpuCullingConstants), &constants);
+	vkCmdDispatch(commandBuffer, (constants.recordCount + k_groupSize - 1) / k_groupSize, 1, 1);
+}
+
+Vulkan::GpuCullingConstants Vulkan::GpuCulling::MakeConstants(const Frustum & frustum, float screenScale, bool perspective, const CullingSettings & settings, uint32_t recordCount)
+{
+	GpuCullingConstants constants;
+	for (uint32_t p = 0; p < 6; ++p)
+		constants.planes[p] = frustum.planes[p];
+	constants.recordCount = recordCount;
+	constants.perspective = perspective ? 1 : 0;
+	constants.maxDistance = settings.maxDistance > 0.0f ? settings.maxDistance : FLT_MAX;
+	constants.minScreenRadius = std::max(settings.minScreenRadius, 0.0f);
+	constants.screenScale = screenScale;
+	return constants;
+}
@@ -0,0 +1,59 @@
+/*=========================================================
+GpuCulling.h - Compute culling feeding indirect draws. Every
+object is uploaded as a bounding sphere with the draw and
+instance slot it belongs to, one dispatch per camera tests
+them against the frustum and appends the survivors to the
+visible list and instance count of their draw command.
+==========================================================*/
+
+#pragma once
+#include <vulkan\vulkan.h>
+#include <glm\matrix.hpp>
+#include "FrustumCulling.h"
+
+namespace Vulkan
+{
+	class VkManagedDevice;
+	class VkManagedPipeline;
+	class VkManagedDescriptorSet;
+
+	///One culled object, matches CullRecord in cull.comp
+	struct GpuCullRecord
+	{
+		glm::vec4 sphere;
+		uint32_t draw;
+		uint32_t instance;
+		uint32_t padding[2];
+	};
+
+	///Push constants of one dispatch, matches Culling in cull.comp
+	struct GpuCullingConstants
+	{
+		glm::vec4 planes[6];
+		uint32_t recordCount;
+		uint32_t perspective;
+		float maxDistance;
+		float minScreenRadius;
+		float screenScale;
+	};
+
+	class GpuCulling
+	{
+	public:
+		//records, draw to command remap, draw commands and visible lists, all dynamic storage buffers
+		static const uint32_t k_bindingCount = 4;
+		static const uint32_t k_groupSize = 64;
+		GpuCulling(VkManagedDevice * device);
+		GpuCulling(const GpuCulling&) = delete;
+		GpuCulling& operator=(const GpuCulling&) = delete;
+		~GpuCulling();
+		VkDescriptorSetLayout SetLayout();
+		///Point every binding of the set at buffer, regions are picked per dispatch with dynamic offsets
+		static void LoadDescriptors(VkManagedDescriptorSet * set, uint32_t setIndex, VkBuffer buffer, uint32_t capacity);
+		void Dispatch(VkCommandBuffer commandBuffer, VkManagedDescriptorSet * set, uint32_t setIndex, const uint32_t offsets[k_bindingCount], const GpuCullingConstants& constants);
+		static GpuCullingConstants MakeConstants(const Frustum& frustum, float screenScale, bool perspective, const CullingSettings& settings, uint32_t recordCount);
+
+	private:
+		VkManagedPipeline * m_pipeline = nullptr;
+	};
+}
@@ -0,0 +1,321 @@
+#include "HiZPyramid.h"
+#include "VkManagedDevice.h"
+#include "VkManagedPipeline.h"
+#include "VkManagedDescriptorSet.h"
+#include "VkManagedBuffer.h"
+#include "VkManagedImage.h"
+#include <float.h>
+#include <algorithm>
+#include <cmath>
+#include <assert.h>
+#include <glm\geometric.hpp>
+
+//clip w below which a corner counts as behind the eye
+static const float k_minClipW = 1e-5f;
+
+void Vulkan::HiZDepth::Load(const float * depth, uint32_t width, uint32_t height, uint32_t texelSize, const glm::mat4 & viewProjection, const glm::vec4 & viewport)
+{
+	assert(depth != nullptr && width > 0 && height > 0);
+	m_texelSize = texelSize;
+	m_viewProjection = viewProjection;
+	m_viewport = viewport;
+	m_depth.assign(depth, depth + width * height);
+	m_levels.clear();
+	m_levels.push_back({ 0, width, height });
+
+	//the coarse levels the device did not build are reduced here, down to a single texel
+	while (m_levels.back().width > 1 || m_levels.back().height > 1)
+	{
+		const Level parent = m_levels.back();
+		Level level;
+		level.offset = m_depth.size();
+		level.width = (parent.width + 1) / 2;
+		level.height = (parent.height + 1) / 2;
+		m_depth.resize(level.offset + level.width * level.height);
+		for (uint32_t y = 0; y < level.height; ++y)
+		{
+			uint32_t y0 = y * 2;
+			uint32_t y1 = std::min(y0 + 1, parent.height - 1);
+			for (uint32_t x = 0; x < level.width; ++x)
+			{
+				uint32_t x0 = x * 2;
+				uint32_t x1 = std::min(x0 + 1, parent.width - 1);
+				float farthest = std::max(std::max(m_depth[parent.offset + y0 * parent.width + x0], m_depth[parent.offset + y0 * parent.width + x1]),
+					std::max(m_depth[parent.offset + y1 * parent.width + x0], m_depth[parent.offset + y1 * parent.width + x1]));
+				m_depth[level.offset + y * level.width + x] = farthest;
+			}
+		}
+		m_levels.push_back(level);
+	}
+}
+
+bool Vulkan::HiZDepth::IsVisible(const glm::mat4 & transform, const glm::vec3 & center, const glm::vec3 & extents, float depthBias) const
+{
+	if (m_levels.empty())
+		return true;
+
+	glm::mat4 mvp = m_viewProjection * transform;
+	float minX = FLT_MAX;
+	float minY = FLT_MAX;
+	float maxX = -FLT_MAX;
+	float maxY = -FLT_MAX;
+	float minZ = 1.0f;
+	for (uint32_t corner = 0; corner < 8; ++corner)
+	{
+		glm::vec3 position = center;
+		position.x += (corner & 1) ? extents.x : -extents.x;
+		position.y += (corner & 2) ? extents.y : -extents.y;
+		position.z += (corner & 4) ? extents.z : -extents.z;
+		glm::vec4 clip = mvp * glm::vec4(position, 1.0f);
+		if (clip.w < k_minClipW)
+			return true;
+		float invW = 1.0f / clip.w;
+		float x = m_viewport.x + (clip.x * invW * 0.5f + 0.5f) * m_viewport.z;
+		float y = m_viewport.y + (clip.y * invW * 0.5f + 0.5f) * m_viewport.w;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		minZ = std::min(minZ, clip.z * invW);
+	}
+
+	//the depth only knows what that frame saw, anything reaching past its viewport may have come into view since
+	float top = std::min(m_viewport.y, m_viewport.y + m_viewport.w);
+	float bottom = std::max(m_viewport.y, m_viewport.y + m_viewport.w);
+	if (minX < m_viewport.x || maxX > m_viewport.x + m_viewport.z || minY < top || maxY > bottom)
+		return true;
+
+	//the finest level where the box spans at most two texels on each axis keeps the test at four reads
+	size_t levelIndex = 0;
+	float texelSize = static_cast<float>(m_texelSize);
+	int x0, x1, y0, y1;
+	for (;;)
+	{
+		x0 = static_cast<int>(std::floor(minX / texelSize));
+		x1 = static_cast<int>(std::floor(maxX / texelSize));
+		y0 = static_cast<int>(std::floor(minY / texelSize));
+		y1 = static_cast<int>(std::floor(maxY / texelSize));
+		if ((x1 - x0 <= 1 && y1 - y0 <= 1) || levelIndex + 1 == m_levels.size())
+			break;
+		levelIndex++;
+		texelSize *= 2.0f;
+	}
+
+	const Level& level = m_levels[levelIndex];
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, static_cast<int>(level.width) - 1);
+	y1 = std::min(y1, static_cast<int>(level.height) - 1);
+	float farthest = 0.0f;
+	for (int y = y0; y <= y1; ++y)
+	{
+		for (int x = x0; x <= x1; ++x)
+			farthest = std::max(farthest, m_depth[level.offset + y * level.width + x]);
+	}
+	return minZ <= farthest + depthBias;
+}
+
+uint32_t Vulkan::HiZDepth::LevelCount() const
+{
+	return static_cast<uint32_t>(m_levels.size());
+}
+
+Vulkan::HiZPyramid::HiZPyramid(VkManagedDevice * device, VkExtent2D extent, VkFormat depthFormat, uint32_t frameCount)
+{
+	assert(device != nullptr && extent.width > 0 && extent.height > 0 && frameCount > 0);
+	m_mdevice = device;
+	m_extent = extent;
+	switch (depthFormat)
+	{
+	case VK_FORMAT_D16_UNORM:
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+		m_encoding = Unorm16;
+		break;
+	case VK_FORMAT_X8_D24_UNORM_PACK32:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+		m_encoding = Unorm24;
+		break;
+	default:
+		m_encoding = Float32;
+		break;
+	}
+
+	//the copied depth comes first, 16 bit depth packs two texels per word
+	uint32_t texelCount = extent.width * extent.height;
+	uint32_t wordCount = m_encoding == Unorm16 ? (texelCount + 1) / 2 : texelCount;
+	uint32_t width = extent.width;
+	uint32_t height = extent.height;
+	do
+	{
+		Level level;
+		level.offset = wordCount;
+		level.width = (width + 1) / 2;
+		level.height = (height + 1) / 2;
+		m_levels.push_back(level);
+		wordCount += level.width * level.height;
+		width = level.width;
+		height = level.height;
+	} while (width > k_readbackWidth || height > k_readbackHeight);
+	m_pyramidSize = wordCount * sizeof(uint32_t);
+	m_readbackSize = m_levels.back().width * m_levels.back().height * sizeof(float);
+	m_readbacks.resize(frameCount, nullptr);
+	m_slots.resize(frameCount);
+
+	VkDescriptorSetLayoutBinding binding = {};
+	binding.binding = 0;
+	binding.descriptorCount = 1;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	binding.pImmutableSamplers = nullptr;
+	binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	VkPushConstantRange range;
+	range.offset = 0;
+	range.size = sizeof(HiZReduction);
+	range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	m_pipeline = new VkManagedPipeline(device);
+	try
+	{
+		m_pipeline->BuildCompute("shaders/hiz.comp.spv", { binding }, { range });
+	}
+	catch (...)
+	{
+		delete m_pipeline;
+		throw;
+	}
+}
+
+Vulkan::HiZPyramid::~HiZPyramid()
+{
+	for (VkManagedBuffer * readback : m_readbacks)
+		delete readback;
+	delete m_pipeline;
+}
+
+VkDescriptorSetLayout Vulkan::HiZPyramid::SetLayout()
+{
+	return m_pipeline->GetComputeLayout();
+}
+
+void Vulkan::HiZPyramid::LoadDescriptors(VkManagedDescriptorSet * set, uint32_t setIndex, VkBuffer pyramid)
+{
+	set->LoadStorageBufferDynamic(setIndex, pyramid, m_pyramidSize, 0);
+}
+
+void Vulkan::HiZPyramid::BeginFrame(uint32_t frameIndex, uint32_t cameraCount)
+{
+	assert(frameIndex < m_slots.size());
+	std::vector<Readback>& slots = m_slots[frameIndex];
+	//slots are valid again once a camera builds into them
+	for (Readback& readback : slots)
+		readback.valid = false;
+	if (m_readbacks[frameIndex] != nullptr && cameraCount <= slots.size())
+		return;
+
+	slots.resize(std::max(cameraCount, 1u));
+	if (m_readbacks[frameIndex] == nullptr)
+		m_readbacks[frameIndex] = new VkManagedBuffer(m_mdevice);
+	m_readbacks[frameIndex]->Build(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_readbackSize * slots.size());
+}
+
+void Vulkan::HiZPyramid::Invalidate()
+{
+	for (std::vector<Readback>& slots : m_slots)
+	{
+		for (Readback& readback : slots)
+			readback.valid = false;
+	}
+}
+
+bool Vulkan::HiZPyramid::Read(uint32_t frameIndex, uint32_t slot, uint32_t cameraId, const glm::vec3 & eye, float maxCameraMove, HiZDepth & depth)
+{
+	if (frameIndex >= m_slots.size() || slot >= m_slots[frameIndex].size())
+		return false;
+	const Readback& readback = m_slots[frameIndex][slot];
+	if (!readback.valid || readback.cameraId != cameraId)
+		return false;
+	//past some distance too much of the old depth is stale to trust it
+	if (maxCameraMove > 0.0f && glm::length(eye - readback.eye) > maxCameraMove)
+		return false;
+
+	VkManagedBuffer * buffer = m_readbacks[frameIndex];
+	VkDeviceSize offset = slot * m_readbackSize;
+	buffer->Invalidate(offset, m_readbackSize);
+	//level 0 already halves the attachment, every further level halves it again
+	const Level& level = m_levels.back();
+	depth.Load(buffer->Data<float>(offset), level.width, level.height, 1u << m_levels.size(), readback.viewProjection, readback.viewport);
+	return true;
+}
+
+void Vulkan::HiZPyramid::Build(VkCommandBuffer commandBuffer, VkManagedDescriptorSet * set, uint32_t setIndex, VkManagedImage * depth, VkBuffer pyramid, uint32_t frameIndex, uint32_t slot,
+	uint32_t cameraId, const glm::mat4 & viewProjection, const VkViewport & viewport, const glm::vec3 & eye)
+{
+	assert(depth != nullptr && pyramid != VK_NULL_HANDLE && frameIndex < m_slots.size() && slot < m_slots[frameIndex].size());
+
+	VkBufferImageCopy region = {};
+	region.imageSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1 };
+	region.imageExtent = { m_extent.width, m_extent.height, 1 };
+	vkCmdCopyImageToBuffer(commandBuffer, *depth, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, pyramid, 1, &region);
+	//the caller ordered the copy after earlier uses, the barriers inside the build follow from it
+	VkManagedResourceState state;
+	state.Reset(1, 1, VK_IMAGE_LAYOUT_UNDEFINED);
+	state.Assume({ 0, 0, 1, 0, 1 }, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+
+	//every level reads the one before it, the first one decodes the copied depth
+	VkDescriptorSet descSet = set->Set(setIndex);
+	uint32_t dynamicOffset = 0;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, *m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, *m_pipeline, 0, 1, &descSet, 1, &dynamicOffset);
+	HiZReduction reduction;
+	reduction.srcOffset = 0;
+	reduction.srcWidth = m_extent.width;
+	reduction.srcHeight = m_extent.height;
+	reduction.encoding = m_encoding;
+	VkManagedBarrierBatch batch;
+	for (size_t l = 0; l < m_levels.size(); ++l)
+	{
+		const Level& level = m_levels[l];
+		state.Use(batch, pyramid, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+		batch.Flush(commandBuffer);
+		reduction.dstOffset = level.offset;
+		reduction.dstWidth = level.width;
+		reduction.dstHeight = level.height;
+		vkCmdPushConstants(commandBuffer, *m_pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HiZReduction), &reduction);
+		vkCmdDispatch(commandBuffer, (level.width + k_groupSize - 1) / k_groupSize, (level.height + k_groupSize - 1) / k_groupSize, 1);
+		reduction.srcOffset = level.offset;
+		reduction.srcWidth = level.width;
+		reduction.srcHeight = level.height;
+		reduction.encoding = Float32;
+	}
+
+	//only the last level travels to the host
+	state.Use(batch, pyramid, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+	batch.Flush(commandBuffer);
+	VkBufferCopy copy = {};
+	copy.srcOffset = m_levels.back().offset * sizeof(uint32_t);
+	copy.dstOffset = slot * m_readbackSize;
+	copy.size = m_readbackSize;
+	vkCmdCopyBuffer(commandBuffer, pyramid, *m_readbacks[frameIndex], 1, &copy);
+
+	Readback& readback = m_slots[frameIndex][slot];
+	readback.valid = true;
+	readback.cameraId = cameraId;
+	readback.viewProjection = viewProjection;
+	readback.viewport = glm::vec4(viewport.x, viewport.y, viewport.width, viewport.height);
+	readback.eye = eye;
+}
+
+VkDeviceSize Vulkan::HiZPyramid::PyramidSize() const
+{
+	return m_pyramidSize;
+}
+
+Vulkan::VkManagedBuffer * Vulkan::HiZPyramid::Readbacks(uint32_t frameIndex)
+{
+	assert(frameIndex < m_readbacks.size());
+	return m_readbacks[frameIndex];
+}
+
+uint32_t Vulkan::HiZPyramid::LevelCount() const
+{
+	return static_cast<uint32_t>(m_levels.size());
+}
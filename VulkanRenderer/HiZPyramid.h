@@ -0,0 +1,135 @@
+/*=========================================================
+HiZPyramid.h - Hierarchical depth occlusion against the
+depth of an earlier frame. After a camera's forward pass the
+depth attachment is copied into a storage buffer and reduced
+by a compute chain, every level keeping the farthest depth
+of the texels below it. The coarsest level is read back and
+finished into a full pyramid on the CPU, where bounding
+boxes of the next frames are tested against the texels they
+cover with the view projection the depth was rendered with.
+==========================================================*/
+
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <vulkan\vulkan.h>
+#include <glm\matrix.hpp>
+
+namespace Vulkan
+{
+	class VkManagedDevice;
+	class VkManagedPipeline;
+	class VkManagedDescriptorSet;
+	class VkManagedBuffer;
+	class VkManagedImage;
+
+	///CPU side of the pyramid, headless so it can be filled from any max reduced depth
+	class HiZDepth
+	{
+	public:
+		///Take width by height texels each covering texelSize pixels, viewport is x, y, width and height in pixels
+		void Load(const float * depth, uint32_t width, uint32_t height, uint32_t texelSize, const glm::mat4& viewProjection, const glm::vec4& viewport);
+		///False when the box around center is behind the stored depth by more than depthBias everywhere it covers.
+		///Boxes crossing the near plane or leaving the viewport were not fully seen and are always visible
+		bool IsVisible(const glm::mat4& transform, const glm::vec3& center, const glm::vec3& extents, float depthBias) const;
+		uint32_t LevelCount() const;
+
+	private:
+		struct Level
+		{
+			size_t offset;
+			uint32_t width;
+			uint32_t height;
+		};
+
+	private:
+		std::vector<float> m_depth;
+		std::vector<Level> m_levels;
+		uint32_t m_texelSize = 1;
+		glm::mat4 m_viewProjection;
+		glm::vec4 m_viewport;
+	};
+
+	///Push constants of one reduction, matches Reduction in hiz.comp
+	struct HiZReduction
+	{
+		uint32_t srcOffset;
+		uint32_t srcWidth;
+		uint32_t srcHeight;
+		uint32_t dstOffset;
+		uint32_t dstWidth;
+		uint32_t dstHeight;
+		uint32_t encoding;
+	};
+
+	class HiZPyramid
+	{
+	public:
+		static const uint32_t k_groupSize = 8;
+		//the chain stops at the first level fitting these, that level is read back
+		static const uint32_t k_readbackWidth = 128;
+		static const uint32_t k_readbackHeight = 128;
+		//what the pyramid buffer is created with, written by the copy and the reductions and read by the readback copy
+		static const VkBufferUsageFlags k_pyramidUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		//how depth texels are laid out once copied out of the attachment
+		enum DepthEncoding
+		{
+			Float32 = 0,
+			Unorm24 = 1,
+			Unorm16 = 2
+		};
+		HiZPyramid(VkManagedDevice * device, VkExtent2D extent, VkFormat depthFormat, uint32_t frameCount);
+		HiZPyramid(const HiZPyramid&) = delete;
+		HiZPyramid& operator=(const HiZPyramid&) = delete;
+		~HiZPyramid();
+		VkDescriptorSetLayout SetLayout();
+		///Point the single binding of the set at the whole pyramid buffer, levels are addressed through push constants
+		void LoadDescriptors(VkManagedDescriptorSet * set, uint32_t setIndex, VkBuffer pyramid);
+		///Make room for one readback per camera, call after the frame's fence was waited on and its results were read
+		void BeginFrame(uint32_t frameIndex, uint32_t cameraCount);
+		///Drop every readback, the next frames fall back to no Hi-Z until their pyramids arrive
+		void Invalidate();
+		///Load the readback the camera in slot queued when frameIndex was last recorded.
+		///False when there is none or the camera moved further than maxCameraMove since, 0 accepts any move
+		bool Read(uint32_t frameIndex, uint32_t slot, uint32_t cameraId, const glm::vec3& eye, float maxCameraMove, HiZDepth& depth);
+		///Copy depth, already in TRANSFER_SRC_OPTIMAL, into pyramid, reduce it and queue its readback. The set has to point at pyramid.
+		///The caller orders the copy after the depth writes and earlier uses of the pyramid, and the readback before host reads
+		void Build(VkCommandBuffer commandBuffer, VkManagedDescriptorSet * set, uint32_t setIndex, VkManagedImage * depth, VkBuffer pyramid, uint32_t frameIndex, uint32_t slot,
+			uint32_t cameraId, const glm::mat4& viewProjection, const VkViewport& viewport, const glm::vec3& eye);
+		///Bytes of the buffer holding every level, the pyramid only lives while Build records so the caller provides it
+		VkDeviceSize PyramidSize() const;
+		///Readbacks of every camera queued while frameIndex is recorded
+		VkManagedBuffer * Readbacks(uint32_t frameIndex);
+		uint32_t LevelCount() const;
+
+	private:
+		struct Level
+		{
+			uint32_t offset;
+			uint32_t width;
+			uint32_t height;
+		};
+
+		//what a readback slot holds once its frame completed
+		struct Readback
+		{
+			bool valid = false;
+			uint32_t cameraId = 0;
+			glm::mat4 viewProjection;
+			glm::vec4 viewport;
+			glm::vec3 eye;
+		};
+
+	private:
+		VkManagedDevice * m_mdevice = nullptr;
+		VkManagedPipeline * m_pipeline = nullptr;
+		std::vector<VkManagedBuffer*> m_readbacks;
+		std::vector<std::vector<Readback>> m_slots;
+		std::vector<Level> m_levels;
+		VkExtent2D m_extent = {};
+		DepthEncoding m_encoding = Float32;
+		VkDeviceSize m_pyramidSize = 0;
+		//bytes of one read back level
+		VkDeviceSize m_readbackSize = 0;
+	};
+}
@@ -9,9 +9,17 @@
 #include "VkManagedDescriptorPool.h"
 #include "VkManagedDescriptorSet.h"
 #include "VkManagedSemaphore.h"
+#include "VkManagedFence.h"
 #include "VkManagedSampler.h"
 #include "VkManagedRenderPass.h"
 #include "VkManagedPipeline.h"
+#include "VkManagedRingBuffer.h"
+#include "VkManagedGeometryPool.h"
+#include "VkManagedParallelRecorder.h"
+#include "DrawSortKey.h"
+#include "GpuCulling.h"
+#include "RenderGraph.h"
+#include "OcclusionBuffer.h"
 
 #include "SPIRVShader.h"
 #include "Camera.h"
@@ -22,12 +30,50 @@
 
 #include <SDL2\SDL_syswm.h>
 #include <algorithm>
+#include <cmath>
+#include <map>
+#include <glm\geometric.hpp>
 #include <functional>
+#include <thread>
 #include <SDL2\SDL.h>
 #include <SDL_image.h>
 
 using namespace std::placeholders;
 
+//draws handed to one recording worker, shorter lists are recorded inline
+static const size_t k_drawsPerRecordTask = 256;
+//resolution of the software occlusion depth, large occluders only need a coarse silhouette
+static const uint32_t k_occlusionWidth = 256;
+static const uint32_t k_occlusionHeight = 128;
+
+//pipeline field of the draw sort keys, one per pipeline a camera's draws can be shaded with
+enum DrawPipeline
+{
+	DrawPipelineSolid = 0,
+	DrawPipelineDepthEqual = 1,
+	DrawPipelineGBuffer = 2
+};
+
+//view and projection matrices pushed to the vertex stage of every pipeline drawing scene geometry
+static std::vector<VkPushConstantRange> CameraPushConstantRanges()
+{
+	VkPushConstantRange rangeView;
+	rangeView.offset = 0;
+	rangeView.size = 64;
+	rangeView.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	VkPushConstantRange rangeProj;
+	rangeProj.offset = 64;
+	rangeProj.size = 128;
+	rangeProj.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	return { rangeView,rangeProj };
+}
+
+static bool RectsOverlap(const VkRect2D& a, const VkRect2D& b)
+{
+	return a.offset.x < b.offset.x + static_cast<int32_t>(b.extent.width) && b.offset.x < a.offset.x + static_cast<int32_t>(a.extent.width) &&
+		a.offset.y < b.offset.y + static_cast<int32_t>(b.extent.height) && b.offset.y < a.offset.y + static_cast<int32_t>(a.extent.height);
+}
+
 Vulkan::KojinRenderer::KojinRenderer(SDL_Window * window, const char * appName, int appVer[3])
 {
 	int engineVer[3] = { RENDER_ENGINE_MAJOR_VERSION,RENDER_ENGINE_PATCH_VERSION,RENDER_ENGINE_MINOR_VERSION };
@@ -50,28 +96,21 @@ Vulkan::KojinRenderer::KojinRenderer(SDL_Window * window, const char * appName,
 		m_vkDevice = m_vkInstance->CreateVkManagedDevice(0, { VK_KHR_SWAPCHAIN_EXTENSION_NAME }, true, true, false, false, false);
 		m_vkPresentQueue = m_vkDevice->GetQueue(VK_QUEUE_GRAPHICS_BIT, true, false, true);
 		m_vkMainCmdPool = new VkManagedCommandPool(m_vkDevice, m_vkDevice->GetQueue(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, false, false, true));
-		m_vkSwapchain = new VkManagedSwapchain(m_vkDevice, m_vkMainCmdPool, VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_FORMAT_UNDEFINED);
+		m_vkSwapchain = new VkManagedSwapchain(m_vkDevice, m_vkMainCmdPool, 0, VK_FORMAT_UNDEFINED);
 		m_vkRenderpassFWD = new VkManagedRenderPass(m_vkDevice);
-		m_vkRenderpassFWD->Build(m_vkSwapchain->Extent(), VK_FORMAT_B8G8R8A8_UNORM, m_vkDevice->Depthformat());
-		m_vkRenderpassFWD->SetFrameBufferCount(1, true, false, true, false, false);
+		//cameras draw straight into the acquired swapchain image, each inside its own viewport
+		m_vkRenderpassFWD->Build(m_vkSwapchain->Extent(), m_vkSwapchain->Format(), m_vkDevice->Depthformat(), VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+		//one framebuffer per swapchain image, depth is copied out after the pass when Hi-Z culling is enabled
+		m_vkRenderpassFWD->SetFrameBufferTargets(m_vkSwapchain->SwapchainImages(), true, false, true);
 		m_vkPipelineFWD = new VkManagedPipeline(m_vkDevice);
 		
-		VkPushConstantRange rangeView;
-		rangeView.offset = 0;
-		rangeView.size = 64;
-		rangeView.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-		VkPushConstantRange rangeProj;
-		rangeProj.offset = 64;
-		rangeProj.size = 128;
-		rangeProj.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
 		m_vkPipelineFWD->Build(
 			m_vkRenderpassFWD, PipelineMode::Solid,
 			"shaders/vertex.vert.spv",
 			"shaders/fragment.frag.spv",
 			{ VK_DYNAMIC_STATE_SCISSOR,
 			VK_DYNAMIC_STATE_VIEWPORT
-			}, {rangeView,rangeProj});
+			}, CameraPushConstantRanges());
 
 		//m_vkRenderPassSDWProj = new VkManagedRenderPass(m_vkDevice);
 		//m_vkRenderPassSDWProj->Build({ VkShadowmapDefaults::k_resolution,VkShadowmapDefaults::k_resolution }, VkShadowmapDefaults::k_attachmentDepthFormat);
@@ -85,11 +124,29 @@ Vulkan::KojinRenderer::KojinRenderer(SDL_Window * window, const char * appName,
 		//	});
 
 		m_vkDescriptorPool = new VkManagedDescriptorPool(m_vkDevice);
-		m_vkDescriptorPool->SetDescriptorCount(VkDescriptorType::VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2);
-		m_vkDescriptorPool->SetDescriptorCount(VkDescriptorType::VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2);
-		m_semaphores = new VkManagedSemaphore(m_vkDevice, 2); // 1 present and 2 pass 
-		m_vkMainCmdPool->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_vkSwapchain->ImageCount(), m_swapChainbuffers);
+		//lights and material of the fragment set
+		m_vkDescriptorPool->SetDescriptorCount(VkDescriptorType::VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 2);
+		//the culling set has the most storage bindings of all layouts
+		m_vkDescriptorPool->SetDescriptorCount(VkDescriptorType::VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, GpuCulling::k_bindingCount);
+		m_vkDescriptorPool->SetDescriptorCount(VkDescriptorType::VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1);
+		//albedo, normal and depth read by the deferred lighting subpass
+		m_vkDescriptorPool->SetDescriptorCount(VkDescriptorType::VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 3);
+		//fences start signaled so the first wait on every frame returns immediately
+		m_imageAvailable = new VkManagedSemaphore(m_vkDevice, RENDER_ENGINE_FRAMES_IN_FLIGHT);
+		m_renderFinished = new VkManagedSemaphore(m_vkDevice, RENDER_ENGINE_FRAMES_IN_FLIGHT);
+		m_frameFences = new VkManagedFence(m_vkDevice, RENDER_ENGINE_FRAMES_IN_FLIGHT, true);
+		m_vkMainCmdPool->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, RENDER_ENGINE_FRAMES_IN_FLIGHT, m_frameCommandBuffers);
 		m_colorSampler = new VkManagedSampler(m_vkDevice, VkManagedSamplerMode::COLOR_NORMALIZED_COORDINATES, 16, VkBorderColor::VK_BORDER_COLOR_INT_OPAQUE_BLACK);
+		//one uniform and instance region per frame in flight, grown in Render once the object and camera counts are known
+		m_uniformRing = new VkManagedRingBuffer(m_vkDevice, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, 64 * 1024, RENDER_ENGINE_FRAMES_IN_FLIGHT);
+		m_geometryPool = new VkManagedGeometryPool(m_vkDevice, RENDER_ENGINE_FRAMES_IN_FLIGHT);
+		m_renderProxies = new RenderProxyPool(m_vkDevice, RENDER_ENGINE_FRAMES_IN_FLIGHT);
+		m_renderGraph = new RenderGraph(m_vkDevice, RENDER_ENGINE_FRAMES_IN_FLIGHT);
+		m_transientVersions.resize(RENDER_ENGINE_FRAMES_IN_FLIGHT, 0);
+		//the calling thread only waits while the workers record, so every other core gets one
+		uint32_t workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+		m_recorder = new VkManagedParallelRecorder(m_vkDevice, m_vkMainCmdPool->PoolQueue(), workerCount, RENDER_ENGINE_FRAMES_IN_FLIGHT, k_drawsPerRecordTask);
+		m_occlusionBuffer = new OcclusionBuffer(k_occlusionWidth, k_occlusionHeight, workerCount);
 	}
 	catch(...)
 	{
@@ -102,14 +159,33 @@ Vulkan::KojinRenderer::KojinRenderer(SDL_Window * window, const char * appName,
 
 Vulkan::KojinRenderer::~KojinRenderer()
 {
+	//frames may still be executing
+	m_vkDevice->WaitForIdle();
 	Clean();
-	delete(m_semaphores);
-	delete(m_meshIndexData);
-	delete(m_meshVertexData);
+	//images hold allocations of the device, they have to go before it does
+	m_deviceLoadedTextures.clear();
+	delete(m_recorder);
+	delete(m_renderGraph);
+	delete(m_gpuCulling);
+	delete(m_hiZPyramid);
+	delete(m_occlusionBuffer);
+	delete(m_frameCommandBuffers);
+	delete(m_frameFences);
+	delete(m_renderFinished);
+	delete(m_imageAvailable);
+	delete(m_geometryPool);
+	delete(m_renderProxies);
+	delete(m_uniformRing);
 	delete(m_vkRenderpassFWD);
 	delete(m_vkRenderPassSDWProj);
 	delete(m_vkPipelineFWD);
 	delete(m_vkPipelineSDWProj);
+	delete(m_vkPipelineBounds);
+	delete(m_vkPipelineDepth);
+	delete(m_vkPipelineFWDEqual);
+	delete(m_vkPipelineGBuffer);
+	delete(m_vkPipelineLighting);
+	delete(m_vkRenderpassDFR);
 	delete(m_vkDescriptorPool);
 	delete(m_vkSwapchain);
 	delete(m_vkMainCmdPool);
@@ -117,33 +193,65 @@ Vulkan::KojinRenderer::~KojinRenderer()
 	delete(m_vkInstance);
 }
 
-void Vulkan::KojinRenderer::Draw(std::vector<Mesh*> meshes, std::vector<Material*> materials)
+void Vulkan::KojinRenderer::Draw(const std::vector<Mesh*>& meshes, const std::vector<Material*>& materials)
 {
-	size_t meshSize = meshes.size();
-	assert(meshSize == materials.size());
-	
-	m_meshPartTransforms.reserve(meshSize);
-	m_meshPartMaterials.reserve(meshSize);
+	assert(meshes.size() == materials.size());
+	Draw(meshes.data(), materials.data(), meshes.size());
+}
 
-	for(Mesh* mesh : meshes)
+void Vulkan::KojinRenderer::Draw(Mesh * const * meshes, Material * const * materials, size_t count)
+{
+	//per object storage is cleared after every Render but keeps its capacity, so steady state submission never allocates
+	for (size_t i = 0; i < count; ++i)
 	{
-		if (std::find_if(m_meshDraws.begin(),m_meshDraws.end(),
-			[&mesh](std::pair<const uint32_t, int> a)->bool { return a.first == mesh->id; })!= m_meshDraws.end())
-		{
-			m_meshDraws[mesh->id]++;
-		}
-		else
-		{
-			m_meshDraws.insert(std::make_pair(mesh->id, 1));
-		}
-		m_objectCount++;
-		m_meshPartTransforms.push_back(mesh->modelMatrix);
+		assert(meshes[i] != nullptr && materials[i] != nullptr);
+		m_meshPartTransforms.push_back(meshes[i]->modelMatrix);
+		m_meshPartIds.push_back(meshes[i]->id);
+		m_meshPartMaterials.push_back(materials[i]);
 	}
+	m_objectCount += static_cast<int>(count);
+}
 
-	for(Material*mat : materials)
-		m_meshPartMaterials.push_back(mat);;
-	
+void Vulkan::KojinRenderer::Draw(Mesh * mesh, Material * material)
+{
+	Draw(&mesh, &material, 1);
+}
+
+void Vulkan::KojinRenderer::DrawOccluder(Mesh * mesh)
+{
+	assert(mesh != nullptr);
+	m_occluderTransforms.push_back(mesh->modelMatrix);
+	m_occluderIds.push_back(mesh->id);
+}
+
+Vulkan::RenderProxyHandle Vulkan::KojinRenderer::CreateRenderProxy(Mesh * mesh, Material * material)
+{
+	return m_renderProxies->Create(mesh, material, mesh->modelMatrix);
+}
+
+void Vulkan::KojinRenderer::SetRenderProxyTransform(RenderProxyHandle proxy, const glm::mat4 & transform)
+{
+	m_renderProxies->SetTransform(proxy, transform);
+}
+
+void Vulkan::KojinRenderer::SetRenderProxyMaterial(RenderProxyHandle proxy, Material * material)
+{
+	m_renderProxies->SetMaterial(proxy, material);
 }
+
+void Vulkan::KojinRenderer::DestroyRenderProxy(RenderProxyHandle proxy)
+{
+	m_renderProxies->Destroy(proxy);
+	//handles are reused, so neither a cached nor a pending result may reach the next proxy given this one
+	for (std::pair<const uint32_t, Camera*>& camera : m_cameras)
+	{
+		uint64_t key = (static_cast<uint64_t>(camera.first) << 32) | proxy;
+		m_occludedProxies.erase(key);
+		for (std::vector<uint64_t>& keys : m_queryKeys)
+			std::replace(keys.begin(), keys.end(), key, UINT64_MAX);
+	}
+}
+
 //void Vulkan::KojinRenderer::Load(std::weak_ptr<Vulkan::Mesh> mesh, Vulkan::Material * material)
 //{
 //	auto lockedMesh = mesh.lock();
@@ -162,7 +270,7 @@ void Vulkan::KojinRenderer::Draw(std::vector<Mesh*> meshes, std::vector<Material
 
 Vulkan::Camera * Vulkan::KojinRenderer::CreateCamera(glm::vec3 initialPosition, bool perspective)
 {
-	Camera * c = new Camera(m_vkSwapchain->Extent(), perspective, std::bind(&KojinRenderer::FreeCamera, this, _1));
+	Camera * c = new Camera(m_vkSwapchain->Extent(), perspective, std::bind(&KojinRenderer::FreeCamera, this, _1), std::bind(&KojinRenderer::BuildDepthPrepass, this, _1));
 	c->m_position = initialPosition;
 	c->m_rotation = { 0,0,0 };
 	m_cameras.insert(std::make_pair(c->id, c));
@@ -174,6 +282,28 @@ void Vulkan::KojinRenderer::FreeCamera(Camera * camera)
 	m_cameras.erase(camera->id);
 }
 
+void Vulkan::KojinRenderer::BuildDepthPrepass(Camera * camera)
+{
+	if (m_vkPipelineDepth != nullptr)
+		return;
+	m_vkPipelineDepth = new VkManagedPipeline(m_vkDevice);
+	m_vkPipelineDepth->Build(
+		m_vkRenderpassFWD, PipelineMode::DepthPrepass,
+		"shaders/depth.vert.spv",
+		nullptr,
+		{ VK_DYNAMIC_STATE_SCISSOR,
+		VK_DYNAMIC_STATE_VIEWPORT
+		}, CameraPushConstantRanges());
+	m_vkPipelineFWDEqual = new VkManagedPipeline(m_vkDevice);
+	m_vkPipelineFWDEqual->Build(
+		m_vkRenderpassFWD, PipelineMode::SolidDepthEqual,
+		"shaders/vertex.vert.spv",
+		"shaders/fragment.frag.spv",
+		{ VK_DYNAMIC_STATE_SCISSOR,
+		VK_DYNAMIC_STATE_VIEWPORT
+		}, CameraPushConstantRanges());
+}
+
 Vulkan::Light * Vulkan::KojinRenderer::CreateLight(glm::vec3 initialPosition)
 {
 	Light * l = new Light(initialPosition, std::bind(&KojinRenderer::FreeLight, this, _1));
@@ -270,6 +400,7 @@ Vulkan::Texture * Vulkan::KojinRenderer::LoadTexture(std::string filepath, bool
 	auto image = std::make_shared<VkManagedImage>(m_vkDevice);
 	m_virtualTextures.insert(std::make_pair(texture->id, texture));
 	m_deviceLoadedTextures.insert(std::make_pair(texture->id,image));
+	m_descriptorsDirty = true;
 	image->Build({ static_cast<uint32_t>(surf->w),static_cast<uint32_t>(surf->h) }, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1, VK_IMAGE_TILING_OPTIMAL, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
 	VkManagedCommandBuffer cmdbuff = m_vkMainCmdPool->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
 	VkManagedQueue * cmdPoolQueue = m_vkMainCmdPool->PoolQueue();
@@ -289,6 +420,7 @@ Vulkan::Texture * Vulkan::KojinRenderer::GetTextureWhite()
 	m_whiteTexture = new Vulkan::Texture(nullptr, w, h, 4);
 	auto image = std::make_shared<VkManagedImage>(m_vkDevice);
 	m_deviceLoadedTextures.insert(std::make_pair(m_whiteTexture->id, image));
+	m_descriptorsDirty = true;
 	image->Build({w,h }, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
 	VkManagedCommandBuffer cmdbuff = m_vkMainCmdPool->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
 	VkManagedQueue * cmdPoolQueue = m_vkMainCmdPool->PoolQueue();
@@ -303,71 +435,455 @@ void Vulkan::KojinRenderer::FreeTexture(Texture * tex)
 	assert(tex->id != m_whiteTexture->id); // can't delete internal texture
 	assert(m_deviceLoadedTextures.count(tex->id) != 0);
 	m_deviceLoadedTextures.erase(tex->id);
+	m_descriptorsDirty = true;
 	delete tex;
 }
 
 void Vulkan::KojinRenderer::Render()
 {
+	//the device has to be done with the frame that last used these resources before any of them is touched
+	m_frameFences->Wait(m_frameIndex);
+
 	//acquire image
 	uint32_t scImage = 0;
-	m_vkSwapchain->AcquireNextImage(&scImage, m_semaphores->Next()); //handle sc return
+	m_vkSwapchain->AcquireNextImage(&scImage, m_imageAvailable->GetSemaphore(m_frameIndex)); //handle sc return
 
 	bool rebuild = false;
 	if(m_objectCount != m_objectCountOld)
 	{
 		m_objectCountOld = m_objectCount;
-		this->UpdateInternalMesh(m_vkMainCmdPool, 
-			Mesh::m_iMeshVertices.data(), static_cast<uint32_t>(Mesh::m_iMeshVertices.size()), 
-			Mesh::m_iMeshIndices.data(), static_cast<uint32_t>(Mesh::m_iMeshIndices.size()));
-		
-		if(m_vkDescriptorPool->Size() < m_objectCount*3)
-		{
-			m_vkDescriptorPool->BuildPool(m_objectCount*3);
-			m_vkDescriptorPool->AllocateDescriptorSet(m_objectCount, m_vkPipelineFWD->GetVertexLayout(), m_vDescriptorSetFWD);
-			m_vkDescriptorPool->AllocateDescriptorSet(m_objectCount, m_vkPipelineFWD->GetFragmentLayout(),m_fDescriptorSetFWD);
-			//m_vkDescriptorPool->AllocateDescriptorSet(m_objectCount, m_vkPipelineSDWProj->GetVertexLayout(), m_vDescriptorSetFWD);
-			CreateUniformBufferSet(m_uniformVStagingBufferFWD,m_uniformVBuffersFWD,m_objectCount,sizeof(VertexShaderMVP));
-			CreateUniformBufferSet(m_uniformFStagingBufferFWD, m_uniformFBuffersFWD, m_objectCount, sizeof(LightingUniformBuffer));
-			//CreateUniformBufferSet(m_uniformStagingBufferSDWProj, m_uniformBuffersSDWProj, m_objectCount, sizeof(VertexDepthMVP));
-			//make sure to delete all buffers on clean function call
-		
-		}
 
 		rebuild = true;
 	}
 	UpdateShadowmapLayers();
 
-	//update uniform buffers
+	//queries recorded the last time this frame slot was used are complete, the proxies they found hidden are skipped until newer results arrive
+	bool occlusionQueries = m_occlusionQueriesEnabled && !m_gpuCullingEnabled && !m_deferredEnabled;
+	if (m_occlusionQueriesEnabled)
+	{
+		std::vector<uint64_t>& keys = m_queryKeys[m_frameIndex];
+		m_occludedProxies.clear();
+		if (m_vkRenderpassFWD->OcclusionResults(m_frameIndex, 0, static_cast<uint32_t>(keys.size()), m_querySamples))
+		{
+			for (size_t q = 0; q < keys.size(); ++q)
+			{
+				if (m_querySamples[q] == 0 && keys[q] != UINT64_MAX)
+					m_occludedProxies.insert(keys[q]);
+			}
+		}
+		keys.clear();
+	}
+
+	//the instance descriptor covers a fixed number of transforms, grow it ahead of the object count
+	if (static_cast<uint32_t>(m_objectCountOld) > m_instanceCapacity)
+	{
+		m_instanceCapacity = std::max(static_cast<uint32_t>(m_objectCountOld), m_instanceCapacity * 2);
+		m_descriptorsDirty = true;
+	}
+
+	//retained proxies keep their own instance buffer, only the ones changed since this frame region was last used are written
+	if (m_renderProxies->Update(m_frameIndex))
+		m_descriptorsDirty = true;
+	const std::vector<VkIndexedDraw>& proxyDraws = m_renderProxies->Draws();
+	const std::vector<const Material*>& proxyMaterials = m_renderProxies->DrawMaterials();
 
-	//write descriptors here!
-	for (uint32_t oc = 0; oc < m_objectCountOld; ++oc)
+	//every camera writes one visible index per object and proxy that passed culling
+	uint32_t cullableCount = static_cast<uint32_t>(m_objectCountOld) + m_renderProxies->Count();
+	if (cullableCount > m_visibleCapacity)
 	{
-		WriteDescriptors(oc);
+		m_visibleCapacity = std::max(cullableCount, m_visibleCapacity * 2);
+		m_descriptorsDirty = true;
 	}
 
+	//lights are binned for every camera ahead of sizing the ring, the longest index list decides the room clusters take
+	std::vector<std::vector<VkLight>> cameraLights(m_cameras.size());
+	std::vector<uint32_t> directionalCounts(m_cameras.size());
+	m_lightClusters.resize(m_cameras.size());
+	{
+		uint32_t clusterIndexCount = 0;
+		uint32_t cameraIndex = 0;
+		for (std::pair<const uint32_t, Camera*>& camera : m_cameras)
+		{
+			directionalCounts[cameraIndex] = BinLights(camera.second, cameraLights[cameraIndex], m_lightClusters[cameraIndex]);
+			clusterIndexCount = std::max(clusterIndexCount, m_lightClusters[cameraIndex].IndexCount());
+			cameraIndex++;
+		}
+		if (static_cast<uint32_t>(m_lights.size()) > m_lightCapacity)
+		{
+			m_lightCapacity = std::max(static_cast<uint32_t>(m_lights.size()), m_lightCapacity * 2);
+			m_descriptorsDirty = true;
+		}
+		if (clusterIndexCount > m_clusterIndexCapacity)
+		{
+			m_clusterIndexCapacity = std::max(clusterIndexCount, m_clusterIndexCapacity * 2);
+			m_descriptorsDirty = true;
+		}
+	}
+
+	//one instance slice per frame, a visible list and lighting slices per camera and a material slice per batch, there are never more batches than objects
+	VkDeviceSize frameUniformSize = m_uniformRing->AlignedSize(m_instanceCapacity * sizeof(glm::mat4)) +
+		m_cameras.size() * (m_uniformRing->AlignedSize(m_visibleCapacity * sizeof(uint32_t)) + m_uniformRing->AlignedSize(sizeof(LightingUniformBuffer)) +
+			m_uniformRing->AlignedSize(m_lightCapacity * sizeof(VkLight)) + m_uniformRing->AlignedSize(LightClusters::DataSize(m_clusterIndexCapacity) * sizeof(uint32_t))) +
+		(m_objectCountOld + proxyDraws.size()) * m_uniformRing->AlignedSize(sizeof(MaterialUniformBuffer));
+	//GPU culling adds the records of the frame and a command list with its remap per camera
+	if (m_gpuCullingEnabled)
+	{
+		frameUniformSize += m_uniformRing->AlignedSize(m_visibleCapacity * sizeof(GpuCullRecord)) +
+			m_cameras.size() * (m_uniformRing->AlignedSize(m_visibleCapacity * sizeof(VkDrawIndexedIndirectCommand)) + m_uniformRing->AlignedSize(m_visibleCapacity * sizeof(uint32_t)));
+	}
+	if (frameUniformSize > m_uniformRing->FrameSize())
+	{
+		m_vkDevice->WaitForIdle();
+		m_uniformRing->Reserve(frameUniformSize);
+		m_descriptorsDirty = true;
+	}
+
+	//sets only reference the ring buffer and textures, so they are rewritten when either changes
+	if (m_descriptorsDirty)
+	{
+		m_vkDevice->WaitForIdle();
+		WriteDescriptors();
+		m_descriptorsDirty = false;
+	}
+
+	//the deferred pass also clears its G-buffer, a view depth of 0 marks pixels nothing was drawn to
+	VkManagedRenderPass * scenePass = m_deferredEnabled ? m_vkRenderpassDFR : m_vkRenderpassFWD;
+	VkManagedPipeline * scenePipeline = m_deferredEnabled ? m_vkPipelineGBuffer : m_vkPipelineFWD;
 	std::vector<VkClearValue> clearValues;
-	clearValues.resize(2);
+	clearValues.resize(m_deferredEnabled ? 5 : 2);
 	clearValues[0].color = { 0,0,0,1.0 };
 	clearValues[1].depthStencil = { (uint32_t)1.0f, (uint32_t)0.0f };
-
-	std::vector<VkIndexedDraw> indexdraws;
-	indexdraws.resize(m_objectCount);
+	for (size_t c = 2; c < clearValues.size(); ++c)
+		clearValues[c].color = { 0,0,0,0 };
+
+	//objects sharing a mesh and material collapse into one instanced draw
+	std::vector<VkIndexedDraw> batchDraws;
+	std::vector<const Material*> batchMaterials;
+	std::vector<uint32_t> batchMeshIds;
+	std::vector<const IMeshData*> batchMeshData;
+	std::vector<uint32_t> objectBatches(m_objectCountOld);
 	{
-		uint32_t objIndex = 0;
-		for(std::pair<const uint32_t,int>& pair : m_meshDraws)
+		std::map<std::pair<uint32_t, const Material*>, uint32_t> batchLookup;
+		for (uint32_t oc = 0; oc < m_objectCountOld; ++oc)
 		{
-			IMeshData * meshD = Mesh::GetMeshData(pair.first);
-			for(int i = 0; i < pair.second;++i)
+			std::pair<uint32_t, const Material*> key = std::make_pair(m_meshPartIds[oc], m_meshPartMaterials[oc]);
+			auto batch = batchLookup.find(key);
+			if (batch == batchLookup.end())
 			{
-				indexdraws[objIndex].indexCount = meshD->indiceCount;
-				indexdraws[objIndex].indexStart = meshD->indiceRange.start;
-				indexdraws[objIndex].vertexOffset = meshD->vertexRange.start;
-				objIndex++;
+				IMeshData * meshD = Mesh::GetMeshData(key.first);
+				VkIndexedDraw draw;
+				draw.indexCount = meshD->indiceCount;
+				draw.indexStart = meshD->indiceRange.start;
+				draw.vertexOffset = meshD->vertexRange.start;
+				draw.instanceCount = 0;
+				draw.descriptorSets[1] = m_textureDescriptorIndices[key.second->albedo->id];
+				batch = batchLookup.insert(std::make_pair(key, static_cast<uint32_t>(batchDraws.size()))).first;
+				batchDraws.push_back(draw);
+				batchMaterials.push_back(key.second);
+				batchMeshIds.push_back(key.first);
+				batchMeshData.push_back(meshD);
 			}
+			objectBatches[oc] = batch->second;
+			batchDraws[batch->second].instanceCount++;
+		}
 
+		uint32_t firstInstance = 0;
+		for (VkIndexedDraw& draw : batchDraws)
+		{
+			draw.firstInstance = firstInstance;
+			firstInstance += draw.instanceCount;
+		}
+	}
 
+	//transforms are written once per frame grouped by batch, every camera reads the same instance slice through its own visible list
+	std::vector<std::vector<VkIndexedDraw>> cameraDraws;
+	//bounding boxes queried after the draws of every camera
+	std::vector<std::vector<VkOcclusionQueryDraw>> cameraQueries;
+	//ring offsets of the cluster fields, light list and clusters of every camera, read again by the deferred lighting subpass
+	std::vector<uint32_t> cameraLightOffsets(m_cameras.size() * 3);
+	//ring regions and constants of the culling dispatch of every camera
+	struct CullDispatch
+	{
+		uint32_t offsets[GpuCulling::k_bindingCount];
+		GpuCullingConstants constants;
+	};
+	std::vector<CullDispatch> cullDispatches;
+	{
+		m_uniformRing->BeginFrame(m_frameIndex);
+		m_materialOffsets.clear();
+		VkDeviceSize instanceOffset = 0;
+		glm::mat4 * instances = static_cast<glm::mat4*>(m_uniformRing->Allocate(m_instanceCapacity * sizeof(glm::mat4), instanceOffset));
+		std::vector<uint32_t> batchFill(batchDraws.size(), 0);
+		std::vector<glm::vec3> batchCenters(batchDraws.size(), glm::vec3(0.0f));
+		std::vector<uint32_t> objectSlots(m_objectCountOld);
+		CullingSpheres objectBounds;
+		objectBounds.Resize(m_objectCountOld);
+		for (uint32_t oc = 0; oc < m_objectCountOld; ++oc)
+		{
+			uint32_t batch = objectBatches[oc];
+			objectSlots[oc] = batchDraws[batch].firstInstance + batchFill[batch]++;
+			instances[objectSlots[oc]] = m_meshPartTransforms[oc];
+			batchCenters[batch] += glm::vec3(m_meshPartTransforms[oc][3]);
+			objectBounds.Set(oc, m_meshPartTransforms[oc], batchMeshData[batch]->boundsCenter, batchMeshData[batch]->boundsRadius);
+		}
+		for (size_t b = 0; b < batchDraws.size(); ++b)
+		{
+			batchDraws[b].dynamicOffsets[0] = static_cast<uint32_t>(instanceOffset);
+			batchCenters[b] /= static_cast<float>(batchDraws[b].instanceCount);
+		}
+		const std::vector<glm::vec3>& proxyCenters = m_renderProxies->DrawCenters();
+		const std::vector<uint32_t>& proxyMeshIds = m_renderProxies->DrawMeshIds();
+		const CullingSpheres& proxyBounds = m_renderProxies->Bounds();
+		const std::vector<uint32_t>& proxySlots = m_renderProxies->InstanceSlots();
+		const std::vector<uint32_t>& proxyBatches = m_renderProxies->ProxyBatches();
+		const std::vector<glm::mat4>& proxyTransforms = m_renderProxies->Transforms();
+		const std::vector<uint32_t>& proxyMeshes = m_renderProxies->MeshIds();
+		const std::vector<RenderProxyHandle>& proxyHandles = m_renderProxies->Handles();
+		size_t batchCount = batchDraws.size();
+		size_t sourceCount = batchCount + proxyDraws.size();
+		std::vector<uint32_t> visibleObjects;
+		std::vector<uint32_t> visibleProxies;
+		std::vector<uint32_t> drawVisible;
+		std::vector<uint32_t> drawFill;
+		std::vector<uint32_t> drawSources;
+		std::vector<uint64_t> sortKeys;
+		std::vector<uint32_t> sortOrder;
+		//materials numbered in the order the frame first draws them, so draws of one material end up next to each other
+		std::unordered_map<const Material*, uint32_t> materialIds;
+		std::vector<VkIndexedDraw> unsortedDraws;
+
+		//on the GPU path every object is uploaded once, each camera's dispatch reads the same records
+		VkDeviceSize recordOffset = 0;
+		uint32_t recordCount = static_cast<uint32_t>(m_objectCountOld + proxySlots.size());
+		if (m_gpuCullingEnabled)
+		{
+			GpuCullRecord * records = static_cast<GpuCullRecord*>(m_uniformRing->Allocate(m_visibleCapacity * sizeof(GpuCullRecord), recordOffset));
+			GpuCullRecord record = {};
+			for (uint32_t oc = 0; oc < m_objectCountOld; ++oc)
+			{
+				record.sphere = glm::vec4(objectBounds.x[oc], objectBounds.y[oc], objectBounds.z[oc], objectBounds.radius[oc]);
+				record.draw = objectBatches[oc];
+				record.instance = objectSlots[oc];
+				records[oc] = record;
+			}
+			for (uint32_t p = 0; p < proxySlots.size(); ++p)
+			{
+				record.sphere = glm::vec4(proxyBounds.x[p], proxyBounds.y[p], proxyBounds.z[p], proxyBounds.radius[p]);
+				record.draw = static_cast<uint32_t>(batchCount) + proxyBatches[p];
+				record.instance = proxySlots[p];
+				records[m_objectCountOld + p] = record;
+			}
+			cullDispatches.resize(m_cameras.size());
+		}
+
+		cameraDraws.resize(m_cameras.size());
+		cameraQueries.resize(m_cameras.size());
+		m_visibleInstances = 0;
+		bool hiZCulling = m_hiZEnabled && !m_gpuCullingEnabled;
+		uint32_t cameraIndex = 0;
+		for (std::pair<const uint32_t, Camera*>& camera : m_cameras)
+		{
+			const Camera * cam = camera.second;
+			glm::mat4 viewProjection = cam->m_projectionMatrix * cam->m_viewMatrix;
+			Frustum frustum = Frustum::FromViewProjection(viewProjection);
+			bool perspective = cam->m_projectionMatrix[3][3] == 0.0f;
+			float screenScale = std::abs(cam->m_projectionMatrix[1][1]) * cam->m_viewPort.height * 0.5f;
+			visibleObjects.clear();
+			visibleProxies.clear();
+			drawVisible.assign(sourceCount, 0);
+			if (m_gpuCullingEnabled)
+			{
+				//the dispatch fills the lists, every draw reserves room for all of its instances
+				for (size_t d = 0; d < sourceCount; ++d)
+					drawVisible[d] = d < batchCount ? batchDraws[d].instanceCount : proxyDraws[d - batchCount].instanceCount;
+			}
+			else
+			{
+				CullSpheres(frustum, objectBounds, screenScale, perspective, m_cullingSettings, visibleObjects);
+				CullSpheres(frustum, proxyBounds, screenScale, perspective, m_cullingSettings, visibleProxies);
+				//the software buffer holds this frame's occluders, the Hi-Z depth whatever was drawn when this frame slot was last used
+				bool softwareOcclusion = !m_occluderIds.empty();
+				bool hiZOcclusion = hiZCulling && m_hiZPyramid->Read(m_frameIndex, cameraIndex, cam->id, cam->m_position, m_cullingSettings.hiZMaxCameraMove, m_hiZDepth);
+				if (softwareOcclusion)
+				{
+					m_occlusionBuffer->Begin(viewProjection);
+					for (size_t o = 0; o < m_occluderIds.size(); ++o)
+					{
+						IMeshData * meshD = Mesh::GetMeshData(m_occluderIds[o]);
+						m_occlusionBuffer->AddOccluder(&Mesh::m_iMeshVertices[meshD->vertexRange.start].pos, sizeof(VkVertex),
+							&Mesh::m_iMeshIndices[meshD->indiceRange.start], meshD->indiceCount, m_occluderTransforms[o]);
+					}
+					m_occlusionBuffer->Rasterize();
+				}
+				if (softwareOcclusion || hiZOcclusion)
+				{
+					//only what survived the frustum is tested, boxes fully behind either depth are dropped
+					float depthBias = m_cullingSettings.hiZDepthBias;
+					auto isVisible = [&](const glm::mat4& transform, const IMeshData * meshD)
+					{
+						return (!softwareOcclusion || m_occlusionBuffer->IsVisible(transform, meshD->boundsCenter, meshD->boundsExtents)) &&
+							(!hiZOcclusion || m_hiZDepth.IsVisible(transform, meshD->boundsCenter, meshD->boundsExtents, depthBias));
+					};
+					size_t kept = 0;
+					for (uint32_t oc : visibleObjects)
+					{
+						if (isVisible(m_meshPartTransforms[oc], batchMeshData[objectBatches[oc]]))
+							visibleObjects[kept++] = oc;
+					}
+					visibleObjects.resize(kept);
+					kept = 0;
+					for (uint32_t p : visibleProxies)
+					{
+						if (isVisible(proxyTransforms[p], Mesh::GetMeshData(proxyMeshes[p])))
+							visibleProxies[kept++] = p;
+					}
+					visibleProxies.resize(kept);
+				}
+				if (occlusionQueries)
+				{
+					//every large proxy left is queried again, the ones an earlier query found hidden are not drawn
+					std::vector<uint64_t>& keys = m_queryKeys[m_frameIndex];
+					std::vector<VkOcclusionQueryDraw>& queries = cameraQueries[cameraIndex];
+					const glm::vec4& nearPlane = frustum.planes[Frustum::k_nearPlane];
+					size_t kept = 0;
+					for (uint32_t p : visibleProxies)
+					{
+						const IMeshData * meshD = Mesh::GetMeshData(proxyMeshes[p]);
+						glm::vec3 center(proxyBounds.x[p], proxyBounds.y[p], proxyBounds.z[p]);
+						//flat boxes cover no samples and boxes cut by the near plane may lose theirs, those proxies stay visible unqueried
+						bool queried = meshD->indiceCount / 3 >= m_cullingSettings.queryMinTriangles &&
+							std::min(std::min(meshD->boundsExtents.x, meshD->boundsExtents.y), meshD->boundsExtents.z) > 0.0f &&
+							glm::dot(glm::vec3(nearPlane), center) + nearPlane.w > proxyBounds.radius[p];
+						if (!queried)
+						{
+							visibleProxies[kept++] = p;
+							continue;
+						}
+						glm::mat4 box(glm::vec4(meshD->boundsExtents.x, 0.0f, 0.0f, 0.0f), glm::vec4(0.0f, meshD->boundsExtents.y, 0.0f, 0.0f),
+							glm::vec4(0.0f, 0.0f, meshD->boundsExtents.z, 0.0f), glm::vec4(meshD->boundsCenter, 1.0f));
+						glm::mat4 boxToClip = viewProjection * proxyTransforms[p] * box;
+						VkOcclusionQueryDraw query;
+						memcpy(query.boxToClip, &boxToClip, sizeof(query.boxToClip));
+						query.query = static_cast<uint32_t>(keys.size());
+						queries.push_back(query);
+						uint64_t key = (static_cast<uint64_t>(camera.first) << 32) | proxyHandles[p];
+						keys.push_back(key);
+						if (m_occludedProxies.count(key) == 0)
+							visibleProxies[kept++] = p;
+					}
+					visibleProxies.resize(kept);
+				}
+				//visible instances are counted per draw, batch draws come first and proxy draws follow
+				for (uint32_t oc : visibleObjects)
+					drawVisible[objectBatches[oc]]++;
+				for (uint32_t p : visibleProxies)
+					drawVisible[batchCount + proxyBatches[p]]++;
+			}
+			drawFill.resize(sourceCount);
+			uint32_t visibleCount = 0;
+			for (size_t d = 0; d < sourceCount; ++d)
+			{
+				drawFill[d] = visibleCount;
+				visibleCount += drawVisible[d];
+			}
+			VkDeviceSize visibleOffset = 0;
+			uint32_t * visibleIndices = static_cast<uint32_t*>(m_uniformRing->Allocate(m_visibleCapacity * sizeof(uint32_t), visibleOffset));
+			for (uint32_t oc : visibleObjects)
+				visibleIndices[drawFill[objectBatches[oc]]++] = objectSlots[oc];
+			for (uint32_t p : visibleProxies)
+				visibleIndices[drawFill[batchCount + proxyBatches[p]]++] = proxySlots[p];
+			if (!m_gpuCullingEnabled)
+				m_visibleInstances += visibleCount;
+
+			//draws without a visible instance are dropped, the fill counters now point past each draw's indices
+			std::vector<VkIndexedDraw>& draws = cameraDraws[cameraIndex];
+			uint32_t * lightOffsets = &cameraLightOffsets[cameraIndex * 3];
+			WriteLights(cam, cameraLights[cameraIndex], directionalCounts[cameraIndex], m_lightClusters[cameraIndex], lightOffsets);
+			drawSources.clear();
+			for (uint32_t d = 0; d < sourceCount; ++d)
+			{
+				if (drawVisible[d] == 0)
+					continue;
+				bool batched = d < batchCount;
+				VkIndexedDraw draw;
+				if (batched)
+				{
+					draw = batchDraws[d];
+				}
+				else
+				{
+					//proxy instances are read through the second vertex set
+					draw = proxyDraws[d - batchCount];
+					draw.descriptorSets[0] = 1;
+					draw.descriptorSets[1] = m_textureDescriptorIndices[proxyMaterials[d - batchCount]->albedo->id];
+				}
+				draw.firstInstance = drawFill[d] - drawVisible[d];
+				draw.instanceCount = drawVisible[d];
+				//vertex set offsets come first, instances and then the visible list, the fragment set reads the cluster fields, material, lights and clusters
+				draw.dynamicOffsets[1] = static_cast<uint32_t>(visibleOffset);
+				draw.dynamicOffsets[2] = lightOffsets[0];
+				draw.dynamicOffsets[3] = WriteMaterial(batched ? batchMaterials[d] : proxyMaterials[d - batchCount]);
+				draw.dynamicOffsets[4] = lightOffsets[1];
+				draw.dynamicOffsets[5] = lightOffsets[2];
+				draw.dynamicOffsetCount = 6;
+				draws.push_back(draw);
+				drawSources.push_back(d);
+			}
 
+			//state heavy fields first so binds are shared, then front to back for early depth rejection
+			uint32_t pipeline = m_deferredEnabled ? DrawPipelineGBuffer : cam->m_depthPrepass ? DrawPipelineDepthEqual : DrawPipelineSolid;
+			size_t drawCount = draws.size();
+			sortKeys.resize(drawCount);
+			sortOrder.resize(drawCount);
+			for (uint32_t d = 0; d < drawCount; ++d)
+			{
+				uint32_t source = drawSources[d];
+				bool batched = source < batchCount;
+				const glm::vec3& center = batched ? batchCenters[source] : proxyCenters[source - batchCount];
+				uint32_t meshId = batched ? batchMeshIds[source] : proxyMeshIds[source - batchCount];
+				const Material * material = batched ? batchMaterials[source] : proxyMaterials[source - batchCount];
+				uint32_t materialId = materialIds.emplace(material, static_cast<uint32_t>(materialIds.size())).first->second;
+				float viewDepth = -(cam->m_viewMatrix * glm::vec4(center, 1.0f)).z;
+				sortKeys[d] = DrawSortKey::Make(pipeline, materialId, meshId, viewDepth, cam->m_zNear, cam->m_zFar);
+				sortOrder[d] = d;
+			}
+			RadixSort(sortKeys, sortOrder);
+			unsortedDraws.swap(draws);
+			draws.resize(drawCount);
+			for (size_t d = 0; d < drawCount; ++d)
+				draws[d] = unsortedDraws[sortOrder[d]];
+
+			//commands are written in draw order so neighbours sharing their bindings can be issued as one multi draw
+			if (m_gpuCullingEnabled)
+			{
+				CullDispatch& dispatch = cullDispatches[cameraIndex];
+				VkDeviceSize remapOffset = 0;
+				VkDeviceSize commandOffset = 0;
+				uint32_t * remap = static_cast<uint32_t*>(m_uniformRing->Allocate(m_visibleCapacity * sizeof(uint32_t), remapOffset));
+				VkDrawIndexedIndirectCommand * commands = static_cast<VkDrawIndexedIndirectCommand*>(m_uniformRing->Allocate(m_visibleCapacity * sizeof(VkDrawIndexedIndirectCommand), commandOffset));
+				for (uint32_t d = 0; d < drawCount; ++d)
+				{
+					VkIndexedDraw& draw = draws[d];
+					VkDrawIndexedIndirectCommand command;
+					command.indexCount = draw.indexCount;
+					command.instanceCount = 0;
+					command.firstIndex = draw.indexStart;
+					command.vertexOffset = static_cast<int32_t>(draw.vertexOffset);
+					command.firstInstance = draw.firstInstance;
+					commands[d] = command;
+					remap[drawSources[sortOrder[d]]] = d;
+					draw.indirectBuffer = *m_uniformRing;
+					draw.indirectOffset = commandOffset + d * sizeof(VkDrawIndexedIndirectCommand);
+				}
+				dispatch.offsets[0] = static_cast<uint32_t>(recordOffset);
+				dispatch.offsets[1] = static_cast<uint32_t>(remapOffset);
+				dispatch.offsets[2] = static_cast<uint32_t>(commandOffset);
+				dispatch.offsets[3] = static_cast<uint32_t>(visibleOffset);
+				dispatch.constants = GpuCulling::MakeConstants(frustum, screenScale, perspective, m_cullingSettings, recordCount);
+			}
+			cameraIndex++;
 		}
+		m_uniformRing->EndFrame();
 	}
 	//set states for the forward render pipeline
 	VkDynamicStatesBlock states;
@@ -376,22 +892,108 @@ void Vulkan::KojinRenderer::Render()
 	states.hasViewport = VK_TRUE;
 	states.hasScissor = VK_TRUE;
 
-	m_swapChainbuffers->Begin(VkCommandBufferUsageFlagBits::VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
-	for(uint32_t cmdIndex = 0; cmdIndex < m_swapChainbuffers->Size(); ++cmdIndex)
+	//only the acquired image is written, so a single command buffer per frame is recorded and submitted
+	VkCommandBuffer cBuffer = m_frameCommandBuffers->Begin(VkCommandBufferUsageFlagBits::VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, m_frameIndex);
+	//newly loaded geometry is copied ahead of the passes, the graph makes the copies visible to the draws
+	m_geometryPool->BeginFrame(m_frameIndex);
+	m_recorder->BeginFrame(m_frameIndex);
+	scenePass->ResetStatistics();
+	bool geometryUploaded = m_geometryPool->Upload(cBuffer,
+		Mesh::m_iMeshVertices.data(), static_cast<uint32_t>(Mesh::m_iMeshVertices.size()),
+		Mesh::m_iMeshIndices.data(), static_cast<uint32_t>(Mesh::m_iMeshIndices.size()));
+	//the passes only declare what they touch, the graph drops the ones nothing presented or read back depends on and batches their barriers
+	m_renderGraph->Begin(m_frameIndex);
+	uint32_t ringResource = m_renderGraph->ImportBuffer(*m_uniformRing, RenderGraph::Undefined);
+	uint32_t vertexResource = UINT32_MAX;
+	uint32_t indexResource = UINT32_MAX;
+	if (m_geometryPool->VertexBuffer() != nullptr && m_geometryPool->IndexBuffer() != nullptr)
 	{
-		VkCommandBuffer cBuffer = m_swapChainbuffers->Buffer(cmdIndex);
-		for (std::pair<uint32_t, Camera*> camera : m_cameras)
+		RenderGraph::Usage geometryUsage = geometryUploaded ? RenderGraph::TransferWrite : RenderGraph::Undefined;
+		vertexResource = m_renderGraph->ImportBuffer(*m_geometryPool->VertexBuffer(), geometryUsage);
+		indexResource = m_renderGraph->ImportBuffer(*m_geometryPool->IndexBuffer(), geometryUsage);
+		//a later grow copies out of the streams, so the copies are made visible to transfers as well
+		if (geometryUploaded)
 		{
-			for (uint32_t oc = 0; oc < m_objectCountOld; ++oc)
+			m_renderGraph->Retain(vertexResource, RenderGraph::TransferRead);
+			m_renderGraph->Retain(indexResource, RenderGraph::TransferRead);
+		}
+	}
+	//all cameras are culled ahead of the passes, the scene pass waits for every command list at once
+	if (!cullDispatches.empty())
+	{
+		uint32_t cullPass = m_renderGraph->AddPass("Culling", [&](VkCommandBuffer commandBuffer)
+		{
+			for (const CullDispatch& dispatch : cullDispatches)
+				m_gpuCulling->Dispatch(commandBuffer, m_cDescriptorSetCull, 0, dispatch.offsets, dispatch.constants);
+		});
+		m_renderGraph->Read(cullPass, ringResource, RenderGraph::ComputeRead);
+		m_renderGraph->Write(cullPass, ringResource, RenderGraph::ComputeWrite);
+	}
+	//readbacks of this frame slot were consumed while culling, every camera queues a new one after the pass
+	bool hiZBuild = m_hiZEnabled && !m_gpuCullingEnabled;
+	if (hiZBuild)
+		m_hiZPyramid->BeginFrame(m_frameIndex, static_cast<uint32_t>(m_cameras.size()));
+	if (occlusionQueries)
+		m_vkRenderpassFWD->ReserveOcclusionQueries(m_frameIndex, static_cast<uint32_t>(m_queryKeys[m_frameIndex].size()));
+	//every camera draws into the one pass over the acquired image, a camera whose region overlaps an earlier one clears it first and hides the earlier one's depth there
+	std::vector<bool> clearsRegion(m_cameras.size(), false);
+	std::vector<bool> depthOverdrawn(m_cameras.size(), false);
+	{
+		uint32_t cameraIndex = 0;
+		for (std::pair<const uint32_t, Camera*>& camera : m_cameras)
+		{
+			uint32_t earlierIndex = 0;
+			for (std::pair<const uint32_t, Camera*>& earlier : m_cameras)
 			{
-				UpdateUniformBuffer(cBuffer, oc, m_meshPartTransforms[oc], camera.second->m_viewMatrix, camera.second->m_projectionMatrix, m_meshPartMaterials[oc]);
+				if (earlierIndex == cameraIndex)
+					break;
+				if (RectsOverlap(earlier.second->m_scissor, camera.second->m_scissor))
+				{
+					clearsRegion[cameraIndex] = true;
+					depthOverdrawn[earlierIndex] = true;
+				}
+				earlierIndex++;
 			}
-
+			cameraIndex++;
+		}
+	}
+	//secondary buffers pay off as soon as one camera's draws are split across the workers, the other cameras follow in secondaries as well
+	VkSubpassContents contents = VkSubpassContents::VK_SUBPASS_CONTENTS_INLINE;
+	for (const std::vector<VkIndexedDraw>& draws : cameraDraws)
+	{
+		if (m_recorder->TaskCount(draws.size()) > 1)
+			contents = VkSubpassContents::VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS;
+	}
+	//lighting is recorded when the pass ends, so the constants it points to outlive the loop
+	std::vector<glm::mat4> inverseProjections(m_cameras.size());
+	VkManagedImage* passDepth = scenePass->GetAttachment(scImage, VkImageUsageFlagBits::VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	uint32_t colorResource = m_renderGraph->ImportImage(m_vkSwapchain->SwapchainImages()[scImage], RenderGraph::Undefined);
+	uint32_t depthResource = m_renderGraph->ImportImage(passDepth, RenderGraph::Undefined);
+	//the G-buffer only lives inside the scene pass, its memory is free for the Hi-Z passes after it
+	std::vector<uint32_t> gBufferResources;
+	if (m_deferredEnabled)
+	{
+		for (VkFormat format : m_vkRenderpassDFR->GetInputFormats())
+			gBufferResources.push_back(m_renderGraph->CreateImage(m_vkRenderpassDFR->GetExtent(), format, VK_IMAGE_ASPECT_COLOR_BIT,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT));
+	}
+	uint32_t scenePassIndex = m_renderGraph->AddPass("Scene", [&](VkCommandBuffer commandBuffer)
+	{
+		scenePass->PreRecordData(commandBuffer, scImage, m_frameIndex); //one framebuffer per swapchain image, queries and G-buffer of this frame slot
+		scenePass->Begin(clearValues, contents);
+		uint32_t cameraIndex = 0;
+		for (std::pair<uint32_t, Camera*> camera : m_cameras)
+		{
 			states.viewports[0] = camera.second->m_viewPort;
 			states.scissors[0] = camera.second->m_scissor;
-
-			m_vkRenderpassFWD->SetPipeline(m_vkPipelineFWD, states, VkPipelineBindPoint::VK_PIPELINE_BIND_POINT_GRAPHICS);
-			m_vkRenderpassFWD->PreRecordData(cBuffer, 0); //we have 1 framebuffer
+			if (clearsRegion[cameraIndex])
+				scenePass->ClearRegion(camera.second->m_scissor, m_recorder);
+
+			//with a pre-pass every draw is issued twice, depth first and then shaded where its depth survived. The G-buffer subpass already shades every pixel once, pre-passes only apply to the forward pass
+			bool depthPrepass = !m_deferredEnabled && camera.second->m_depthPrepass;
+			scenePass->SetPipeline(depthPrepass ? m_vkPipelineFWDEqual : scenePipeline, states, VkPipelineBindPoint::VK_PIPELINE_BIND_POINT_GRAPHICS);
+			if (depthPrepass)
+				scenePass->SetDepthPrepass(m_vkPipelineDepth);
 			std::vector<VkPushConstant> constants(2);
 			constants[0].data = &camera.second->m_viewMatrix;
 			constants[0].offset = 0;
@@ -401,27 +1003,123 @@ void Vulkan::KojinRenderer::Render()
 			constants[1].offset = constants[0].size;
 			constants[1].size = sizeof(camera.second->m_projectionMatrix);
 			constants[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-			m_vkRenderpassFWD->Record(clearValues, { m_vDescriptorSetFWD,m_fDescriptorSetFWD }, constants, m_meshIndexData, m_meshVertexData, indexdraws);
-
-			//copy pass result
-			VkManagedImage* passColor = m_vkRenderpassFWD->GetAttachment(0, VkImageUsageFlagBits::VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
-			VkManagedImage* scImage = m_vkSwapchain->SwapchainImage(cmdIndex);
-			passColor->Copy(cBuffer, scImage);
+			if (!cameraQueries.empty() && !cameraQueries[cameraIndex].empty())
+				m_vkRenderpassFWD->SetOcclusionQueries(m_vkPipelineBounds, &cameraQueries[cameraIndex]);
+			//the lighting subpass reads the camera's lights through any fragment set and unprojects pixels with the inverse projection
+			if (m_deferredEnabled && m_fDescriptorSetFWD != nullptr)
+			{
+				inverseProjections[cameraIndex] = glm::inverse(camera.second->m_projectionMatrix);
+				VkIndexedDraw lightingBinding;
+				lightingBinding.descriptorSets[0] = 0;
+				lightingBinding.descriptorSets[1] = m_frameIndex;
+				lightingBinding.dynamicOffsets[0] = cameraLightOffsets[cameraIndex * 3];
+				lightingBinding.dynamicOffsets[1] = 0;
+				lightingBinding.dynamicOffsets[2] = cameraLightOffsets[cameraIndex * 3 + 1];
+				lightingBinding.dynamicOffsets[3] = cameraLightOffsets[cameraIndex * 3 + 2];
+				lightingBinding.dynamicOffsetCount = 4;
+				std::vector<VkPushConstant> lightingConstants(1);
+				lightingConstants[0].data = &inverseProjections[cameraIndex];
+				lightingConstants[0].offset = 0;
+				lightingConstants[0].size = sizeof(glm::mat4);
+				lightingConstants[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+				m_vkRenderpassDFR->SetDeferredLighting(m_vkPipelineLighting, { m_fDescriptorSetFWD, m_iDescriptorSetDFR }, lightingBinding, lightingConstants);
+			}
+			scenePass->Record(clearValues, { m_vDescriptorSetFWD,m_fDescriptorSetFWD }, constants, m_geometryPool->IndexBuffer(), m_geometryPool->VertexBuffer(), cameraDraws[cameraIndex], m_recorder);
+			cameraIndex++;
 		}
+		scenePass->End();
+	});
+	m_renderGraph->Read(scenePassIndex, ringResource, RenderGraph::IndirectRead);
+	m_renderGraph->Read(scenePassIndex, ringResource, RenderGraph::VertexShaderRead);
+	m_renderGraph->Read(scenePassIndex, ringResource, RenderGraph::FragmentShaderRead);
+	if (vertexResource != UINT32_MAX)
+	{
+		m_renderGraph->Read(scenePassIndex, vertexResource, RenderGraph::VertexInput);
+		m_renderGraph->Read(scenePassIndex, indexResource, RenderGraph::VertexInput);
 	}
-
-	m_swapChainbuffers->End();
-
-	//submit & wait
-
-	m_swapChainbuffers->Submit(m_vkPresentQueue->queue, { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT }, { m_semaphores->Next() }, { m_semaphores->Last() });
+	m_renderGraph->WriteAttachment(scenePassIndex, colorResource, RenderGraph::ColorAttachment, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	m_renderGraph->WriteAttachment(scenePassIndex, depthResource, RenderGraph::DepthAttachment, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	for (uint32_t gBufferResource : gBufferResources)
+		m_renderGraph->WriteAttachment(scenePassIndex, gBufferResource, RenderGraph::ColorAttachment, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	m_renderGraph->Retain(colorResource);
+
+	//the pyramids are built from the depth all cameras left behind, a camera partly drawn over by a later one goes without
+	uint32_t pyramidResource = UINT32_MAX;
+	if (hiZBuild)
+	{
+		//every camera reduces into the same pyramid, it only lives across the Hi-Z passes
+		pyramidResource = m_renderGraph->CreateBuffer(m_hiZPyramid->PyramidSize(), HiZPyramid::k_pyramidUsage);
+		uint32_t readbackResource = m_renderGraph->ImportBuffer(*m_hiZPyramid->Readbacks(m_frameIndex), RenderGraph::Undefined);
+		uint32_t cameraIndex = 0;
+		for (std::pair<uint32_t, Camera*> camera : m_cameras)
+		{
+			if (!depthOverdrawn[cameraIndex])
+			{
+				Camera * cam = camera.second;
+				uint32_t hiZPass = m_renderGraph->AddPass("Hi-Z", [this, cam, cameraIndex, passDepth, pyramidResource](VkCommandBuffer commandBuffer)
+				{
+					glm::mat4 viewProjection = cam->m_projectionMatrix * cam->m_viewMatrix;
+					m_hiZPyramid->Build(commandBuffer, m_cDescriptorSetHiZ, m_frameIndex, passDepth, m_renderGraph->Buffer(pyramidResource), m_frameIndex, cameraIndex, cam->id, viewProjection, cam->m_viewPort, cam->m_position);
+				});
+				m_renderGraph->Read(hiZPass, depthResource, RenderGraph::TransferRead);
+				m_renderGraph->Write(hiZPass, pyramidResource, RenderGraph::TransferWrite);
+				m_renderGraph->Write(hiZPass, pyramidResource, RenderGraph::ComputeWrite);
+				m_renderGraph->Read(hiZPass, pyramidResource, RenderGraph::ComputeRead);
+				m_renderGraph->Read(hiZPass, pyramidResource, RenderGraph::TransferRead);
+				m_renderGraph->Write(hiZPass, readbackResource, RenderGraph::TransferWrite);
+			}
+			cameraIndex++;
+		}
+		//the frame's fence makes the readbacks available, the barrier makes them visible to the host
+		m_renderGraph->Retain(readbackResource, RenderGraph::HostRead);
+	}
+	m_renderGraph->Compile();
+	//the fence of this frame slot was waited on, so what was built over its old transients can be pointed at the new ones
+	if (m_renderGraph->TransientVersion() != m_transientVersions[m_frameIndex])
+	{
+		if (!gBufferResources.empty())
+		{
+			std::vector<VkManagedImage*> gBuffer;
+			for (uint32_t input = 0; input < gBufferResources.size(); ++input)
+			{
+				gBuffer.push_back(m_renderGraph->Image(gBufferResources[input]));
+				m_iDescriptorSetDFR->LoadInputAttachment(m_frameIndex, gBuffer.back(), input);
+			}
+			m_iDescriptorSetDFR->WriteSet(m_frameIndex);
+			m_iDescriptorSetDFR->ClearSetsWrites();
+			m_vkRenderpassDFR->SetInputAttachments(m_frameIndex, gBuffer);
+		}
+		//no pyramid is made when every camera was drawn over
+		if (pyramidResource != UINT32_MAX && m_renderGraph->Buffer(pyramidResource) != VK_NULL_HANDLE)
+		{
+			m_hiZPyramid->LoadDescriptors(m_cDescriptorSetHiZ, m_frameIndex, m_renderGraph->Buffer(pyramidResource));
+			m_cDescriptorSetHiZ->WriteSet(m_frameIndex);
+			m_cDescriptorSetHiZ->ClearSetsWrites();
+		}
+		m_transientVersions[m_frameIndex] = m_renderGraph->TransientVersion();
+	}
+	m_renderGraph->Execute(cBuffer);
+	m_graphBarriers = m_renderGraph->BarrierCount();
+
+	m_frameCommandBuffers->End(m_frameIndex);
+	m_elidedStateCommands = scenePass->ElidedCommandCount();
+
+	//submit, the fence is only reset once there is work that will signal it again
+	//the pass is the first to touch the swapchain image and the depth that goes with it, so the acquire only has to complete before attachment access
+	m_frameFences->Reset(m_frameIndex);
+	VkResult result = m_frameCommandBuffers->Submit(m_vkPresentQueue->queue, { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT }, { m_renderFinished->GetSemaphore(m_frameIndex) }, { m_imageAvailable->GetSemaphore(m_frameIndex) }, static_cast<size_t>(m_frameIndex), m_frameFences->GetFence(m_frameIndex));
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Unable to submit frame command buffer. Reason: " + Vulkan::VkResultToString(result));
 	//present
-	m_vkSwapchain->PresentCurrentImage(&scImage, m_vkPresentQueue, { m_semaphores->Last()}); // pass waiting semaphores
+	m_vkSwapchain->PresentCurrentImage(&scImage, m_vkPresentQueue, { m_renderFinished->GetSemaphore(m_frameIndex) }); // pass waiting semaphores
 
+	m_frameIndex = (m_frameIndex + 1) % RENDER_ENGINE_FRAMES_IN_FLIGHT;
 	m_objectCount = 0;
-	m_meshDraws.clear();
 	m_meshPartMaterials.clear();
 	m_meshPartTransforms.clear();
+	m_meshPartIds.clear();
+	m_occluderTransforms.clear();
+	m_occluderIds.clear();
 }
 
 void Vulkan::KojinRenderer::WaitForIdle()
@@ -429,182 +1127,254 @@ void Vulkan::KojinRenderer::WaitForIdle()
 	m_vkDevice->WaitForIdle();
 }
 
-void Vulkan::KojinRenderer::UpdateInternalMesh(VkManagedCommandPool * commandPool, VkVertex * vertexData, uint32_t vertexCount, uint32_t * indiceData, uint32_t indiceCount)
+uint32_t Vulkan::KojinRenderer::ElidedStateCommands()
 {
+	return m_elidedStateCommands;
+}
 
-	VkDeviceSize vertexSize = sizeof(vertexData[0]) * vertexCount;
-	VkDeviceSize indiceSize = sizeof(indiceData[0]) * indiceCount;
-
-	if (m_meshVertexData == nullptr && m_meshIndexData == nullptr)
-	{
-		m_meshIndexData = new VkManagedBuffer{ m_vkDevice };
-		m_meshVertexData = new VkManagedBuffer{ m_vkDevice };
-	}
-	//create vertex and index buffers for the mesh
-	//declare staging buffers
-	VkManagedBuffer vertexStagingBuffer(m_vkDevice);
-	VkManagedBuffer indiceStagingBuffer(m_vkDevice);
-
-	//create staging buffers
-	vertexStagingBuffer.Build(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vertexSize);
-	indiceStagingBuffer.Build(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, indiceSize);
-
-	//copy data into staging buffers
-	vertexStagingBuffer.Write(0, 0, (size_t)vertexStagingBuffer.bufferSize, vertexData);
-	indiceStagingBuffer.Write(0, 0, (size_t)indiceStagingBuffer.bufferSize, indiceData);
-
-	//create and load normal buffers
-	m_meshVertexData->Build(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexSize);
-	m_meshIndexData->Build(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indiceSize);
-
-	VkManagedCommandBuffer cmdBuff = commandPool->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
-	cmdBuff.Begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, 0);
-	VkCommandBuffer buffer = cmdBuff.Buffer();
-	vertexStagingBuffer.CopyTo(buffer, m_meshVertexData, 0, 0, vertexSize);
-	indiceStagingBuffer.CopyTo(buffer, m_meshIndexData, 0, 0, indiceSize);
-	cmdBuff.End(0);
-	cmdBuff.Submit(commandPool->PoolQueue()->queue, {}, {}, {}, 0);
-	m_vkDevice->WaitForIdle();
-	cmdBuff.Free();
+uint32_t Vulkan::KojinRenderer::GraphBarriers()
+{
+	return m_graphBarriers;
 }
 
-void Vulkan::KojinRenderer::UpdateUniformBuffer(VkCommandBuffer recordBuffer, uint32_t bufferIndex, const glm::mat4 & model, const glm::mat4 & view, const glm::mat4 & proj, const Vulkan::Material * material)
+void Vulkan::KojinRenderer::SetCullingSettings(const CullingSettings & settings)
 {
-	Vulkan::VertexShaderMVP ubo = {};
-	ubo.model = model;
-	ubo.ComputeMVP(view, proj);
-	size_t dataSize = sizeof(ubo);
-	m_uniformVStagingBufferFWD->Write(0, 0, dataSize, &ubo);
+	m_cullingSettings = settings;
+}
 
-	try
+void Vulkan::KojinRenderer::SetGpuCulling(bool enabled)
+{
+	if (enabled && m_gpuCulling == nullptr)
 	{
-		m_uniformVStagingBufferFWD->CopyTo(recordBuffer, m_uniformVBuffersFWD[bufferIndex], 0, 0,dataSize);
+		m_gpuCulling = new GpuCulling(m_vkDevice);
+		m_descriptorsDirty = true;
 	}
-	catch (...)
+	m_gpuCullingEnabled = enabled;
+}
+
+void Vulkan::KojinRenderer::SetHiZCulling(bool enabled)
+{
+	if (enabled && m_hiZPyramid == nullptr)
 	{
-		throw;
+		m_hiZPyramid = new HiZPyramid(m_vkDevice, m_vkRenderpassFWD->GetExtent(), m_vkDevice->Depthformat(), RENDER_ENGINE_FRAMES_IN_FLIGHT);
+		m_descriptorsDirty = true;
 	}
+	//depth read back before Hi-Z was turned off may no longer match the scene
+	else if (enabled && !m_hiZEnabled)
+		m_hiZPyramid->Invalidate();
+	m_hiZEnabled = enabled;
+}
 
-	Vulkan::LightingUniformBuffer lightsUbo = {};
-	lightsUbo.ambientLightColor = glm::vec4(0.1, 0.1, 0.1, 0.1);
-	lightsUbo.materialDiffuse = material->diffuseColor;
-	lightsUbo.specularity = material->specularity;
-	uint32_t i = 0;
-	for (std::pair<const uint32_t,Light*>& l : m_lights)
+void Vulkan::KojinRenderer::SetOcclusionQueries(bool enabled)
+{
+	if (enabled && m_vkPipelineBounds == nullptr)
 	{
-		if (i < MAX_LIGHTS_PER_FRAGMENT)
-		{
-			lightsUbo.lights[i] = {};
-			lightsUbo.lights[i].color = l.second->diffuseColor;
-			lightsUbo.lights[i].direction = view*l.second->GetLightForward();
-			lightsUbo.lights[i].m_position = glm::vec4(l.second->m_position, 1.0f);
-			lightsUbo.lights[i].m_position.x *= -1;
-			lightsUbo.lights[i].m_position = view*lightsUbo.lights[i].m_position;
-			lightsUbo.lights[i].lightProps = {};
-			lightsUbo.lights[i].lightProps.lightType = l.second->GetType();
-			lightsUbo.lights[i].lightProps.intensity = l.second->intensity;
-			lightsUbo.lights[i].lightProps.falloff = l.second->range;
-			lightsUbo.lights[i].lightProps.angle = l.second->angle;
-		//	if (i < depthMVPs.size())
-		//		lightsUbo.lights[i].lightBiasedMVP = VkShadowmapDefaults::k_shadowBiasMatrix * (depthMVPs[i] * modelMatrix);
-		//	else
-				lightsUbo.lights[i].lightBiasedMVP = glm::mat4(1);
-			i++;
-		}
-		else
-			break;
+		VkPushConstantRange rangeBox;
+		rangeBox.offset = 0;
+		rangeBox.size = sizeof(glm::mat4);
+		rangeBox.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		m_vkPipelineBounds = new VkManagedPipeline(m_vkDevice);
+		m_vkPipelineBounds->Build(
+			m_vkRenderpassFWD, PipelineMode::BoundsQuery,
+			"shaders/bounds.vert.spv",
+			"shaders/bounds.frag.spv",
+			{ VK_DYNAMIC_STATE_SCISSOR,
+			VK_DYNAMIC_STATE_VIEWPORT
+			}, { rangeBox });
+		m_queryKeys.resize(RENDER_ENGINE_FRAMES_IN_FLIGHT);
 	}
-	dataSize = sizeof(LightingUniformBuffer);
-	m_uniformFStagingBufferFWD->Write(0, 0, dataSize, &lightsUbo);
-
-	try
+	//results pending from before a toggle are dropped, nothing is hidden until new ones arrive
+	if (enabled != m_occlusionQueriesEnabled)
 	{
-		m_uniformFStagingBufferFWD->CopyTo(recordBuffer, m_uniformFBuffersFWD[bufferIndex], 0, 0,dataSize);
+		for (std::vector<uint64_t>& keys : m_queryKeys)
+			keys.clear();
+		m_occludedProxies.clear();
 	}
-	catch (...)
+	m_occlusionQueriesEnabled = enabled;
+}
+
+void Vulkan::KojinRenderer::SetDeferredShading(bool enabled)
+{
+	if (enabled && m_vkRenderpassDFR == nullptr)
 	{
-		throw;
+		m_vkRenderpassDFR = new VkManagedRenderPass(m_vkDevice);
+		m_vkRenderpassDFR->BuildDeferred(m_vkRenderpassFWD->GetExtent(), m_vkSwapchain->Format(), m_vkDevice->Depthformat(), VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+		m_vkRenderpassDFR->SetFrameBufferTargets(m_vkSwapchain->SwapchainImages(), true, false, true);
+
+		//the G-buffer subpass runs the forward vertex stage with the same camera constants
+		m_vkPipelineGBuffer = new VkManagedPipeline(m_vkDevice);
+		m_vkPipelineGBuffer->Build(
+			m_vkRenderpassDFR, PipelineMode::Deffered,
+			"shaders/vertex.vert.spv",
+			"shaders/gbuffer.frag.spv",
+			{ VK_DYNAMIC_STATE_SCISSOR,
+			VK_DYNAMIC_STATE_VIEWPORT
+			}, CameraPushConstantRanges());
+
+		VkPushConstantRange rangeInverseProj;
+		rangeInverseProj.offset = 0;
+		rangeInverseProj.size = sizeof(glm::mat4);
+		rangeInverseProj.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		m_vkPipelineLighting = new VkManagedPipeline(m_vkDevice);
+		m_vkPipelineLighting->Build(
+			m_vkRenderpassDFR, PipelineMode::DeferredLighting,
+			"shaders/deferred.vert.spv",
+			"shaders/deferred.frag.spv",
+			{ VK_DYNAMIC_STATE_SCISSOR,
+			VK_DYNAMIC_STATE_VIEWPORT
+			}, { rangeInverseProj });
+		m_descriptorsDirty = true;
 	}
+	//both passes leave the same depth behind, so Hi-Z readbacks stay valid across a toggle
+	m_deferredEnabled = enabled;
 }
 
-void Vulkan::KojinRenderer::WriteDescriptors(uint32_t objIndex)
+uint32_t Vulkan::KojinRenderer::VisibleInstances()
 {
-	//VERTEX
-	VkDescriptorSet set = m_vDescriptorSetFWD->Set(objIndex);
-	VkDescriptorBufferInfo vertexUniformBufferInfo = {};
-	vertexUniformBufferInfo.buffer = *m_uniformVBuffersFWD[objIndex];
-	vertexUniformBufferInfo.offset = 0;
-	vertexUniformBufferInfo.range = sizeof(VertexShaderMVP);
+	return m_visibleInstances;
+}
 
-	VkWriteDescriptorSet descriptorVertexWrite = {};
+uint32_t Vulkan::KojinRenderer::BinLights(const Camera * camera, std::vector<VkLight>& lights, LightClusters& clusters)
+{
+	//directional lights reach every fragment and lead the list, local lights are only found through the clusters their range touches
+	uint32_t directionalCount = 0;
+	for (std::pair<const uint32_t, Light*>& l : m_lights)
 	{
-		descriptorVertexWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorVertexWrite.dstSet = set;
-		descriptorVertexWrite.dstBinding = 0;
-		descriptorVertexWrite.dstArrayElement = 0;
-		descriptorVertexWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorVertexWrite.descriptorCount = 1;
-		descriptorVertexWrite.pBufferInfo = &vertexUniformBufferInfo;
+		if (l.second->GetType() == LightType::Directional)
+			directionalCount++;
 	}
+	lights.resize(m_lights.size());
+	bool perspective = camera->m_projectionMatrix[3][3] == 0.0f;
+	clusters.Begin(camera->m_projectionMatrix, camera->m_zNear, camera->m_zFar, perspective);
+	const glm::mat4& view = camera->m_viewMatrix;
+	uint32_t directional = 0;
+	uint32_t local = directionalCount;
+	for (std::pair<const uint32_t, Light*>& l : m_lights)
+	{
+		VkLight light = {};
+		light.color = l.second->diffuseColor;
+		light.direction = view*l.second->GetLightForward();
+		light.m_position = glm::vec4(l.second->m_position, 1.0f);
+		light.m_position.x *= -1;
+		light.m_position = view*light.m_position;
+		light.lightProps = {};
+		light.lightProps.lightType = l.second->GetType();
+		light.lightProps.intensity = l.second->intensity;
+		light.lightProps.falloff = l.second->range;
+		light.lightProps.angle = l.second->angle;
+		light.lightBiasedMVP = glm::mat4(1);
+		if (l.second->GetType() == LightType::Directional)
+		{
+			lights[directional++] = light;
+		}
+		else
+		{
+			clusters.Add(local, glm::vec3(light.m_position), l.second->range);
+			lights[local++] = light;
+		}
+	}
+	clusters.Finish();
+	return directionalCount;
+}
 
-	vkUpdateDescriptorSets(*m_vkDevice, 1, &descriptorVertexWrite, 0, nullptr);
-
-	//FRAGMENT
-	set = m_fDescriptorSetFWD->Set(objIndex);
-	VkDescriptorImageInfo diffuseTextureInfo = {};
-	diffuseTextureInfo.imageLayout = m_deviceLoadedTextures[m_meshPartMaterials[objIndex]->albedo->id]->layout;
-	diffuseTextureInfo.imageView = *m_deviceLoadedTextures[m_meshPartMaterials[objIndex]->albedo->id];
-	diffuseTextureInfo.sampler = *m_colorSampler;
+void Vulkan::KojinRenderer::WriteLights(const Camera * camera, const std::vector<VkLight>& lights, uint32_t directionalCount, const LightClusters & clusters, uint32_t offsets[3])
+{
+	//the struct is filled on the stack and copied once, the ring memory may be write combined
+	ClusterGrid grid = clusters.Grid();
+	Vulkan::LightingUniformBuffer lightsUbo = {};
+	lightsUbo.ambientLightColor = glm::vec4(0.1, 0.1, 0.1, 0.1);
+	lightsUbo.viewport = glm::vec4(camera->m_viewPort.x, camera->m_viewPort.y, camera->m_viewPort.width, camera->m_viewPort.height);
+	lightsUbo.depthSlicing = grid.depthSlicing;
+	lightsUbo.grid = glm::uvec4(grid.size.x, grid.size.y, grid.size.z, directionalCount);
+	size_t dataSize = sizeof(LightingUniformBuffer);
+	VkDeviceSize offset = 0;
+	memcpy(m_uniformRing->Allocate(dataSize, offset), &lightsUbo, dataSize);
+	offsets[0] = static_cast<uint32_t>(offset);
+
+	//the storage descriptors cover the full capacities, so that much is reserved even when less is written
+	void * lightData = m_uniformRing->Allocate(m_lightCapacity * sizeof(VkLight), offset);
+	if (!lights.empty())
+		memcpy(lightData, lights.data(), lights.size() * sizeof(VkLight));
+	offsets[1] = static_cast<uint32_t>(offset);
+	const std::vector<uint32_t>& clusterData = clusters.Data();
+	memcpy(m_uniformRing->Allocate(LightClusters::DataSize(m_clusterIndexCapacity) * sizeof(uint32_t), offset), clusterData.data(), clusterData.size() * sizeof(uint32_t));
+	offsets[2] = static_cast<uint32_t>(offset);
+}
 
-//	VkDescriptorImageInfo shadowMaptexture = {};
-//	shadowMaptexture.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-	//shadowMaptexture.imageView = m_fwdOffScreenProjShadows.GetAttachment(0, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)->imageView;
-//	shadowMaptexture.imageView = m_layeredProjectedShadowmaps->imageView;
-//	shadowMaptexture.sampler = m_fwdOffScreenProjShadows.GetSampler(m_fwdOffScreenProjShadows.k_defaultSamplerName);
+uint32_t Vulkan::KojinRenderer::WriteMaterial(const Vulkan::Material * material)
+{
+	auto written = m_materialOffsets.find(material);
+	if (written != m_materialOffsets.end())
+		return written->second;
+
+	Vulkan::MaterialUniformBuffer materialUbo = {};
+	materialUbo.materialDiffuse = material->diffuseColor;
+	materialUbo.specularity = material->specularity;
+	size_t dataSize = sizeof(MaterialUniformBuffer);
+	VkDeviceSize offset = 0;
+	memcpy(m_uniformRing->Allocate(dataSize, offset), &materialUbo, dataSize);
+	m_materialOffsets[material] = static_cast<uint32_t>(offset);
+	return static_cast<uint32_t>(offset);
+}
 
-	VkDescriptorBufferInfo lightsUniformBufferInfo = {};
-	lightsUniformBufferInfo.buffer = *m_uniformFBuffersFWD[objIndex];
-	lightsUniformBufferInfo.offset = 0;
-	lightsUniformBufferInfo.range = sizeof(LightingUniformBuffer);
+void Vulkan::KojinRenderer::WriteDescriptors()
+{
+	//vertex sets for submitted and retained instances, one fragment set per texture, the culling set, and Hi-Z and G-buffer sets per frame in flight, regions are selected with dynamic offsets
+	uint32_t textureCount = static_cast<uint32_t>(m_deviceLoadedTextures.size());
+	uint32_t setCount = textureCount + 3 + 2 * RENDER_ENGINE_FRAMES_IN_FLIGHT;
+	bool rebuildPool = m_vkDescriptorPool->Size() < setCount;
 
+	//sets of a rebuilt pool are released with it, otherwise they go back to the pool before allocating again
+	for (VkManagedDescriptorSet ** descSet : { &m_vDescriptorSetFWD, &m_fDescriptorSetFWD, &m_cDescriptorSetCull, &m_cDescriptorSetHiZ, &m_iDescriptorSetDFR })
+	{
+		if (*descSet == nullptr)
+			continue;
+		if (!rebuildPool && (*descSet)->Size() > 0)
+			m_vkDescriptorPool->FreeDescriptorSet(*descSet);
+		delete *descSet;
+		*descSet = nullptr;
+	}
+	if (rebuildPool)
+		m_vkDescriptorPool->BuildPool(setCount * 2);
 
-	std::array<VkWriteDescriptorSet, 2> fragmentDescriptorWrites = {};
+	m_vkDescriptorPool->AllocateDescriptorSet(2, m_vkPipelineFWD->GetVertexLayout(), m_vDescriptorSetFWD);
+	m_vDescriptorSetFWD->LoadStorageBufferDynamic(0, *m_uniformRing, m_instanceCapacity * sizeof(glm::mat4), 0);
+	m_vDescriptorSetFWD->LoadStorageBufferDynamic(1, *m_renderProxies, m_renderProxies->FrameSize(), 0);
+	m_vDescriptorSetFWD->LoadStorageBufferDynamic(0, *m_uniformRing, m_visibleCapacity * sizeof(uint32_t), 1);
+	m_vDescriptorSetFWD->LoadStorageBufferDynamic(1, *m_uniformRing, m_visibleCapacity * sizeof(uint32_t), 1);
+	m_vDescriptorSetFWD->WriteSets();
 
+	if (m_gpuCulling != nullptr)
 	{
-		fragmentDescriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		fragmentDescriptorWrites[0].dstSet = set;
-		fragmentDescriptorWrites[0].dstBinding = 0;
-		fragmentDescriptorWrites[0].dstArrayElement = 0;
-		fragmentDescriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		fragmentDescriptorWrites[0].descriptorCount = 1;
-		fragmentDescriptorWrites[0].pImageInfo = &diffuseTextureInfo;
+		m_vkDescriptorPool->AllocateDescriptorSet(1, m_gpuCulling->SetLayout(), m_cDescriptorSetCull);
+		GpuCulling::LoadDescriptors(m_cDescriptorSetCull, 0, *m_uniformRing, m_visibleCapacity);
+		m_cDescriptorSetCull->WriteSets();
+	}
 
-		//fragmentDescriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		//fragmentDescriptorWrites[1].dstSet = fragSet;
-		//fragmentDescriptorWrites[1].dstBinding = 1;
-		//fragmentDescriptorWrites[1].dstArrayElement = 0;
-		//fragmentDescriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		//fragmentDescriptorWrites[1].descriptorCount = 1;
-		//fragmentDescriptorWrites[1].pImageInfo = &shadowMaptexture;
+	//the pyramid and the G-buffer are graph transients of each frame slot, their sets are written once the graph made them
+	if (m_hiZPyramid != nullptr)
+		m_vkDescriptorPool->AllocateDescriptorSet(RENDER_ENGINE_FRAMES_IN_FLIGHT, m_hiZPyramid->SetLayout(), m_cDescriptorSetHiZ);
+	if (m_vkRenderpassDFR != nullptr)
+		m_vkDescriptorPool->AllocateDescriptorSet(RENDER_ENGINE_FRAMES_IN_FLIGHT, m_vkPipelineLighting->GetInputLayout(), m_iDescriptorSetDFR);
+	m_transientVersions.assign(RENDER_ENGINE_FRAMES_IN_FLIGHT, 0);
 
-	//	fragmentDescriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	//	fragmentDescriptorWrites[1].dstSet = set;
-	//	fragmentDescriptorWrites[1].dstBinding = 1;
-	//	fragmentDescriptorWrites[1].dstArrayElement = 0;
-	//	fragmentDescriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	//	fragmentDescriptorWrites[1].descriptorCount = 1;
-	//	fragmentDescriptorWrites[1].pImageInfo = &diffuseTextureInfo;
+	m_textureDescriptorIndices.clear();
+	if (textureCount == 0)
+		return;
 
-		fragmentDescriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		fragmentDescriptorWrites[1].dstSet = set;
-		fragmentDescriptorWrites[1].dstBinding = 1;
-		fragmentDescriptorWrites[1].dstArrayElement = 0;
-		fragmentDescriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		fragmentDescriptorWrites[1].descriptorCount = 1;
-		fragmentDescriptorWrites[1].pBufferInfo = &lightsUniformBufferInfo;
+	m_vkDescriptorPool->AllocateDescriptorSet(textureCount, m_vkPipelineFWD->GetFragmentLayout(), m_fDescriptorSetFWD);
+	uint32_t setIndex = 0;
+	for (std::pair<const uint32_t, std::shared_ptr<VkManagedImage>>& texture : m_deviceLoadedTextures)
+	{
+		m_fDescriptorSetFWD->LoadCombinedSamplerImage(setIndex, texture.second.get(), 0, *m_colorSampler);
+		m_fDescriptorSetFWD->LoadUniformBufferDynamic(setIndex, *m_uniformRing, sizeof(LightingUniformBuffer), 1);
+		m_fDescriptorSetFWD->LoadUniformBufferDynamic(setIndex, *m_uniformRing, sizeof(MaterialUniformBuffer), 2);
+		m_fDescriptorSetFWD->LoadStorageBufferDynamic(setIndex, *m_uniformRing, m_lightCapacity * sizeof(VkLight), 3);
+		m_fDescriptorSetFWD->LoadStorageBufferDynamic(setIndex, *m_uniformRing, LightClusters::DataSize(m_clusterIndexCapacity) * sizeof(uint32_t), 4);
+		m_textureDescriptorIndices[texture.first] = setIndex;
+		setIndex++;
 	}
-
-	vkUpdateDescriptorSets(*m_vkDevice, static_cast<uint32_t>(fragmentDescriptorWrites.size()), fragmentDescriptorWrites.data(), 0, nullptr);
+	m_fDescriptorSetFWD->WriteSets();
 }
 
 bool Vulkan::KojinRenderer::UpdateShadowmapLayers()
@@ -618,40 +1388,3 @@ bool Vulkan::KojinRenderer::UpdateShadowmapLayers()
 		return false;
 	}
 }
-
-void Vulkan::KojinRenderer::CreateUniformBufferSet(VkManagedBuffer *& stagingBuffer, std::vector<VkManagedBuffer*>& buffers, uint32_t objectCount, uint32_t bufferDataSize)
-{
-	VkDeviceSize bufferSize = static_cast<VkDeviceSize>(bufferDataSize);
-	if (stagingBuffer == nullptr)
-	{
-		stagingBuffer = new VkManagedBuffer{ m_vkDevice };
-	}
-	
-	uint32_t currentBufferCount = static_cast<uint32_t>(buffers.size());
-	if (currentBufferCount == 0)
-	{
-		buffers.resize(objectCount, new VkManagedBuffer{ m_vkDevice });
-	}
-	else if (currentBufferCount != objectCount)
-	{
-		for (uint32_t i = 0; i < currentBufferCount; ++i)
-			delete buffers[i];
-		buffers.clear();
-		buffers.resize(objectCount, new VkManagedBuffer{ m_vkDevice });
-	}
-
-
-	try
-	{
-		stagingBuffer->Build(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, bufferSize);
-		for (uint32_t i = 0; i < objectCount; i++)
-		{
-			buffers[i]->Build(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,bufferSize);
-		}
-
-	}
-	catch (...)
-	{
-		throw;
-	}
-}
@@ -8,8 +8,13 @@ wrapers.
 #include <memory>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <glm\matrix.hpp>
 #include <vulkan\vulkan.h>
+#include "RenderProxyPool.h"
+#include "FrustumCulling.h"
+#include "HiZPyramid.h"
+#include "LightClusters.h"
 
 #ifndef RENDER_ENGINE_NAME
 #define RENDER_ENGINE_NAME "KojinRenderer"
@@ -27,6 +32,11 @@ wrapers.
 #define RENDER_ENGINE_MINOR_VERSION 1
 #endif // !RENDER_ENGINE_MAJOR_VERSION
 
+//frames the CPU may record ahead of the GPU, each one owns its command buffers, uniform region and attachments
+#ifndef RENDER_ENGINE_FRAMES_IN_FLIGHT
+#define RENDER_ENGINE_FRAMES_IN_FLIGHT 2
+#endif // !RENDER_ENGINE_FRAMES_IN_FLIGHT
+
 struct SDL_Window;
 
 namespace Vulkan
@@ -55,11 +65,20 @@ namespace Vulkan
 	class VkManagedQueue;
 	class VkManagedCommandPool;
 	class VkManagedSemaphore;
+	class VkManagedFence;
 	class VkManagedSampler;
 	class VkManagedCommandBuffer;
 	struct VkVertex;
+	struct VkIndexedDraw;
+	struct VkLight;
 
 	class VkManagedBuffer;
+	class RenderGraph;
+	class VkManagedRingBuffer;
+	class VkManagedGeometryPool;
+	class VkManagedParallelRecorder;
+	class GpuCulling;
+	class OcclusionBuffer;
 	
 	class KojinRenderer
 	{
@@ -68,7 +87,17 @@ namespace Vulkan
 		KojinRenderer(const KojinRenderer&) = delete;
 		KojinRenderer& operator=(const KojinRenderer&) = delete;
 		~KojinRenderer();
-		void Draw(std::vector<Mesh*> meshes, std::vector<Material*> materials);
+		void Draw(const std::vector<Mesh*>& meshes, const std::vector<Material*>& materials);
+		///Submit count objects from parallel arrays of meshes and materials
+		void Draw(Mesh * const * meshes, Material * const * materials, size_t count);
+		void Draw(Mesh * mesh, Material * material);
+		///Occluder for the next Render, objects hidden behind occluders are skipped while culling on the CPU
+		void DrawOccluder(Mesh * mesh);
+		///Retained objects, drawn every Render until destroyed. Only changed proxies cost CPU time
+		RenderProxyHandle CreateRenderProxy(Mesh * mesh, Material * material);
+		void SetRenderProxyTransform(RenderProxyHandle proxy, const glm::mat4& transform);
+		void SetRenderProxyMaterial(RenderProxyHandle proxy, Material * material);
+		void DestroyRenderProxy(RenderProxyHandle proxy);
 		//void Load(std::weak_ptr<Vulkan::Mesh> mesh, Vulkan::Material * material);
 		//std::shared_ptr<Vulkan::Light> CreateLight(glm::vec3 initialPosition);
 		Vulkan::Camera * CreateCamera(glm::vec3 initialPosition, bool perspective);
@@ -78,6 +107,22 @@ namespace Vulkan
 		void FreeTexture(Texture * tex);
 		void Render();
 		void WaitForIdle();
+		///Redundant bind, dynamic state and push constant commands skipped while recording the last frame
+		uint32_t ElidedStateCommands();
+		///Pipeline barriers the render graph placed between the passes of the last frame
+		uint32_t GraphBarriers();
+		///Distance and screen size limits applied while culling objects against every camera
+		void SetCullingSettings(const CullingSettings& settings);
+		///Cull on the GPU with a compute pass and draw through indirect commands instead of culling on the CPU
+		void SetGpuCulling(bool enabled);
+		///Cull on the CPU against the depth pyramid of the last frame rendered from the same frame slot, unused while culling on the GPU
+		void SetHiZCulling(bool enabled);
+		///Query the bounding boxes of large retained proxies after each camera's draws, proxies found hidden are skipped until a later query sees them
+		void SetOcclusionQueries(bool enabled);
+		///Write albedo, normals and depth in a G-buffer subpass and light every pixel once in a second subpass instead of shading every drawn fragment. Occlusion queries are skipped while enabled
+		void SetDeferredShading(bool enabled);
+		///Instances that passed CPU culling for all cameras during the last frame, the GPU path leaves it at 0
+		uint32_t VisibleInstances();
 
 		
 
@@ -87,12 +132,17 @@ namespace Vulkan
 
 	private:
 		void FreeCamera(Camera * camera);
+		///Depth only and depth equal forward pipelines, built the first time a camera enables its depth pre-pass
+		void BuildDepthPrepass(Camera * camera);
 		void FreeLight(Light * light);
-		void UpdateInternalMesh(VkManagedCommandPool * commandPool, VkVertex * vertexData, uint32_t vertexCount, uint32_t * indiceData, uint32_t indiceCount);
-		void UpdateUniformBuffer(VkCommandBuffer recordBuffer, uint32_t bufferIndex, const glm::mat4 & model, const glm::mat4 & view, const glm::mat4 & proj, const Vulkan::Material * material);
-		void WriteDescriptors(uint32_t objIndex);
+		///Every light in the camera's view space with the directional ones first, the others are binned into clusters. Returns the directional count
+		uint32_t BinLights(const Camera * camera, std::vector<VkLight>& lights, LightClusters& clusters);
+		///Write the cluster fields, the light list and the clusters of a camera, offsets receives their ring offsets in binding order
+		void WriteLights(const Camera * camera, const std::vector<VkLight>& lights, uint32_t directionalCount, const LightClusters& clusters, uint32_t offsets[3]);
+		///Parameters of a material, written the first time it is drawn in a frame, returns its ring offset
+		uint32_t WriteMaterial(const Vulkan::Material * material);
+		void WriteDescriptors();
 		bool UpdateShadowmapLayers();
-		void CreateUniformBufferSet(VkManagedBuffer *& stagingBuffer, std::vector<VkManagedBuffer*>& buffers, uint32_t objectCount, uint32_t bufferDataSize);
 		void Clean();
 	private:
 
@@ -104,27 +154,80 @@ namespace Vulkan
 		VkManagedRenderPass * m_vkRenderPassSDWProj = nullptr;
 		VkManagedPipeline * m_vkPipelineFWD = nullptr;
 		VkManagedPipeline * m_vkPipelineSDWProj = nullptr;
+		VkManagedPipeline * m_vkPipelineBounds = nullptr;
+		//deferred pass and its two pipelines are created the first time deferred shading is enabled
+		VkManagedRenderPass * m_vkRenderpassDFR = nullptr;
+		VkManagedPipeline * m_vkPipelineGBuffer = nullptr;
+		VkManagedPipeline * m_vkPipelineLighting = nullptr;
+		bool m_deferredEnabled = false;
+		//depth only and depth equal forward pipelines, created the first time a camera enables its depth pre-pass
+		VkManagedPipeline * m_vkPipelineDepth = nullptr;
+		VkManagedPipeline * m_vkPipelineFWDEqual = nullptr;
 		VkManagedDescriptorPool * m_vkDescriptorPool = nullptr;
 		VkManagedDescriptorSet * m_vDescriptorSetFWD = nullptr;
 		VkManagedDescriptorSet * m_fDescriptorSetFWD = nullptr;
 		VkManagedDescriptorSet * m_vDescriptorSetSDWProj = nullptr;
+		VkManagedDescriptorSet * m_cDescriptorSetCull = nullptr;
+		VkManagedDescriptorSet * m_cDescriptorSetHiZ = nullptr;
+		//G-buffer input attachments of every frame in flight
+		VkManagedDescriptorSet * m_iDescriptorSetDFR = nullptr;
 		VkManagedQueue * m_vkPresentQueue = nullptr;
-		VkManagedSemaphore * m_semaphores = nullptr;
+		VkManagedSemaphore * m_imageAvailable = nullptr;
+		VkManagedSemaphore * m_renderFinished = nullptr;
+		VkManagedFence * m_frameFences = nullptr;
 		VkManagedSemaphore * m_passSemaphore = nullptr;
-		VkManagedBuffer * m_meshVertexData = nullptr;
-		VkManagedBuffer * m_meshIndexData = nullptr;
-		VkManagedCommandBuffer * m_swapChainbuffers = nullptr;
+		VkManagedGeometryPool * m_geometryPool = nullptr;
+		RenderProxyPool * m_renderProxies = nullptr;
+		VkManagedParallelRecorder * m_recorder = nullptr;
+		//orders the upload, culling, scene and Hi-Z passes of a frame with batched barriers
+		RenderGraph * m_renderGraph = nullptr;
+		//transients the G-buffer framebuffers and the input and Hi-Z sets of every frame in flight were last pointed at, 0 before any
+		std::vector<uint64_t> m_transientVersions;
+		//created the first time GPU culling is enabled
+		GpuCulling * m_gpuCulling = nullptr;
+		bool m_gpuCullingEnabled = false;
+		//created the first time Hi-Z culling is enabled, depth is read back per camera and frame in flight
+		HiZPyramid * m_hiZPyramid = nullptr;
+		bool m_hiZEnabled = false;
+		HiZDepth m_hiZDepth;
+		//camera id in the high and proxy handle in the low half of every key, one key per query issued from each frame in flight
+		bool m_occlusionQueriesEnabled = false;
+		std::vector<std::vector<uint64_t>> m_queryKeys;
+		std::unordered_set<uint64_t> m_occludedProxies;
+		std::vector<uint64_t> m_querySamples;
+		//one primary command buffer per frame in flight, independent of the swapchain image count
+		VkManagedCommandBuffer * m_frameCommandBuffers = nullptr;
 		VkManagedSampler * m_colorSampler = nullptr;
 
-		std::unordered_map<uint32_t, int> m_meshDraws;
 		std::vector<glm::mat4> m_meshPartTransforms;
+		std::vector<uint32_t> m_meshPartIds;
 		std::vector<Material*> m_meshPartMaterials;
-		VkManagedBuffer * m_uniformVStagingBufferFWD = nullptr;
-		std::vector<VkManagedBuffer*> m_uniformVBuffersFWD;
-		VkManagedBuffer * m_uniformFStagingBufferFWD = nullptr;
-		std::vector<VkManagedBuffer*> m_uniformFBuffersFWD;
+		std::vector<glm::mat4> m_occluderTransforms;
+		std::vector<uint32_t> m_occluderIds;
+		OcclusionBuffer * m_occlusionBuffer = nullptr;
+		VkManagedRingBuffer * m_uniformRing = nullptr;
+		//frame in flight being recorded, selects the fence, command buffers and ring regions
+		uint32_t m_frameIndex = 0;
+		//fragment descriptor set index of every loaded texture
+		std::unordered_map<uint32_t, uint32_t> m_textureDescriptorIndices;
+		//ring offset of every material written during the frame being recorded
+		std::unordered_map<const Material*, uint32_t> m_materialOffsets;
+		bool m_descriptorsDirty = true;
+		//model matrices the instance storage descriptor covers, grows with the object count
+		uint32_t m_instanceCapacity = 256;
+		//instance indices the visible list descriptor covers, objects and proxies together
+		uint32_t m_visibleCapacity = 256;
+		//lights and cluster light indices the fragment storage descriptors cover, grown like the lists above
+		uint32_t m_lightCapacity = 64;
+		uint32_t m_clusterIndexCapacity = 4096;
+		//light grid of every camera, kept between frames to reuse its storage
+		std::vector<LightClusters> m_lightClusters;
+		CullingSettings m_cullingSettings;
+		uint32_t m_visibleInstances = 0;
 		VkManagedBuffer * m_uniformStagingBufferSDWProj = nullptr;
 		std::vector<VkManagedBuffer*> m_uniformBuffersSDWProj;
+		uint32_t m_elidedStateCommands = 0;
+		uint32_t m_graphBarriers = 0;
 		int m_objectCount = 0;
 		int m_objectCountOld = 0;
 	
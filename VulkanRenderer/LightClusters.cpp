@@ -0,0 +1,143 @@
+#include "LightClusters.h"
+#include <algorithm>
+#include <cmath>
+#include <float.h>
+
+namespace
+{
+	//view depths are clamped before slicing so the logarithm stays finite, fragment.frag clamps the same way
+	const float k_minSliceDepth = 0.0001f;
+
+	uint32_t Tile(float ndc, uint32_t tileCount)
+	{
+		float tile = std::floor((ndc * 0.5f + 0.5f) * static_cast<float>(tileCount));
+		return static_cast<uint32_t>(std::min(std::max(tile, 0.0f), static_cast<float>(tileCount - 1)));
+	}
+}
+
+void Vulkan::LightClusters::Begin(const glm::mat4 & projection, float zNear, float zFar, bool perspective)
+{
+	m_projection = projection;
+	m_zNear = zNear;
+	m_zFar = zFar;
+	m_perspective = perspective;
+	//perspective slices grow with distance like the footprint of a screen tile does
+	if (perspective)
+	{
+		float logNear = std::log(std::max(zNear, k_minSliceDepth));
+		m_sliceScale = static_cast<float>(k_slices) / (std::log(std::max(zFar, k_minSliceDepth)) - logNear);
+		m_sliceBias = -logNear * m_sliceScale;
+	}
+	else
+	{
+		m_sliceScale = static_cast<float>(k_slices) / (zFar - zNear);
+		m_sliceBias = -zNear * m_sliceScale;
+	}
+	m_ranges.clear();
+	m_data.clear();
+	m_indexCount = 0;
+}
+
+void Vulkan::LightClusters::Add(uint32_t light, const glm::vec3 & center, float radius)
+{
+	//the camera looks down negative z
+	float nearest = -center.z - radius;
+	float farthest = -center.z + radius;
+	if (farthest < m_zNear || nearest > m_zFar)
+		return;
+
+	Range range;
+	range.light = light;
+	range.minX = 0;
+	range.maxX = k_tilesX - 1;
+	range.minY = 0;
+	range.maxY = k_tilesY - 1;
+	range.minZ = Slice(nearest);
+	range.maxZ = Slice(farthest);
+	//a sphere reaching past the near plane may cover any pixel, otherwise the corners of its box bound its projection
+	if (!m_perspective || nearest > m_zNear)
+	{
+		float minX = FLT_MAX, minY = FLT_MAX;
+		float maxX = -FLT_MAX, maxY = -FLT_MAX;
+		for (uint32_t c = 0; c < 8; ++c)
+		{
+			glm::vec4 corner(center.x + ((c & 1) ? radius : -radius), center.y + ((c & 2) ? radius : -radius), center.z + ((c & 4) ? radius : -radius), 1.0f);
+			glm::vec4 clip = m_projection * corner;
+			float x = clip.x / clip.w;
+			float y = clip.y / clip.w;
+			minX = std::min(minX, x);
+			maxX = std::max(maxX, x);
+			minY = std::min(minY, y);
+			maxY = std::max(maxY, y);
+		}
+		if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+			return;
+		range.minX = Tile(minX, k_tilesX);
+		range.maxX = Tile(maxX, k_tilesX);
+		range.minY = Tile(minY, k_tilesY);
+		range.maxY = Tile(maxY, k_tilesY);
+	}
+	m_ranges.push_back(range);
+}
+
+void Vulkan::LightClusters::Finish()
+{
+	//lights are counted per cluster first so the indices can be written in place after a prefix sum
+	m_data.assign(k_clusterCount * 2, 0);
+	for (const Range& range : m_ranges)
+	{
+		for (uint32_t z = range.minZ; z <= range.maxZ; ++z)
+			for (uint32_t y = range.minY; y <= range.maxY; ++y)
+				for (uint32_t x = range.minX; x <= range.maxX; ++x)
+					m_data[((z * k_tilesY + y) * k_tilesX + x) * 2 + 1]++;
+	}
+	uint32_t offset = k_clusterCount * 2;
+	for (uint32_t c = 0; c < k_clusterCount; ++c)
+	{
+		m_data[c * 2] = offset;
+		offset += m_data[c * 2 + 1];
+		m_data[c * 2 + 1] = 0;
+	}
+	m_indexCount = offset - k_clusterCount * 2;
+	m_data.resize(offset);
+	for (const Range& range : m_ranges)
+	{
+		for (uint32_t z = range.minZ; z <= range.maxZ; ++z)
+			for (uint32_t y = range.minY; y <= range.maxY; ++y)
+				for (uint32_t x = range.minX; x <= range.maxX; ++x)
+				{
+					uint32_t cluster = ((z * k_tilesY + y) * k_tilesX + x) * 2;
+					m_data[m_data[cluster] + m_data[cluster + 1]++] = range.light;
+				}
+	}
+}
+
+const std::vector<uint32_t>& Vulkan::LightClusters::Data() const
+{
+	return m_data;
+}
+
+uint32_t Vulkan::LightClusters::IndexCount() const
+{
+	return m_indexCount;
+}
+
+Vulkan::ClusterGrid Vulkan::LightClusters::Grid() const
+{
+	ClusterGrid grid;
+	grid.depthSlicing = glm::vec4(m_sliceScale, m_sliceBias, m_perspective ? 1.0f : 0.0f, 0.0f);
+	grid.size = glm::uvec4(k_tilesX, k_tilesY, k_slices, 0);
+	return grid;
+}
+
+uint32_t Vulkan::LightClusters::DataSize(uint32_t indexCount)
+{
+	return k_clusterCount * 2 + indexCount;
+}
+
+uint32_t Vulkan::LightClusters::Slice(float depth) const
+{
+	depth = std::max(depth, k_minSliceDepth);
+	float slice = std::floor((m_perspective ? std::log(depth) : depth) * m_sliceScale + m_sliceBias);
+	return static_cast<uint32_t>(std::min(std::max(slice, 0.0f), static_cast<float>(k_slices - 1)));
+}
@@ -0,0 +1,72 @@
+/*=========================================================
+LightClusters.h - Binning of local lights into a view space
+grid for clustered forward shading. The viewport is split in
+screen tiles and the view depth in slices, spaced
+exponentially for perspective cameras so near clusters stay
+small. Every light sphere is added to the clusters its
+screen rectangle and depth range touch, then the grid is
+flattened into an offset and count per cluster followed by
+the light indices the fragment shader walks.
+==========================================================*/
+
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <glm\matrix.hpp>
+
+namespace Vulkan
+{
+	///How fragments find their cluster, matches the grid fields of FragUbo in fragment.frag
+	struct ClusterGrid
+	{
+		//slice = depth * x + y, with depth replaced by its logarithm when z is 1
+		glm::vec4 depthSlicing;
+		//tiles across, tiles down and depth slices, w is left to the user
+		glm::uvec4 size;
+	};
+
+	class LightClusters
+	{
+	public:
+		static const uint32_t k_tilesX = 16;
+		static const uint32_t k_tilesY = 9;
+		static const uint32_t k_slices = 24;
+		static const uint32_t k_clusterCount = k_tilesX * k_tilesY * k_slices;
+		///Clear the grid for a camera, view depth between zNear and zFar is sliced
+		void Begin(const glm::mat4& projection, float zNear, float zFar, bool perspective);
+		///Add light to every cluster touched by a view space sphere
+		void Add(uint32_t light, const glm::vec3& center, float radius);
+		///Flatten the grid after the last Add
+		void Finish();
+		///Offset into this array and light count of every cluster, followed by the light indices
+		const std::vector<uint32_t>& Data() const;
+		uint32_t IndexCount() const;
+		ClusterGrid Grid() const;
+		///32 bit words Data takes with indexCount light indices
+		static uint32_t DataSize(uint32_t indexCount);
+
+	private:
+		uint32_t Slice(float depth) const;
+
+	private:
+		//clusters every added light covers, inclusive
+		struct Range
+		{
+			uint32_t light;
+			uint32_t minX, maxX;
+			uint32_t minY, maxY;
+			uint32_t minZ, maxZ;
+		};
+
+	private:
+		glm::mat4 m_projection;
+		float m_zNear = 0.0f;
+		float m_zFar = 0.0f;
+		bool m_perspective = true;
+		float m_sliceScale = 0.0f;
+		float m_sliceBias = 0.0f;
+		std::vector<Range> m_ranges;
+		std::vector<uint32_t> m_data;
+		uint32_t m_indexCount = 0;
+	};
+}
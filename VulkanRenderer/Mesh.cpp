@@ -5,6 +5,10 @@
 #include <assimp/postprocess.h>
 #include <assimp/cimport.h>
 #include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <glm\common.hpp>
+#include <glm\geometric.hpp>
 #include "VulkanHash.h"
 
 std::atomic<uint32_t> Vulkan::Mesh::globalID = 0;
@@ -279,20 +283,34 @@ void Vulkan::Mesh::WriteToInternalMesh(const char* filepath,std::vector<Vulkan::
 	meshData.vertexRange.start = static_cast<uint32_t>(m_iMeshVertices.size());
 	meshData.indiceRange.start = static_cast<uint32_t>(m_iMeshIndices.size());
 
-	size_t currentSize = m_iMeshVertices.size();
-	size_t neededSize = currentSize + verts.size();
-	size_t currentCap = m_iMeshVertices.capacity();
-	if (neededSize > currentCap)
-		m_iMeshVertices.resize(neededSize);
+	//bounds are taken before the vertices are moved into the pool
+	if (!verts.empty())
+	{
+		glm::vec3 minPos = verts[0].pos;
+		glm::vec3 maxPos = verts[0].pos;
+		for (const VkVertex& vert : verts)
+		{
+			minPos = glm::min(minPos, vert.pos);
+			maxPos = glm::max(maxPos, vert.pos);
+		}
+		meshData.boundsCenter = (minPos + maxPos) * 0.5f;
+		meshData.boundsExtents = (maxPos - minPos) * 0.5f;
+		float radiusSquared = 0.0f;
+		for (const VkVertex& vert : verts)
+		{
+			glm::vec3 offset = vert.pos - meshData.boundsCenter;
+			radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+		}
+		meshData.boundsRadius = std::sqrt(radiusSquared);
+	}
 
+	//the pool is append only, the renderer uploads everything past its last high-water mark
+	size_t currentSize = m_iMeshVertices.size();
+	m_iMeshVertices.resize(currentSize + verts.size());
 	std::move(verts.begin(), verts.end(), m_iMeshVertices.begin() + currentSize);
 
 	currentSize = m_iMeshIndices.size();
-	neededSize = currentSize + indices.size();
-	currentCap = m_iMeshIndices.capacity();
-	if (neededSize > currentCap)
-		m_iMeshIndices.resize(neededSize);
-
+	m_iMeshIndices.resize(currentSize + indices.size());
 	std::move(indices.begin(), indices.end(), m_iMeshIndices.begin() + currentSize);
 
 	meshData.indiceRange.end = static_cast<uint32_t>(m_iMeshIndices.size());
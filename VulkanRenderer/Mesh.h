@@ -25,6 +25,11 @@ namespace Vulkan
 		uint32_t indiceCount;
 		uint32_t vertexCount;
 		uint32_t materialIndex; // to be used when creating materials via import
+		//local space bounding sphere, centered on the vertex bounding box
+		glm::vec3 boundsCenter;
+		float boundsRadius;
+		//half size of the vertex bounding box around boundsCenter
+		glm::vec3 boundsExtents;
 	};
 	class Material;
 	struct VkVertex;
@@ -0,0 +1,268 @@
+#include "OcclusionBuffer.h"
+#include <algorithm>
+#include <cmath>
+#include <assert.h>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define OCCLUSION_BUFFER_SSE 1
+#endif
+
+//clip w below which a vertex counts as behind the eye
+static const float k_minClipW = 1e-5f;
+
+Vulkan::OcclusionBuffer::OcclusionBuffer(uint32_t width, uint32_t height, uint32_t workerCount)
+{
+	assert(width > 0 && height > 0);
+	//rows are processed 4 pixels at a time, so every row starts on a multiple of 4
+	m_width = (width + 3) & ~3u;
+	m_height = height;
+	m_bandCount = std::min(workerCount + 1, height);
+	m_depth.assign(m_width * m_height, 1.0f);
+	for (uint32_t band = 1; band < m_bandCount; ++band)
+		m_workers.push_back(std::thread(&OcclusionBuffer::WorkerLoop, this, band));
+}
+
+Vulkan::OcclusionBuffer::~OcclusionBuffer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_exit = true;
+	}
+	m_jobReady.notify_all();
+	for (std::thread& worker : m_workers)
+	{
+		if (worker.joinable())
+			worker.join();
+	}
+}
+
+void Vulkan::OcclusionBuffer::Begin(const glm::mat4 & viewProjection)
+{
+	m_viewProjection = viewProjection;
+	std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+	m_triangles.clear();
+}
+
+void Vulkan::OcclusionBuffer::AddOccluder(const void * positions, size_t stride, const uint32_t * indices, uint32_t indexCount, const glm::mat4 & transform)
+{
+	assert(positions != nullptr && indices != nullptr);
+	const char * bytes = static_cast<const char*>(positions);
+	glm::mat4 mvp = m_viewProjection * transform;
+	for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		Triangle triangle;
+		bool clipped = false;
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			const glm::vec3& position = *reinterpret_cast<const glm::vec3*>(bytes + indices[i + k] * stride);
+			glm::vec4 clip = mvp * glm::vec4(position, 1.0f);
+			//an occluder only has to hide things, dropping triangles through the near plane is always safe
+			if (clip.w < k_minClipW)
+			{
+				clipped = true;
+				break;
+			}
+			float invW = 1.0f / clip.w;
+			triangle.v[k].x = (clip.x * invW * 0.5f + 0.5f) * m_width;
+			triangle.v[k].y = (clip.y * invW * 0.5f + 0.5f) * m_height;
+			triangle.v[k].z = clip.z * invW;
+		}
+		if (!clipped)
+			m_triangles.push_back(triangle);
+	}
+}
+
+void Vulkan::OcclusionBuffer::Rasterize()
+{
+	if (m_triangles.empty())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_pendingBands = m_bandCount - 1;
+		m_jobGeneration++;
+	}
+	m_jobReady.notify_all();
+
+	//the calling thread takes the first band instead of waiting idle
+	RasterizeBand(0);
+
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_jobDone.wait(lock, [this]() { return m_pendingBands == 0; });
+}
+
+bool Vulkan::OcclusionBuffer::IsVisible(const glm::mat4 & transform, const glm::vec3 & center, const glm::vec3 & extents) const
+{
+	glm::mat4 mvp = m_viewProjection * transform;
+	float minX = static_cast<float>(m_width);
+	float minY = static_cast<float>(m_height);
+	float maxX = 0.0f;
+	float maxY = 0.0f;
+	float minZ = 1.0f;
+	for (uint32_t corner = 0; corner < 8; ++corner)
+	{
+		glm::vec3 position = center;
+		position.x += (corner & 1) ? extents.x : -extents.x;
+		position.y += (corner & 2) ? extents.y : -extents.y;
+		position.z += (corner & 4) ? extents.z : -extents.z;
+		glm::vec4 clip = mvp * glm::vec4(position, 1.0f);
+		if (clip.w < k_minClipW)
+			return true;
+		float invW = 1.0f / clip.w;
+		float x = (clip.x * invW * 0.5f + 0.5f) * m_width;
+		float y = (clip.y * invW * 0.5f + 0.5f) * m_height;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		minZ = std::min(minZ, clip.z * invW);
+	}
+
+	int x0 = std::max(static_cast<int>(std::floor(minX)), 0);
+	int x1 = std::min(static_cast<int>(std::floor(maxX)), static_cast<int>(m_width) - 1);
+	int y0 = std::max(static_cast<int>(std::floor(minY)), 0);
+	int y1 = std::min(static_cast<int>(std::floor(maxY)), static_cast<int>(m_height) - 1);
+	//outside the buffer there is nothing to test against
+	if (x0 > x1 || y0 > y1)
+		return true;
+
+	for (int y = y0; y <= y1; ++y)
+	{
+		const float * row = &m_depth[y * m_width];
+#ifdef OCCLUSION_BUFFER_SSE
+		const __m128 boxDepth = _mm_set1_ps(minZ);
+		const __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+		for (int x = x0 & ~3; x <= x1; x += 4)
+		{
+			__m128i column = _mm_add_epi32(_mm_set1_epi32(x), lanes);
+			__m128i inRange = _mm_and_si128(_mm_cmpgt_epi32(column, _mm_set1_epi32(x0 - 1)), _mm_cmplt_epi32(column, _mm_set1_epi32(x1 + 1)));
+			__m128 nearer = _mm_cmple_ps(boxDepth, _mm_loadu_ps(row + x));
+			if (_mm_movemask_ps(_mm_and_ps(nearer, _mm_castsi128_ps(inRange))) != 0)
+				return true;
+		}
+#else
+		for (int x = x0; x <= x1; ++x)
+		{
+			if (minZ <= row[x])
+				return true;
+		}
+#endif
+	}
+	return false;
+}
+
+uint32_t Vulkan::OcclusionBuffer::Width() const
+{
+	return m_width;
+}
+
+uint32_t Vulkan::OcclusionBuffer::Height() const
+{
+	return m_height;
+}
+
+const float * Vulkan::OcclusionBuffer::Depth() const
+{
+	return m_depth.data();
+}
+
+void Vulkan::OcclusionBuffer::WorkerLoop(uint32_t band)
+{
+	uint64_t seenGeneration = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_jobReady.wait(lock, [&]() { return m_exit || m_jobGeneration != seenGeneration; });
+			if (m_exit)
+				return;
+			seenGeneration = m_jobGeneration;
+		}
+
+		RasterizeBand(band);
+
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (--m_pendingBands == 0)
+				m_jobDone.notify_one();
+		}
+	}
+}
+
+void Vulkan::OcclusionBuffer::RasterizeBand(uint32_t band)
+{
+	//bands never share a row, so no two threads write the same depth
+	int rowsPerBand = static_cast<int>((m_height + m_bandCount - 1) / m_bandCount);
+	int bandTop = static_cast<int>(band) * rowsPerBand;
+	int bandBottom = std::min(bandTop + rowsPerBand, static_cast<int>(m_height)) - 1;
+	if (bandTop > bandBottom)
+		return;
+
+	for (const Triangle& triangle : m_triangles)
+	{
+		glm::vec3 v0 = triangle.v[0];
+		glm::vec3 v1 = triangle.v[1];
+		glm::vec3 v2 = triangle.v[2];
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+		if (area == 0.0f)
+			continue;
+		//both windings are rasterized, occluders are closed or seen from either side
+		if (area < 0.0f)
+		{
+			std::swap(v1, v2);
+			area = -area;
+		}
+
+		int minX = std::max(static_cast<int>(std::floor(std::min(std::min(v0.x, v1.x), v2.x))), 0);
+		int maxX = std::min(static_cast<int>(std::ceil(std::max(std::max(v0.x, v1.x), v2.x))), static_cast<int>(m_width) - 1);
+		int minY = std::max(static_cast<int>(std::floor(std::min(std::min(v0.y, v1.y), v2.y))), bandTop);
+		int maxY = std::min(static_cast<int>(std::ceil(std::max(std::max(v0.y, v1.y), v2.y))), bandBottom);
+		if (minX > maxX || minY > maxY)
+			continue;
+
+		//edge functions a*x + b*y + c, positive on the inner side of each edge
+		float a0 = v1.y - v2.y, b0 = v2.x - v1.x, c0 = v1.x * v2.y - v1.y * v2.x;
+		float a1 = v2.y - v0.y, b1 = v0.x - v2.x, c1 = v2.x * v0.y - v2.y * v0.x;
+		float a2 = v0.y - v1.y, b2 = v1.x - v0.x, c2 = v0.x * v1.y - v0.y * v1.x;
+		//depth as a plane over the screen, interpolated with the normalized edge functions
+		float invArea = 1.0f / area;
+		float za = (a0 * v0.z + a1 * v1.z + a2 * v2.z) * invArea;
+		float zb = (b0 * v0.z + b1 * v1.z + b2 * v2.z) * invArea;
+		float zc = (c0 * v0.z + c1 * v1.z + c2 * v2.z) * invArea;
+
+		for (int y = minY; y <= maxY; ++y)
+		{
+			float * row = &m_depth[y * m_width];
+			float py = y + 0.5f;
+#ifdef OCCLUSION_BUFFER_SSE
+			const __m128 lanes = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 minColumn = _mm_set1_ps(static_cast<float>(minX));
+			const __m128 maxColumn = _mm_set1_ps(static_cast<float>(maxX) + 1.0f);
+			for (int x = minX & ~3; x <= maxX; x += 4)
+			{
+				__m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), lanes);
+				__m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a0), px), _mm_set1_ps(b0 * py + c0));
+				__m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a1), px), _mm_set1_ps(b1 * py + c1));
+				__m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a2), px), _mm_set1_ps(b2 * py + c2));
+				//coverage mask of the pixel centers, lanes outside the bounds are masked as well
+				__m128 covered = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+				covered = _mm_and_ps(covered, _mm_and_ps(_mm_cmpgt_ps(px, minColumn), _mm_cmplt_ps(px, maxColumn)));
+				if (_mm_movemask_ps(covered) == 0)
+					continue;
+				__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), px), _mm_set1_ps(zb * py + zc));
+				__m128 depth = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_min_ps(depth, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(covered, nearest), _mm_andnot_ps(covered, depth)));
+			}
+#else
+			for (int x = minX; x <= maxX; ++x)
+			{
+				float px = x + 0.5f;
+				if (a0 * px + b0 * py + c0 < 0.0f || a1 * px + b1 * py + c1 < 0.0f || a2 * px + b2 * py + c2 < 0.0f)
+					continue;
+				row[x] = std::min(row[x], za * px + zb * py + zc);
+			}
+#endif
+		}
+	}
+}
@@ -0,0 +1,67 @@
+/*=========================================================
+OcclusionBuffer.h - Low resolution software depth buffer used
+to reject objects hidden behind large occluders before their
+draws are built. Occluder triangles are rasterized four pixels
+at a time with coverage masks on worker threads, each one
+owning a band of rows. Bounding boxes are then tested against
+the nearest occluder depth of the pixels they cover. Nothing
+here touches Vulkan, so the buffer also works headless.
+==========================================================*/
+
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include <glm\matrix.hpp>
+
+namespace Vulkan
+{
+	class OcclusionBuffer
+	{
+	public:
+		///width is rounded up to a multiple of 4, rows are split in one band per worker plus one for the calling thread
+		OcclusionBuffer(uint32_t width, uint32_t height, uint32_t workerCount);
+		OcclusionBuffer(const OcclusionBuffer&) = delete;
+		OcclusionBuffer& operator=(const OcclusionBuffer&) = delete;
+		~OcclusionBuffer();
+		///Clear depth and occluders, viewProjection must map depth to the zero to one range
+		void Begin(const glm::mat4& viewProjection);
+		///Queue indexed triangles placed by transform, positions are read stride bytes apart
+		void AddOccluder(const void * positions, size_t stride, const uint32_t * indices, uint32_t indexCount, const glm::mat4& transform);
+		///Rasterize the queued occluders, blocks until every band is done
+		void Rasterize();
+		///False when the box around center is behind the occluders everywhere it covers, boxes crossing the near plane are always visible
+		bool IsVisible(const glm::mat4& transform, const glm::vec3& center, const glm::vec3& extents) const;
+		uint32_t Width() const;
+		uint32_t Height() const;
+		const float * Depth() const;
+
+	private:
+		//screen space triangle, x and y in pixels and z in zero to one depth
+		struct Triangle
+		{
+			glm::vec3 v[3];
+		};
+
+		void WorkerLoop(uint32_t band);
+		void RasterizeBand(uint32_t band);
+
+	private:
+		uint32_t m_width = 0;
+		uint32_t m_height = 0;
+		uint32_t m_bandCount = 1;
+		glm::mat4 m_viewProjection;
+		std::vector<float> m_depth;
+		std::vector<Triangle> m_triangles;
+
+		std::vector<std::thread> m_workers;
+		std::mutex m_lock;
+		std::condition_variable m_jobReady;
+		std::condition_variable m_jobDone;
+		uint64_t m_jobGeneration = 0;
+		uint32_t m_pendingBands = 0;
+		bool m_exit = false;
+	};
+}
@@ -0,0 +1,592 @@
+#include "RenderGraph.h"
+#include "VkManagedDevice.h"
+#include "VkManagedImage.h"
+#include <algorithm>
+#include <assert.h>
+
+Vulkan::RenderGraph::RenderGraph(VkManagedDevice * device, uint32_t frameCount)
+{
+	assert(device != nullptr);
+	assert(frameCount > 0);
+	m_mdevice = device;
+	m_device = *m_mdevice;
+	m_frames.resize(frameCount);
+}
+
+Vulkan::RenderGraph::~RenderGraph()
+{
+	for (FrameTransients& frame : m_frames)
+		ReleaseTransients(frame);
+}
+
+void Vulkan::RenderGraph::Begin(uint32_t frameIndex)
+{
+	assert(frameIndex < m_frames.size());
+	m_frameIndex = frameIndex;
+	m_resources.clear();
+	m_passes.clear();
+	m_exitBarrier.Clear();
+	m_culledPasses = 0;
+	m_barrierCount = 0;
+	m_compiled = false;
+}
+
+uint32_t Vulkan::RenderGraph::ImportImage(VkManagedImage * image, Usage lastUsage)
+{
+	assert(image != nullptr);
+	assert(!m_compiled);
+	Resource resource;
+	resource.isImage = true;
+	resource.image = image;
+	resource.aspect = image->aspect;
+	resource.lastUsage = lastUsage;
+	m_resources.push_back(resource);
+	return static_cast<uint32_t>(m_resources.size() - 1);
+}
+
+uint32_t Vulkan::RenderGraph::ImportBuffer(VkBuffer buffer, Usage lastUsage)
+{
+	assert(buffer != VK_NULL_HANDLE);
+	assert(!m_compiled);
+	Resource resource;
+	resource.buffer = buffer;
+	resource.lastUsage = lastUsage;
+	m_resources.push_back(resource);
+	return static_cast<uint32_t>(m_resources.size() - 1);
+}
+
+uint32_t Vulkan::RenderGraph::CreateImage(VkExtent2D extent, VkFormat format, VkImageAspectFlags aspect, VkImageUsageFlags usage)
+{
+	assert(format != VK_FORMAT_UNDEFINED && usage != 0);
+	assert(!m_compiled);
+	Resource resource;
+	resource.isImage = true;
+	resource.transient = true;
+	resource.extent = extent;
+	resource.format = format;
+	resource.aspect = aspect;
+	resource.usageFlags = usage;
+	m_resources.push_back(resource);
+	return static_cast<uint32_t>(m_resources.size() - 1);
+}
+
+uint32_t Vulkan::RenderGraph::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage)
+{
+	assert(size > 0 && usage != 0);
+	assert(!m_compiled);
+	Resource resource;
+	resource.transient = true;
+	resource.size = size;
+	resource.usageFlags = usage;
+	m_resources.push_back(resource);
+	return static_cast<uint32_t>(m_resources.size() - 1);
+}
+
+uint32_t Vulkan::RenderGraph::AddPass(const std::string & name, RecordCallback record)
+{
+	assert(!m_compiled);
+	Pass pass;
+	pass.name = name;
+	pass.record = record;
+	m_passes.push_back(pass);
+	return static_cast<uint32_t>(m_passes.size() - 1);
+}
+
+void Vulkan::RenderGraph::Read(uint32_t pass, uint32_t resource, Usage usage)
+{
+	assert(!Info(usage).write);
+	AddAccess(pass, resource, usage, false, false, VK_IMAGE_LAYOUT_UNDEFINED);
+}
+
+void Vulkan::RenderGraph::Write(uint32_t pass, uint32_t resource, Usage usage)
+{
+	AddAccess(pass, resource, usage, true, false, VK_IMAGE_LAYOUT_UNDEFINED);
+}
+
+void Vulkan::RenderGraph::WriteAttachment(uint32_t pass, uint32_t resource, Usage usage, VkImageLayout finalLayout)
+{
+	assert(usage == ColorAttachment || usage == DepthAttachment);
+	AddAccess(pass, resource, usage, true, true, finalLayout);
+}
+
+void Vulkan::RenderGraph::Retain(uint32_t resource, Usage finalUsage)
+{
+	assert(resource < m_resources.size());
+	assert(!m_compiled);
+	m_resources[resource].retained = true;
+	m_resources[resource].finalUsage = finalUsage;
+}
+
+void Vulkan::RenderGraph::AddAccess(uint32_t pass, uint32_t resource, Usage usage, bool write, bool attachment, VkImageLayout finalLayout)
+{
+	assert(pass < m_passes.size() && resource < m_resources.size());
+	assert(usage != Undefined && usage != Present);
+	assert(!m_compiled);
+	UsageInfo info = Info(usage);
+
+	//several uses of one resource in a pass are covered by the same barrier
+	for (Access& access : m_passes[pass].accesses)
+	{
+		if (access.resource != resource)
+			continue;
+		assert(!access.attachment && !attachment);
+		access.stages |= info.stages;
+		access.access |= info.access;
+		access.write = access.write || write;
+		//shader and transfer uses of an image can only share the general layout
+		if (access.layout != info.layout)
+			access.layout = VK_IMAGE_LAYOUT_GENERAL;
+		return;
+	}
+
+	Access access;
+	access.resource = resource;
+	access.stages = info.stages;
+	access.access = info.access;
+	access.layout = info.layout;
+	access.write = write;
+	access.attachment = attachment;
+	access.finalLayout = finalLayout;
+	m_passes[pass].accesses.push_back(access);
+}
+
+void Vulkan::RenderGraph::Compile()
+{
+	assert(!m_compiled);
+	Cull();
+
+	for (uint32_t p = 0; p < m_passes.size(); ++p)
+	{
+		if (!m_passes[p].live)
+			continue;
+		for (const Access& access : m_passes[p].accesses)
+		{
+			Resource& resource = m_resources[access.resource];
+			if (resource.firstPass == UINT32_MAX)
+				resource.firstPass = p;
+			resource.lastPass = p;
+		}
+	}
+	BuildTransients();
+
+	//imported resources start the way they were left, transients with nothing
+	std::vector<VkManagedSubresourceState> states(m_resources.size());
+	for (size_t r = 0; r < m_resources.size(); ++r)
+	{
+		const Resource& resource = m_resources[r];
+		if (resource.transient)
+			continue;
+		UsageInfo info = Info(resource.lastUsage);
+		if (resource.isImage)
+			states[r].layout = info.layout;
+		if (info.write)
+		{
+			states[r].writeStages = info.stages;
+			states[r].writeAccess = info.access & VkManagedResourceState::k_writeAccess;
+		}
+		else
+		{
+			states[r].readStages = info.stages;
+		}
+	}
+
+	for (uint32_t p = 0; p < m_passes.size(); ++p)
+	{
+		Pass& pass = m_passes[p];
+		pass.barrier.Clear();
+		if (!pass.live)
+			continue;
+		for (const Access& access : pass.accesses)
+		{
+			Resource& resource = m_resources[access.resource];
+			VkManagedSubresourceState& state = states[access.resource];
+			//memory taken over from an earlier transient, whatever it was last used for has to finish first
+			if (resource.transient && resource.firstPass == p && resource.aliasPrevious != UINT32_MAX)
+			{
+				state = states[resource.aliasPrevious];
+				state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+				state.visibleStages = 0;
+			}
+			if (access.attachment)
+			{
+				//the render pass only waits on earlier uses of its own attachments, the last user of aliased memory is waited on here
+				if (resource.transient && resource.firstPass == p && resource.aliasPrevious != UINT32_MAX)
+					PlaceBarrier(pass.barrier, resource, state, access.stages, access.access, access.layout);
+				//the render pass transitions its attachments itself, only what it leaves behind is tracked
+				state.layout = access.finalLayout;
+				state.writeStages = access.stages;
+				state.writeAccess = access.access & VkManagedResourceState::k_writeAccess;
+				state.visibleStages = 0;
+				state.readStages = 0;
+				continue;
+			}
+			PlaceBarrier(pass.barrier, resource, state, access.stages, access.access, access.layout);
+		}
+		if (!pass.barrier.Empty())
+			m_barrierCount++;
+	}
+
+	for (size_t r = 0; r < m_resources.size(); ++r)
+	{
+		Resource& resource = m_resources[r];
+		if (resource.retained && resource.finalUsage != Undefined)
+		{
+			UsageInfo info = Info(resource.finalUsage);
+			PlaceBarrier(m_exitBarrier, resource, states[r], info.stages, info.access, info.layout);
+		}
+		//imported images keep track of how the graph leaves them
+		if (resource.isImage && !resource.transient && resource.firstPass != UINT32_MAX)
+			resource.image->Assume(states[r].layout, states[r].writeStages | states[r].readStages, states[r].writeAccess);
+	}
+	if (!m_exitBarrier.Empty())
+		m_barrierCount++;
+	m_compiled = true;
+}
+
+void Vulkan::RenderGraph::Execute(VkCommandBuffer commandBuffer)
+{
+	assert(m_compiled);
+	for (Pass& pass : m_passes)
+	{
+		if (!pass.live)
+			continue;
+		pass.barrier.Flush(commandBuffer);
+		pass.record(commandBuffer);
+	}
+	m_exitBarrier.Flush(commandBuffer);
+}
+
+Vulkan::VkManagedImage * Vulkan::RenderGraph::Image(uint32_t resource)
+{
+	assert(resource < m_resources.size() && m_resources[resource].isImage);
+	assert(m_compiled || !m_resources[resource].transient);
+	return m_resources[resource].image;
+}
+
+VkBuffer Vulkan::RenderGraph::Buffer(uint32_t resource)
+{
+	assert(resource < m_resources.size() && !m_resources[resource].isImage);
+	assert(m_compiled || !m_resources[resource].transient);
+	return m_resources[resource].buffer;
+}
+
+uint32_t Vulkan::RenderGraph::CulledPassCount()
+{
+	return m_culledPasses;
+}
+
+uint32_t Vulkan::RenderGraph::BarrierCount()
+{
+	return m_barrierCount;
+}
+
+VkDeviceSize Vulkan::RenderGraph::TransientBytes()
+{
+	return m_frames[m_frameIndex].bytes;
+}
+
+uint64_t Vulkan::RenderGraph::TransientVersion()
+{
+	return m_frames[m_frameIndex].version;
+}
+
+Vulkan::RenderGraph::UsageInfo Vulkan::RenderGraph::Info(Usage usage)
+{
+	switch (usage)
+	{
+	case TransferRead:
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false };
+	case TransferWrite:
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true };
+	case VertexInput:
+		return { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false };
+	case IndirectRead:
+		return { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false };
+	case VertexShaderRead:
+		return { VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+	case FragmentShaderRead:
+		return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+	case ComputeRead:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+	case ComputeWrite:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true };
+	case ColorAttachment:
+		return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true };
+	case DepthAttachment:
+		return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true };
+	case HostRead:
+		return { VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false };
+	case Present:
+		return { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false };
+	default:
+		return { 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, false };
+	}
+}
+
+void Vulkan::RenderGraph::Cull()
+{
+	//walking back from the retained resources, a pass stays when a later pass or the frame needs something it writes
+	std::vector<bool> needed(m_resources.size(), false);
+	for (size_t r = 0; r < m_resources.size(); ++r)
+		needed[r] = m_resources[r].retained;
+
+	m_culledPasses = 0;
+	for (size_t p = m_passes.size(); p-- > 0;)
+	{
+		Pass& pass = m_passes[p];
+		pass.live = false;
+		for (const Access& access : pass.accesses)
+		{
+			if (access.write && needed[access.resource])
+				pass.live = true;
+		}
+		if (!pass.live)
+		{
+			m_culledPasses++;
+			continue;
+		}
+		//earlier writers of anything it touches are needed as well, partial writes keep what was there
+		for (const Access& access : pass.accesses)
+			needed[access.resource] = true;
+	}
+}
+
+void Vulkan::RenderGraph::BuildTransients()
+{
+	FrameTransients& frame = m_frames[m_frameIndex];
+	std::vector<Resource> declarations;
+	std::vector<uint32_t> slotResources;
+	for (uint32_t r = 0; r < m_resources.size(); ++r)
+	{
+		const Resource& resource = m_resources[r];
+		if (!resource.transient || resource.firstPass == UINT32_MAX)
+			continue;
+		declarations.push_back(resource);
+		slotResources.push_back(r);
+	}
+
+	//the same declarations and lifetimes as the last time this frame was recorded reuse its objects and aliasing
+	if (!SameTransients(declarations, frame.declarations))
+	{
+		ReleaseTransients(frame);
+		size_t count = declarations.size();
+		frame.images.assign(count, VK_NULL_HANDLE);
+		frame.views.assign(count, nullptr);
+		frame.buffers.assign(count, VK_NULL_HANDLE);
+		std::vector<VkMemoryRequirements> requirements(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const Resource& declaration = declarations[i];
+			VkResult result;
+			if (declaration.isImage)
+			{
+				VkImageCreateInfo imageCI = {};
+				imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+				imageCI.imageType = VK_IMAGE_TYPE_2D;
+				imageCI.format = declaration.format;
+				imageCI.extent = { declaration.extent.width, declaration.extent.height, 1 };
+				imageCI.mipLevels = 1;
+				imageCI.arrayLayers = 1;
+				imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+				imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+				imageCI.usage = declaration.usageFlags;
+				imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+				imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				result = vkCreateImage(m_device, &imageCI, nullptr, &frame.images[i]);
+				if (result != VK_SUCCESS)
+					throw std::runtime_error("Unable to create transient image. Reason: " + Vulkan::VkResultToString(result));
+				vkGetImageMemoryRequirements(m_device, frame.images[i], &requirements[i]);
+			}
+			else
+			{
+				VkBufferCreateInfo bufferCI = {};
+				bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+				bufferCI.size = declaration.size;
+				bufferCI.usage = declaration.usageFlags;
+				bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+				result = vkCreateBuffer(m_device, &bufferCI, nullptr, &frame.buffers[i]);
+				if (result != VK_SUCCESS)
+					throw std::runtime_error("Unable to create transient buffer. Reason: " + Vulkan::VkResultToString(result));
+				vkGetBufferMemoryRequirements(m_device, frame.buffers[i], &requirements[i]);
+			}
+		}
+
+		//first fit in order of first use, memory is free again once the lifetime of its last user ended
+		//an image and a buffer only share a slot padded to whole granularity pages, so the slot never sits next to the other kind
+		struct MemorySlot
+		{
+			bool hasImage;
+			bool hasBuffer;
+			uint32_t lastPass;
+			VkMemoryRequirements requirements;
+			std::vector<uint32_t> users;
+		};
+		std::vector<uint32_t> order(count);
+		for (uint32_t i = 0; i < count; ++i)
+			order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return declarations[a].firstPass < declarations[b].firstPass; });
+		std::vector<MemorySlot> slots;
+		for (uint32_t i : order)
+		{
+			Resource& declaration = declarations[i];
+			declaration.aliasPrevious = UINT32_MAX;
+			MemorySlot * fit = nullptr;
+			for (MemorySlot& slot : slots)
+			{
+				if (slot.lastPass < declaration.firstPass && (slot.requirements.memoryTypeBits & requirements[i].memoryTypeBits) != 0)
+				{
+					fit = &slot;
+					break;
+				}
+			}
+			if (fit == nullptr)
+			{
+				MemorySlot slot;
+				slot.hasImage = declaration.isImage;
+				slot.hasBuffer = !declaration.isImage;
+				slot.lastPass = declaration.lastPass;
+				slot.requirements = requirements[i];
+				slot.users.push_back(i);
+				slots.push_back(slot);
+				continue;
+			}
+			declaration.aliasPrevious = fit->users.back();
+			fit->hasImage = fit->hasImage || declaration.isImage;
+			fit->hasBuffer = fit->hasBuffer || !declaration.isImage;
+			fit->lastPass = declaration.lastPass;
+			fit->requirements.size = std::max(fit->requirements.size, requirements[i].size);
+			fit->requirements.alignment = std::max(fit->requirements.alignment, requirements[i].alignment);
+			fit->requirements.memoryTypeBits &= requirements[i].memoryTypeBits;
+			fit->users.push_back(i);
+		}
+
+		VkDeviceSize granularity = std::max<VkDeviceSize>(m_mdevice->GetPhysicalDeviceLimits().bufferImageGranularity, 1);
+		for (MemorySlot& slot : slots)
+		{
+			if (slot.hasImage && slot.hasBuffer)
+			{
+				slot.requirements.alignment = std::max(slot.requirements.alignment, granularity);
+				slot.requirements.size = (slot.requirements.size + granularity - 1) / granularity * granularity;
+			}
+			VkManagedAllocation allocation = m_mdevice->Allocator()->Allocate(slot.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.hasImage ? VK_VKM_RESOURCE_OPTIMAL : VK_VKM_RESOURCE_LINEAR);
+			frame.memory.push_back(allocation);
+			frame.bytes += allocation.size;
+			for (uint32_t i : slot.users)
+			{
+				const Resource& declaration = declarations[i];
+				VkResult result = declaration.isImage ?
+					vkBindImageMemory(m_device, frame.images[i], allocation.memory, allocation.offset) :
+					vkBindBufferMemory(m_device, frame.buffers[i], allocation.memory, allocation.offset);
+				if (result != VK_SUCCESS)
+					throw std::runtime_error("Unable to bind transient memory. Reason: " + Vulkan::VkResultToString(result));
+				if (declaration.isImage)
+				{
+					frame.views[i] = new VkManagedImage(m_mdevice, false);
+					frame.views[i]->Build(frame.images[i], declaration.format, declaration.extent, 1, declaration.aspect, VK_IMAGE_LAYOUT_UNDEFINED);
+				}
+			}
+		}
+		frame.declarations = declarations;
+		frame.version = ++m_transientVersion;
+	}
+
+	for (size_t i = 0; i < slotResources.size(); ++i)
+	{
+		Resource& resource = m_resources[slotResources[i]];
+		uint32_t previous = frame.declarations[i].aliasPrevious;
+		resource.aliasPrevious = previous != UINT32_MAX ? slotResources[previous] : UINT32_MAX;
+		if (resource.isImage)
+		{
+			resource.image = frame.views[i];
+			//every frame starts from undefined contents
+			resource.image->Assume(VK_IMAGE_LAYOUT_UNDEFINED);
+		}
+		else
+		{
+			resource.buffer = frame.buffers[i];
+		}
+	}
+}
+
+void Vulkan::RenderGraph::ReleaseTransients(FrameTransients & frame)
+{
+	for (VkManagedImage * view : frame.views)
+		delete view;
+	for (VkImage image : frame.images)
+	{
+		if (image != VK_NULL_HANDLE)
+			vkDestroyImage(m_device, image, nullptr);
+	}
+	for (VkBuffer buffer : frame.buffers)
+	{
+		if (buffer != VK_NULL_HANDLE)
+			vkDestroyBuffer(m_device, buffer, nullptr);
+	}
+	for (VkManagedAllocation& allocation : frame.memory)
+		m_mdevice->Allocator()->Free(allocation);
+	frame.views.clear();
+	frame.images.clear();
+	frame.buffers.clear();
+	frame.memory.clear();
+	frame.declarations.clear();
+	frame.bytes = 0;
+	frame.version = 0;
+}
+
+bool Vulkan::RenderGraph::SameTransients(const std::vector<Resource>& a, const std::vector<Resource>& b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		if (a[i].isImage != b[i].isImage || a[i].format != b[i].format || a[i].aspect != b[i].aspect || a[i].usageFlags != b[i].usageFlags || a[i].size != b[i].size)
+			return false;
+		if (a[i].extent.width != b[i].extent.width || a[i].extent.height != b[i].extent.height)
+			return false;
+		if (a[i].firstPass != b[i].firstPass || a[i].lastPass != b[i].lastPass)
+			return false;
+	}
+	return true;
+}
+
+void Vulkan::RenderGraph::PlaceBarrier(VkManagedBarrierBatch & barrier, Resource & resource, VkManagedSubresourceState & state, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout)
+{
+	VkPipelineStageFlags srcStages;
+	VkAccessFlags srcAccess;
+	VkImageLayout oldLayout;
+	if (!VkManagedResourceState::Advance(state, resource.isImage, stages, access, layout, srcStages, srcAccess, oldLayout))
+		return;
+
+	if (resource.isImage)
+	{
+		VkImageMemoryBarrier imageBarrier = {};
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier.srcAccessMask = srcAccess;
+		imageBarrier.dstAccessMask = access;
+		imageBarrier.oldLayout = oldLayout;
+		imageBarrier.newLayout = layout;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = *resource.image;
+		imageBarrier.subresourceRange = { resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+		barrier.Add(srcStages, stages, imageBarrier);
+	}
+	//a buffer written after reads only has to wait for them, there is no memory to make visible
+	else if (srcAccess == 0)
+	{
+		barrier.Add(srcStages, stages);
+	}
+	else
+	{
+		VkBufferMemoryBarrier bufferBarrier = {};
+		bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferBarrier.srcAccessMask = srcAccess;
+		bufferBarrier.dstAccessMask = access;
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = resource.buffer;
+		bufferBarrier.offset = 0;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		barrier.Add(srcStages, stages, bufferBarrier);
+	}
+}
@@ -0,0 +1,169 @@
+/*=========================================================
+RenderGraph.h - Frame graph over the passes recorded into a
+command buffer. Passes declare how they use the images and
+buffers they touch, passes nothing retained depends on are
+dropped, and every remaining pass is preceded by at most one
+barrier carrying all of its transitions with the stages and
+accesses of the uses on both sides. Transient resources only
+live from their first to their last use, the ones whose
+lifetimes do not overlap share memory, an image may take
+over the memory of a buffer and the other way around. Transients are kept
+per frame in flight and only recreated when the frame
+declares different ones.
+==========================================================*/
+
+#pragma once
+#include "VulkanObject.h"
+#include "VkManagedAllocator.h"
+#include "VkManagedResourceState.h"
+#include <vector>
+#include <string>
+#include <functional>
+
+namespace Vulkan
+{
+	class VkManagedDevice;
+	class VkManagedImage;
+	class RenderGraph
+	{
+	public:
+		enum Usage
+		{
+			//no use yet, contents are discarded by the first transition
+			Undefined = 0,
+			TransferRead = 1,
+			TransferWrite = 2,
+			VertexInput = 3,
+			IndirectRead = 4,
+			VertexShaderRead = 5,
+			FragmentShaderRead = 6,
+			ComputeRead = 7,
+			ComputeWrite = 8,
+			ColorAttachment = 9,
+			DepthAttachment = 10,
+			HostRead = 11,
+			Present = 12,
+			UsageCount = 13
+		};
+		typedef std::function<void(VkCommandBuffer commandBuffer)> RecordCallback;
+
+		RenderGraph(VkManagedDevice * device, uint32_t frameCount);
+		RenderGraph(const RenderGraph&) = delete;
+		RenderGraph& operator=(const RenderGraph&) = delete;
+		~RenderGraph();
+		///Drop the passes and resources declared for the last frame, the device must be done with the transients of frameIndex
+		void Begin(uint32_t frameIndex);
+		///Resource living outside the graph, lastUsage is how it was left before the first pass
+		uint32_t ImportImage(VkManagedImage * image, Usage lastUsage);
+		uint32_t ImportBuffer(VkBuffer buffer, Usage lastUsage);
+		///Resource only alive between its first and last use in the frame, its contents are undefined at the first one
+		uint32_t CreateImage(VkExtent2D extent, VkFormat format, VkImageAspectFlags aspect, VkImageUsageFlags usage);
+		uint32_t CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage);
+		///Passes run in the order they are added
+		uint32_t AddPass(const std::string& name, RecordCallback record);
+		void Read(uint32_t pass, uint32_t resource, Usage usage);
+		void Write(uint32_t pass, uint32_t resource, Usage usage);
+		///Attachment of a render pass, the render pass moves it to finalLayout and orders it against earlier uses with its own dependencies
+		void WriteAttachment(uint32_t pass, uint32_t resource, Usage usage, VkImageLayout finalLayout);
+		///Keep the passes writing resource, a finalUsage other than Undefined is made visible after the last pass
+		void Retain(uint32_t resource, Usage finalUsage = Undefined);
+		///Drop passes, alias transients and place the barriers, resources are valid afterwards
+		void Compile();
+		///Record the passes left by Compile, each after its barrier
+		void Execute(VkCommandBuffer commandBuffer);
+		VkManagedImage * Image(uint32_t resource);
+		VkBuffer Buffer(uint32_t resource);
+		uint32_t CulledPassCount();
+		uint32_t BarrierCount();
+		///Memory behind the transients of the current frame, after aliasing
+		VkDeviceSize TransientBytes();
+		///Changes every time Compile recreates the transients of the current frame, objects built over them have to follow
+		uint64_t TransientVersion();
+
+	private:
+		struct UsageInfo
+		{
+			VkPipelineStageFlags stages;
+			VkAccessFlags access;
+			VkImageLayout layout;
+			bool write;
+		};
+
+		struct Resource
+		{
+			bool isImage = false;
+			bool transient = false;
+			VkManagedImage * image = nullptr;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			//transient description
+			VkExtent2D extent = {};
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			VkImageAspectFlags aspect = 0;
+			VkFlags usageFlags = 0;
+			VkDeviceSize size = 0;
+			Usage lastUsage = Undefined;
+			Usage finalUsage = Undefined;
+			bool retained = false;
+			//live passes using it, UINT32_MAX when there are none
+			uint32_t firstPass = UINT32_MAX;
+			uint32_t lastPass = UINT32_MAX;
+			//transient that used the same memory before it, UINT32_MAX for the first one
+			uint32_t aliasPrevious = UINT32_MAX;
+		};
+
+		struct Access
+		{
+			uint32_t resource;
+			VkPipelineStageFlags stages;
+			VkAccessFlags access;
+			VkImageLayout layout;
+			bool write;
+			bool attachment;
+			VkImageLayout finalLayout;
+		};
+
+		struct Pass
+		{
+			std::string name;
+			RecordCallback record;
+			std::vector<Access> accesses;
+			bool live = false;
+			VkManagedBarrierBatch barrier;
+		};
+
+		//transients of one frame in flight and the declarations they were made for
+		struct FrameTransients
+		{
+			std::vector<Resource> declarations;
+			std::vector<VkImage> images;
+			std::vector<VkManagedImage*> views;
+			std::vector<VkBuffer> buffers;
+			std::vector<VkManagedAllocation> memory;
+			VkDeviceSize bytes = 0;
+			uint64_t version = 0;
+		};
+
+		static UsageInfo Info(Usage usage);
+		void AddAccess(uint32_t pass, uint32_t resource, Usage usage, bool write, bool attachment, VkImageLayout finalLayout);
+		void Cull();
+		void BuildTransients();
+		void ReleaseTransients(FrameTransients& frame);
+		static bool SameTransients(const std::vector<Resource>& a, const std::vector<Resource>& b);
+		//whole resources are tracked, the graph does not split them into mip levels or layers
+		void PlaceBarrier(VkManagedBarrierBatch& barrier, Resource& resource, VkManagedSubresourceState& state, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout);
+
+	private:
+		VkManagedDevice * m_mdevice = nullptr;
+		VulkanObjectContainer<VkDevice> m_device{ vkDestroyDevice, false };
+		uint32_t m_frameIndex = 0;
+		std::vector<Resource> m_resources;
+		std::vector<Pass> m_passes;
+		//barrier for the final usages of retained resources
+		VkManagedBarrierBatch m_exitBarrier;
+		std::vector<FrameTransients> m_frames;
+		uint64_t m_transientVersion = 0;
+		uint32_t m_culledPasses = 0;
+		uint32_t m_barrierCount = 0;
+		bool m_compiled = false;
+	};
+}
@@ -0,0 +1,295 @@
+#include "RenderProxyPool.h"
+#include "VkManagedDevice.h"
+#include "Mesh.h"
+#include "Material.h"
+#include <algorithm>
+#include <map>
+#include <assert.h>
+
+//proxies the instance buffer holds before its first grow
+static const uint32_t k_initialProxyCapacity = 256;
+
+Vulkan::RenderProxyPool::RenderProxyPool(VkManagedDevice * device, uint32_t frameCount) : m_instances(device)
+{
+	assert(device != nullptr);
+	assert(frameCount > 0);
+	m_mdevice = device;
+	m_frameCount = frameCount;
+	Reserve(k_initialProxyCapacity);
+}
+
+Vulkan::RenderProxyHandle Vulkan::RenderProxyPool::Create(Mesh * mesh, Material * material, const glm::mat4 & transform)
+{
+	assert(mesh != nullptr && material != nullptr);
+	RenderProxyHandle handle;
+	if (!m_freeHandles.empty())
+	{
+		handle = m_freeHandles.back();
+		m_freeHandles.pop_back();
+	}
+	else
+	{
+		handle = static_cast<RenderProxyHandle>(m_indices.size());
+		m_indices.push_back(k_invalidHandle);
+	}
+
+	m_indices[handle] = static_cast<uint32_t>(m_transforms.size());
+	m_transforms.push_back(transform);
+	m_meshIds.push_back(mesh->id);
+	m_materials.push_back(material);
+	m_instanceSlots.push_back(0);
+	m_dirtyFrames.push_back(0);
+	m_handles.push_back(handle);
+	m_proxyBatches.push_back(0);
+	m_bounds.Resize(m_transforms.size());
+	UpdateBounds(m_indices[handle]);
+	m_batchesDirty = true;
+	return handle;
+}
+
+void Vulkan::RenderProxyPool::Destroy(RenderProxyHandle handle)
+{
+	assert(handle < m_indices.size() && m_indices[handle] != k_invalidHandle);
+	uint32_t index = m_indices[handle];
+	uint32_t last = static_cast<uint32_t>(m_transforms.size() - 1);
+
+	//keep the arrays dense by moving the last proxy into the hole
+	if (index != last)
+	{
+		m_transforms[index] = m_transforms[last];
+		m_meshIds[index] = m_meshIds[last];
+		m_materials[index] = m_materials[last];
+		m_instanceSlots[index] = m_instanceSlots[last];
+		m_dirtyFrames[index] = m_dirtyFrames[last];
+		m_handles[index] = m_handles[last];
+		m_proxyBatches[index] = m_proxyBatches[last];
+		m_bounds.Move(index, last);
+		m_indices[m_handles[index]] = index;
+	}
+	m_transforms.pop_back();
+	m_meshIds.pop_back();
+	m_materials.pop_back();
+	m_instanceSlots.pop_back();
+	m_dirtyFrames.pop_back();
+	m_handles.pop_back();
+	m_proxyBatches.pop_back();
+	m_bounds.Resize(m_transforms.size());
+
+	m_indices[handle] = k_invalidHandle;
+	m_freeHandles.push_back(handle);
+	m_batchesDirty = true;
+}
+
+void Vulkan::RenderProxyPool::SetTransform(RenderProxyHandle handle, const glm::mat4 & transform)
+{
+	assert(handle < m_indices.size() && m_indices[handle] != k_invalidHandle);
+	uint32_t index = m_indices[handle];
+	m_transforms[index] = transform;
+	UpdateBounds(index);
+	MarkDirty(index);
+	m_centersDirty = true;
+}
+
+void Vulkan::RenderProxyPool::SetMaterial(RenderProxyHandle handle, Material * material)
+{
+	assert(handle < m_indices.size() && m_indices[handle] != k_invalidHandle);
+	assert(material != nullptr);
+	uint32_t index = m_indices[handle];
+	if (m_materials[index] == material)
+		return;
+	m_materials[index] = material;
+	m_batchesDirty = true;
+}
+
+bool Vulkan::RenderProxyPool::Update(uint32_t frameIndex)
+{
+	assert(frameIndex < m_frameCount);
+	bool rebuilt = false;
+	if (m_transforms.size() > m_capacity)
+	{
+		//every region is replaced, the device has to be done with all of them
+		m_mdevice->WaitForIdle();
+		Reserve(std::max(static_cast<uint32_t>(m_transforms.size()), m_capacity * 2));
+		rebuilt = true;
+	}
+
+	if (m_batchesDirty || rebuilt)
+		RebuildBatches();
+
+	//a changed transform is written once into every frame region as the frames come around
+	VkDeviceSize regionOffset = frameIndex * m_frameSize;
+	if (!m_dirty.empty())
+	{
+		glm::mat4 * region = m_instances.Data<glm::mat4>(regionOffset);
+		size_t kept = 0;
+		for (uint32_t index : m_dirty)
+		{
+			region[m_instanceSlots[index]] = m_transforms[index];
+			if (--m_dirtyFrames[index] > 0)
+				m_dirty[kept++] = index;
+		}
+		m_dirty.resize(kept);
+		m_instances.Flush(regionOffset, m_frameSize);
+	}
+
+	for (VkIndexedDraw& draw : m_draws)
+		draw.dynamicOffsets[0] = static_cast<uint32_t>(regionOffset);
+	if (m_centersDirty)
+		UpdateCenters();
+	return rebuilt;
+}
+
+const std::vector<Vulkan::VkIndexedDraw>& Vulkan::RenderProxyPool::Draws()
+{
+	return m_draws;
+}
+
+const std::vector<const Vulkan::Material*>& Vulkan::RenderProxyPool::DrawMaterials()
+{
+	return m_drawMaterials;
+}
+
+const std::vector<glm::vec3>& Vulkan::RenderProxyPool::DrawCenters()
+{
+	return m_drawCenters;
+}
+
+const std::vector<uint32_t>& Vulkan::RenderProxyPool::DrawMeshIds()
+{
+	return m_drawMeshIds;
+}
+
+const std::vector<glm::mat4>& Vulkan::RenderProxyPool::Transforms()
+{
+	return m_transforms;
+}
+
+const std::vector<uint32_t>& Vulkan::RenderProxyPool::MeshIds()
+{
+	return m_meshIds;
+}
+
+const Vulkan::CullingSpheres & Vulkan::RenderProxyPool::Bounds()
+{
+	return m_bounds;
+}
+
+const std::vector<uint32_t>& Vulkan::RenderProxyPool::InstanceSlots()
+{
+	return m_instanceSlots;
+}
+
+const std::vector<uint32_t>& Vulkan::RenderProxyPool::ProxyBatches()
+{
+	return m_proxyBatches;
+}
+
+const std::vector<Vulkan::RenderProxyHandle>& Vulkan::RenderProxyPool::Handles()
+{
+	return m_handles;
+}
+
+VkDeviceSize Vulkan::RenderProxyPool::FrameSize()
+{
+	return m_frameSize;
+}
+
+uint32_t Vulkan::RenderProxyPool::Count()
+{
+	return static_cast<uint32_t>(m_transforms.size());
+}
+
+Vulkan::RenderProxyPool::operator VkBuffer()
+{
+	return m_instances;
+}
+
+void Vulkan::RenderProxyPool::Reserve(uint32_t capacity)
+{
+	//regions are bound with a dynamic offset, so each one starts on the storage alignment
+	VkDeviceSize alignment = std::max<VkDeviceSize>(m_mdevice->GetPhysicalDeviceLimits().minStorageBufferOffsetAlignment, 1);
+	m_frameSize = (capacity * sizeof(glm::mat4) + alignment - 1) / alignment * alignment;
+	m_capacity = capacity;
+	try
+	{
+		m_instances.Build(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_frameSize * m_frameCount);
+	}
+	catch (...)
+	{
+		throw;
+	}
+}
+
+void Vulkan::RenderProxyPool::RebuildBatches()
+{
+	m_draws.clear();
+	m_drawMaterials.clear();
+	m_drawMeshIds.clear();
+	uint32_t count = static_cast<uint32_t>(m_transforms.size());
+	std::map<std::pair<uint32_t, const Material*>, uint32_t> batchLookup;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		std::pair<uint32_t, const Material*> key = std::make_pair(m_meshIds[i], m_materials[i]);
+		auto batch = batchLookup.find(key);
+		if (batch == batchLookup.end())
+		{
+			IMeshData * meshD = Mesh::GetMeshData(key.first);
+			VkIndexedDraw draw;
+			draw.indexCount = meshD->indiceCount;
+			draw.indexStart = meshD->indiceRange.start;
+			draw.vertexOffset = meshD->vertexRange.start;
+			draw.instanceCount = 0;
+			batch = batchLookup.insert(std::make_pair(key, static_cast<uint32_t>(m_draws.size()))).first;
+			m_draws.push_back(draw);
+			m_drawMaterials.push_back(key.second);
+			m_drawMeshIds.push_back(key.first);
+		}
+		m_proxyBatches[i] = batch->second;
+		m_draws[batch->second].instanceCount++;
+	}
+
+	uint32_t firstInstance = 0;
+	for (VkIndexedDraw& draw : m_draws)
+	{
+		draw.firstInstance = firstInstance;
+		firstInstance += draw.instanceCount;
+		draw.instanceCount = 0;
+	}
+
+	//instances move with their batch, so every proxy is written again
+	m_dirty.clear();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		VkIndexedDraw& draw = m_draws[m_proxyBatches[i]];
+		m_instanceSlots[i] = draw.firstInstance + draw.instanceCount++;
+		m_dirtyFrames[i] = m_frameCount;
+		m_dirty.push_back(i);
+	}
+	m_batchesDirty = false;
+	m_centersDirty = true;
+}
+
+void Vulkan::RenderProxyPool::MarkDirty(uint32_t index)
+{
+	if (m_dirtyFrames[index] == 0)
+		m_dirty.push_back(index);
+	m_dirtyFrames[index] = m_frameCount;
+}
+
+void Vulkan::RenderProxyPool::UpdateCenters()
+{
+	//only runs after a transform or batch change, a static scene keeps the last result
+	m_drawCenters.assign(m_draws.size(), glm::vec3(0.0f));
+	uint32_t count = static_cast<uint32_t>(m_transforms.size());
+	for (uint32_t i = 0; i < count; ++i)
+		m_drawCenters[m_proxyBatches[i]] += glm::vec3(m_transforms[i][3]);
+	for (uint32_t b = 0; b < m_draws.size(); ++b)
+		m_drawCenters[b] /= static_cast<float>(m_draws[b].instanceCount);
+	m_centersDirty = false;
+}
+
+void Vulkan::RenderProxyPool::UpdateBounds(uint32_t index)
+{
+	IMeshData * meshD = Mesh::GetMeshData(m_meshIds[index]);
+	m_bounds.Set(index, m_transforms[index], meshD->boundsCenter, meshD->boundsRadius);
+}
@@ -0,0 +1,96 @@
+/*=========================================================
+RenderProxyPool.h - Retained scene objects for the
+KojinRenderer. Every proxy keeps its mesh, material and
+transform in dense arrays addressed through a stable handle.
+Batches are only rebuilt when proxies are added, removed or
+change material, and transforms are only copied to the
+instance buffer when they changed.
+==========================================================*/
+
+#pragma once
+#include <vector>
+#include <glm\matrix.hpp>
+#include "VkManagedStructures.h"
+#include "VkManagedBuffer.h"
+#include "FrustumCulling.h"
+
+namespace Vulkan
+{
+	class VkManagedDevice;
+	class Mesh;
+	class Material;
+	typedef uint32_t RenderProxyHandle;
+
+	class RenderProxyPool
+	{
+	public:
+		static const RenderProxyHandle k_invalidHandle = UINT32_MAX;
+		RenderProxyPool(VkManagedDevice * device, uint32_t frameCount);
+		RenderProxyPool(const RenderProxyPool&) = delete;
+		RenderProxyPool& operator=(const RenderProxyPool&) = delete;
+		RenderProxyHandle Create(Mesh * mesh, Material * material, const glm::mat4& transform);
+		void Destroy(RenderProxyHandle handle);
+		void SetTransform(RenderProxyHandle handle, const glm::mat4& transform);
+		void SetMaterial(RenderProxyHandle handle, Material * material);
+		///Rebuild batches if needed and write changed transforms to the frame's instance region, returns true when the instance buffer was recreated
+		bool Update(uint32_t frameIndex);
+		///One instanced draw per mesh and material pair, the instance offset points at the region of the last updated frame
+		const std::vector<VkIndexedDraw>& Draws();
+		const std::vector<const Material*>& DrawMaterials();
+		///Average instance position of every draw, used to order draws by view depth
+		const std::vector<glm::vec3>& DrawCenters();
+		const std::vector<uint32_t>& DrawMeshIds();
+		///Transform and mesh of every proxy, in dense order
+		const std::vector<glm::mat4>& Transforms();
+		const std::vector<uint32_t>& MeshIds();
+		///World space bounding sphere of every proxy, in dense order
+		const CullingSpheres& Bounds();
+		///Slot of every proxy within its frame region, in dense order
+		const std::vector<uint32_t>& InstanceSlots();
+		///Draw every proxy belongs to, in dense order
+		const std::vector<uint32_t>& ProxyBatches();
+		///Handle of every proxy, in dense order
+		const std::vector<RenderProxyHandle>& Handles();
+		///Bytes of one frame region, the range of the instance storage descriptor
+		VkDeviceSize FrameSize();
+		uint32_t Count();
+		operator VkBuffer();
+
+	private:
+		void Reserve(uint32_t capacity);
+		void RebuildBatches();
+		void MarkDirty(uint32_t index);
+		void UpdateCenters();
+		void UpdateBounds(uint32_t index);
+
+	private:
+		VkManagedDevice * m_mdevice = nullptr;
+		VkManagedBuffer m_instances;
+		uint32_t m_frameCount = 0;
+		uint32_t m_capacity = 0;
+		VkDeviceSize m_frameSize = 0;
+		bool m_batchesDirty = false;
+		bool m_centersDirty = false;
+
+		//dense proxy data, a destroyed proxy is replaced by the last one
+		std::vector<glm::mat4> m_transforms;
+		std::vector<uint32_t> m_meshIds;
+		std::vector<const Material*> m_materials;
+		std::vector<uint32_t> m_instanceSlots;
+		std::vector<uint32_t> m_dirtyFrames;
+		std::vector<RenderProxyHandle> m_handles;
+		std::vector<uint32_t> m_proxyBatches;
+		CullingSpheres m_bounds;
+
+		//handle to dense index, released handles are reused
+		std::vector<uint32_t> m_indices;
+		std::vector<RenderProxyHandle> m_freeHandles;
+
+		//dense indices whose transform still has to reach some frame region
+		std::vector<uint32_t> m_dirty;
+		std::vector<VkIndexedDraw> m_draws;
+		std::vector<const Material*> m_drawMaterials;
+		std::vector<glm::vec3> m_drawCenters;
+		std::vector<uint32_t> m_drawMeshIds;
+	};
+}
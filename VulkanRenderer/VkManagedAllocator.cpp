@@ -0,0 +1,273 @@
+#include "VkManagedAllocator.h"
+#include "VkManagedDevice.h"
+#include <algorithm>
+#include <assert.h>
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+Vulkan::VkManagedAllocator::VkManagedAllocator(VkManagedDevice * device, VkDeviceSize blockSize)
+{
+	assert(device != nullptr);
+	assert(blockSize > 0);
+	m_mdevice = device;
+	m_device = *device;
+	m_blockSize = blockSize;
+	m_granularity = device->GetPhysicalDeviceLimits().bufferImageGranularity;
+	m_nonCoherentAtomSize = device->GetPhysicalDeviceLimits().nonCoherentAtomSize;
+	vkGetPhysicalDeviceMemoryProperties(device->PhysicalDevice(), &m_memoryProperties);
+}
+
+Vulkan::VkManagedAllocator::~VkManagedAllocator()
+{
+	for (uint32_t i = 0; i < m_blocks.size(); ++i)
+		DestroyBlock(i);
+}
+
+Vulkan::VkManagedAllocation Vulkan::VkManagedAllocator::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, VkManagedResourceTiling tiling)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	VkManagedAllocation allocation = {};
+	allocation.memoryType = m_mdevice->GetMemoryType(requirements.memoryTypeBits, properties);
+	allocation.size = requirements.size;
+
+	//linear and optimal resources only need to be kept apart when the device has a granularity above one byte
+	if (m_granularity <= 1)
+		tiling = VK_VKM_RESOURCE_LINEAR;
+
+	//large requests get a block of their own instead of fragmenting the shared ones
+	bool dedicated = requirements.size > m_blockSize / 2;
+	VkDeviceSize offset = 0;
+
+	if (!dedicated)
+	{
+		for (uint32_t i = 0; i < m_blocks.size(); ++i)
+		{
+			MemoryBlock& block = m_blocks[i];
+			if (block.memory == VK_NULL_HANDLE || block.dedicated || block.memoryType != allocation.memoryType || block.tiling != tiling)
+				continue;
+
+			if (SubAllocate(block, requirements.size, requirements.alignment, offset))
+			{
+				block.allocationCount++;
+				m_usedBytes += requirements.size;
+				allocation.memory = block.memory;
+				allocation.offset = offset;
+				allocation.block = i;
+				allocation.mapped = block.mapped != nullptr ? static_cast<char*>(block.mapped) + offset : nullptr;
+				allocation.coherent = (m_memoryProperties.memoryTypes[block.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+				return allocation;
+			}
+		}
+	}
+
+	uint32_t blockIndex = UINT32_MAX;
+	VkResult result = CreateBlock(allocation.memoryType, dedicated ? requirements.size : m_blockSize, tiling, dedicated, blockIndex);
+	//a whole block may no longer fit in the heap while the request alone still does
+	if (!dedicated && (result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY))
+		result = CreateBlock(allocation.memoryType, requirements.size, tiling, true, blockIndex);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Unable to allocate device memory block. Reason: " + Vulkan::VkResultToString(result));
+	MemoryBlock& block = m_blocks[blockIndex];
+	bool allocated = SubAllocate(block, requirements.size, requirements.alignment, offset);
+	assert(allocated);
+	block.allocationCount++;
+	m_usedBytes += requirements.size;
+	allocation.memory = block.memory;
+	allocation.offset = offset;
+	allocation.block = blockIndex;
+	allocation.mapped = block.mapped != nullptr ? static_cast<char*>(block.mapped) + offset : nullptr;
+	allocation.coherent = (m_memoryProperties.memoryTypes[block.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+	return allocation;
+}
+
+void Vulkan::VkManagedAllocator::Free(VkManagedAllocation & allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	assert(allocation.block < m_blocks.size());
+	MemoryBlock& block = m_blocks[allocation.block];
+	assert(block.memory == allocation.memory);
+
+	FreeRange range = { allocation.offset, allocation.size };
+	auto it = std::lower_bound(block.freeRanges.begin(), block.freeRanges.end(), range,
+		[](const FreeRange& a, const FreeRange& b) { return a.offset < b.offset; });
+	it = block.freeRanges.insert(it, range);
+
+	//merge with the following range
+	auto next = it + 1;
+	if (next != block.freeRanges.end() && it->offset + it->size == next->offset)
+	{
+		it->size += next->size;
+		it = block.freeRanges.erase(next) - 1;
+	}
+	//merge with the preceding range
+	if (it != block.freeRanges.begin())
+	{
+		auto prev = it - 1;
+		if (prev->offset + prev->size == it->offset)
+		{
+			prev->size += it->size;
+			block.freeRanges.erase(it);
+		}
+	}
+
+	m_usedBytes -= allocation.size;
+	block.allocationCount--;
+	if (block.allocationCount == 0 && block.dedicated)
+		DestroyBlock(allocation.block);
+
+	allocation = {};
+}
+
+void Vulkan::VkManagedAllocator::Flush(const VkManagedAllocation & allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+	if (allocation.coherent || allocation.mapped == nullptr)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	VkMappedMemoryRange range = AtomAlignedRange(allocation, offset, size);
+	VkResult result = vkFlushMappedMemoryRanges(m_device, 1, &range);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Unable to flush mapped memory range. Reason: " + Vulkan::VkResultToString(result));
+}
+
+void Vulkan::VkManagedAllocator::Invalidate(const VkManagedAllocation & allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+	if (allocation.coherent || allocation.mapped == nullptr)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	VkMappedMemoryRange range = AtomAlignedRange(allocation, offset, size);
+	VkResult result = vkInvalidateMappedMemoryRanges(m_device, 1, &range);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Unable to invalidate mapped memory range. Reason: " + Vulkan::VkResultToString(result));
+}
+
+uint32_t Vulkan::VkManagedAllocator::BlockCount()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return static_cast<uint32_t>(m_blocks.size() - m_freeBlockSlots.size());
+}
+
+VkDeviceSize Vulkan::VkManagedAllocator::UsedBytes()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_usedBytes;
+}
+
+bool Vulkan::VkManagedAllocator::SubAllocate(MemoryBlock & block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize & offset)
+{
+	size_t rangeCount = block.freeRanges.size();
+	for (size_t i = 0; i < rangeCount; ++i)
+	{
+		FreeRange& range = block.freeRanges[i];
+		VkDeviceSize alignedOffset = AlignUp(range.offset, alignment);
+		VkDeviceSize padding = alignedOffset - range.offset;
+		if (range.size < padding + size)
+			continue;
+
+		VkDeviceSize tailOffset = alignedOffset + size;
+		VkDeviceSize tailSize = range.size - padding - size;
+
+		//alignment padding stays in the free list so it can merge back once the neighbours are released
+		if (padding > 0)
+		{
+			range.size = padding;
+			if (tailSize > 0)
+				block.freeRanges.insert(block.freeRanges.begin() + i + 1, { tailOffset, tailSize });
+		}
+		else if (tailSize > 0)
+		{
+			range.offset = tailOffset;
+			range.size = tailSize;
+		}
+		else
+		{
+			block.freeRanges.erase(block.freeRanges.begin() + i);
+		}
+
+		offset = alignedOffset;
+		return true;
+	}
+	return false;
+}
+
+VkResult Vulkan::VkManagedAllocator::CreateBlock(uint32_t memoryType, VkDeviceSize size, VkManagedResourceTiling tiling, bool dedicated, uint32_t& blockIndex)
+{
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	MemoryBlock block;
+	VkResult result = vkAllocateMemory(m_device, &allocInfo, nullptr, &block.memory);
+	if (result != VK_SUCCESS)
+		return result;
+
+	block.size = size;
+	block.memoryType = memoryType;
+	block.tiling = tiling;
+	block.dedicated = dedicated;
+	block.freeRanges.push_back({ 0, size });
+
+	if (m_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		result = vkMapMemory(m_device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped);
+		if (result != VK_SUCCESS)
+		{
+			vkFreeMemory(m_device, block.memory, nullptr);
+			throw std::runtime_error("Unable to map device memory block. Reason: " + Vulkan::VkResultToString(result));
+		}
+	}
+
+	if (!m_freeBlockSlots.empty())
+	{
+		blockIndex = m_freeBlockSlots.back();
+		m_freeBlockSlots.pop_back();
+		m_blocks[blockIndex] = block;
+		return VK_SUCCESS;
+	}
+
+	m_blocks.push_back(block);
+	blockIndex = static_cast<uint32_t>(m_blocks.size() - 1);
+	return VK_SUCCESS;
+}
+
+void Vulkan::VkManagedAllocator::DestroyBlock(uint32_t blockIndex)
+{
+	MemoryBlock& block = m_blocks[blockIndex];
+	if (block.memory == VK_NULL_HANDLE)
+		return;
+
+	if (block.mapped != nullptr)
+		vkUnmapMemory(m_device, block.memory);
+	vkFreeMemory(m_device, block.memory, nullptr);
+	block = {};
+	m_freeBlockSlots.push_back(blockIndex);
+}
+
+VkMappedMemoryRange Vulkan::VkManagedAllocator::AtomAlignedRange(const VkManagedAllocation & allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+	const MemoryBlock& block = m_blocks[allocation.block];
+	if (size == VK_WHOLE_SIZE)
+		size = allocation.size - offset;
+
+	//flushed ranges have to start and end on nonCoherentAtomSize boundaries, the block end is always a valid end
+	VkDeviceSize begin = (allocation.offset + offset) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+	VkDeviceSize end = AlignUp(allocation.offset + offset + size, m_nonCoherentAtomSize);
+	if (end > block.size)
+		end = block.size;
+
+	VkMappedMemoryRange range = {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = allocation.memory;
+	range.offset = begin;
+	range.size = end - begin;
+	return range;
+}
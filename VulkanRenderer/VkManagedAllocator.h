@@ -0,0 +1,95 @@
+/*=========================================================
+VkManagedAllocator.h - Block allocator for device memory.
+Memory is requested from the driver in large blocks per
+memory type and handed out to buffers and images as aligned
+suballocations, keeping vkAllocateMemory calls far below
+maxMemoryAllocationCount. Host visible blocks are mapped once
+when created and stay mapped until released.
+==========================================================*/
+
+#pragma once
+#include "VulkanObject.h"
+#include <vector>
+#include <mutex>
+
+namespace Vulkan
+{
+	enum VkManagedResourceTiling
+	{
+		VK_VKM_RESOURCE_LINEAR,
+		VK_VKM_RESOURCE_OPTIMAL
+	};
+
+	struct VkManagedAllocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		uint32_t memoryType = UINT32_MAX;
+		uint32_t block = UINT32_MAX;
+		//host address of the suballocation, only set for HOST_VISIBLE memory
+		void * mapped = nullptr;
+		bool coherent = false;
+	};
+
+	class VkManagedDevice;
+	class VkManagedAllocator
+	{
+	public:
+		VkManagedAllocator(VkManagedDevice * device, VkDeviceSize blockSize);
+		~VkManagedAllocator();
+		VkManagedAllocator(const VkManagedAllocator&) = delete;
+		VkManagedAllocator& operator=(const VkManagedAllocator&) = delete;
+		///Suballocate memory satisfying the requirements, a new block is created when no existing block has room.
+		///When a new block does not fit, the request gets a dedicated allocation of its own size
+		VkManagedAllocation Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, VkManagedResourceTiling tiling);
+		///Return a suballocation to its block, the allocation is reset afterwards
+		void Free(VkManagedAllocation& allocation);
+		///Make host writes visible to the device, no-op for coherent memory. Range is relative to the allocation.
+		void Flush(const VkManagedAllocation& allocation, VkDeviceSize offset, VkDeviceSize size);
+		///Make device writes visible to the host, no-op for coherent memory. Range is relative to the allocation.
+		void Invalidate(const VkManagedAllocation& allocation, VkDeviceSize offset, VkDeviceSize size);
+		///Number of device memory objects currently owned by the allocator
+		uint32_t BlockCount();
+		VkDeviceSize UsedBytes();
+
+	private:
+		struct FreeRange
+		{
+			VkDeviceSize offset;
+			VkDeviceSize size;
+		};
+
+		struct MemoryBlock
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0;
+			uint32_t memoryType = UINT32_MAX;
+			VkManagedResourceTiling tiling = VK_VKM_RESOURCE_LINEAR;
+			bool dedicated = false;
+			uint32_t allocationCount = 0;
+			//host visible blocks stay mapped for their whole lifetime
+			void * mapped = nullptr;
+			//sorted by offset, adjacent ranges are always merged
+			std::vector<FreeRange> freeRanges;
+		};
+
+		bool SubAllocate(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+		//only the allocation failing is returned, so the caller can retry with less
+		VkResult CreateBlock(uint32_t memoryType, VkDeviceSize size, VkManagedResourceTiling tiling, bool dedicated, uint32_t& blockIndex);
+		void DestroyBlock(uint32_t blockIndex);
+		VkMappedMemoryRange AtomAlignedRange(const VkManagedAllocation& allocation, VkDeviceSize offset, VkDeviceSize size);
+
+	private:
+		VkManagedDevice * m_mdevice = nullptr;
+		VkDevice m_device = VK_NULL_HANDLE;
+		VkDeviceSize m_blockSize = 0;
+		VkDeviceSize m_granularity = 1;
+		VkDeviceSize m_nonCoherentAtomSize = 1;
+		VkPhysicalDeviceMemoryProperties m_memoryProperties = {};
+		VkDeviceSize m_usedBytes = 0;
+		std::vector<MemoryBlock> m_blocks;
+		std::vector<uint32_t> m_freeBlockSlots;
+		std::mutex m_lock;
+	};
+}
@@ -17,6 +17,11 @@ Vulkan::VkManagedBuffer::VkManagedBuffer(VkDevice device, VkDeviceSize bufferSiz
 	memory = VulkanObjectContainer<VkDeviceMemory>{ this->device, vkFreeMemory };
 }
 
+Vulkan::VkManagedBuffer::~VkManagedBuffer()
+{
+	Clear();
+}
+
 Vulkan::VkManagedBuffer::operator VkBuffer()
 {
 	return m_buffer;
@@ -30,6 +35,7 @@ VkDeviceSize Vulkan::VkManagedBuffer::Size()
 void Vulkan::VkManagedBuffer::Build(VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties, VkDeviceSize bufferSize, VkSharingMode sharingMode)
 {
 	VkResult result;
+	Clear();
 
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -44,27 +50,15 @@ void Vulkan::VkManagedBuffer::Build(VkBufferUsageFlags usage, VkMemoryPropertyFl
 	VkMemoryRequirements memRequirements;
 	vkGetBufferMemoryRequirements(m_device, m_buffer, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = m_mDevice->GetMemoryType(memRequirements.memoryTypeBits, memoryProperties);
+	//buffer requirements already include the offset alignment of every usage the buffer was created with
+	m_allocation = m_mDevice->Allocator()->Allocate(memRequirements, memoryProperties, VK_VKM_RESOURCE_LINEAR);
 
-	result = vkAllocateMemory(m_device, &allocInfo, nullptr, ++m_memory);
-	if (result != VK_SUCCESS)
-		throw std::runtime_error("Unable to allocate buffer memory from local device. Reason: " + Vulkan::VkResultToString(result));
-	
-	///TODO: Compute offset multiplier based on usage flags
-	/*
-	VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT = 0x00000004,
-	VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT = 0x00000008,
-	VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT = 0x00000010,
-	VK_BUFFER_USAGE_STORAGE_BUFFER_BIT = 0x00000020,
-	*/
-
-	result = vkBindBufferMemory(m_device, m_buffer, m_memory, 0);
+	result = vkBindBufferMemory(m_device, m_buffer, m_allocation.memory, m_allocation.offset);
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Unable to bind buffer memory from local device. Reason: " + Vulkan::VkResultToString(result));
 	this->bufferSize = bufferSize;
+	mappedMemory = m_allocation.mapped;
+	m_state.Reset(1, 1, VK_IMAGE_LAYOUT_UNDEFINED);
 
 }
 
@@ -103,9 +97,9 @@ void Vulkan::VkManagedBuffer::CopyTo(VkCommandBuffer buffer, VkManagedBuffer * d
 {
 	assert(dst != nullptr);
 	assert(dst->m_buffer != VK_NULL_HANDLE);
-	assert(dst->m_memory != VK_NULL_HANDLE);
+	assert(dst->m_allocation.memory != VK_NULL_HANDLE);
 	assert(m_buffer != VK_NULL_HANDLE);
-	assert(m_memory != VK_NULL_HANDLE);
+	assert(m_allocation.memory != VK_NULL_HANDLE);
 	assert(copySize <= dst->bufferSize);
 
 	VkBufferCopy copyRegion = {};
@@ -119,8 +113,45 @@ void Vulkan::VkManagedBuffer::CopyTo(VkCommandBuffer buffer, VkManagedBuffer * d
 void Vulkan::VkManagedBuffer::Write(VkDeviceSize offset, VkMemoryMapFlags flags,size_t srcSize, void * src)
 {
 	assert(srcSize <= bufferSize-offset);
-	vkMapMemory(m_device, m_memory, offset, srcSize, flags, &mappedMemory);
-	memcpy(mappedMemory, src, srcSize);
-	vkUnmapMemory(m_device, m_memory);
+	assert(mappedMemory != nullptr);
+	memcpy(static_cast<char*>(mappedMemory) + offset, src, srcSize);
+	Flush(offset, srcSize);
+}
+
+void Vulkan::VkManagedBuffer::Use(VkManagedBarrierBatch & batch, VkPipelineStageFlags stages, VkAccessFlags access)
+{
+	m_state.Use(batch, m_buffer, stages, access);
+}
+
+void Vulkan::VkManagedBuffer::Assume(VkPipelineStageFlags stages, VkAccessFlags access)
+{
+	m_state.Assume({ 0, 0, 1, 0, 1 }, stages, access, VK_IMAGE_LAYOUT_UNDEFINED);
+}
+
+bool Vulkan::VkManagedBuffer::IsMapped()
+{
+	return mappedMemory != nullptr;
+}
+
+void Vulkan::VkManagedBuffer::Flush(VkDeviceSize offset, VkDeviceSize size)
+{
+	if (m_allocation.coherent || mappedMemory == nullptr)
+		return;
+	m_mDevice->Allocator()->Flush(m_allocation, offset, size);
+}
+
+void Vulkan::VkManagedBuffer::Invalidate(VkDeviceSize offset, VkDeviceSize size)
+{
+	if (m_allocation.coherent || mappedMemory == nullptr)
+		return;
+	m_mDevice->Allocator()->Invalidate(m_allocation, offset, size);
+}
+
+void Vulkan::VkManagedBuffer::Clear()
+{
+	++m_buffer;
+	if (m_mDevice != nullptr)
+		m_mDevice->Allocator()->Free(m_allocation);
 	mappedMemory = nullptr;
+	bufferSize = 0;
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #pragma once
 #include "VulkanObject.h"
+#include "VkManagedAllocator.h"
+#include "VkManagedResourceState.h"
 #include <memory>
+#include <assert.h>
 namespace Vulkan
 {
 	class VkManagedDevice;
@@ -11,12 +14,29 @@ namespace Vulkan
 		VkManagedBuffer() {};
 		VkManagedBuffer(VkManagedDevice * device);
 		VkManagedBuffer(VkDevice device, VkDeviceSize bufferSize);
+		~VkManagedBuffer();
+		VkManagedBuffer(const VkManagedBuffer&) = delete;
+		VkManagedBuffer& operator=(const VkManagedBuffer&) = delete;
 		operator VkBuffer();
 		VkDeviceSize Size();
 		void Build(VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties, VkDeviceSize bufferSize, VkSharingMode sharingMode = VK_SHARING_MODE_EXCLUSIVE);
 		void Build(VkPhysicalDevice physDevice,VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
 		void CopyTo(VkCommandBuffer buffer, VkManagedBuffer * dst, VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize copySize);
 		void Write(VkDeviceSize offset, VkMemoryMapFlags flags, size_t srcSize, void * src);
+		///Host address of the buffer contents, HOST_VISIBLE buffers are mapped once at Build and stay mapped until released
+		template <typename T>
+		T * Data(VkDeviceSize offset = 0);
+		bool IsMapped();
+		///Make host writes visible to the device, only issues a flush for non-coherent memory
+		void Flush(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+		///Make device writes visible to the host, only issues an invalidate for non-coherent memory
+		void Invalidate(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+		///Queue what the buffer needs before stages use it with access, recorded when batch is flushed
+		void Use(VkManagedBarrierBatch& batch, VkPipelineStageFlags stages, VkAccessFlags access);
+		///The buffer was last used by stages with access, ordered by other means like a render graph
+		void Assume(VkPipelineStageFlags stages, VkAccessFlags access);
+		///Release the buffer and return its memory to the device allocator
+		void Clear();
 	public:
 		VulkanObjectContainer<VkBuffer> buffer = VK_NULL_HANDLE;
 		VulkanObjectContainer<VkDeviceMemory> memory = VK_NULL_HANDLE;
@@ -28,9 +48,17 @@ namespace Vulkan
 		VkManagedDevice * m_mDevice = nullptr;
 		VulkanObjectContainer<VkDevice> m_device{ vkDestroyDevice,false };
 		VulkanObjectContainer<VkBuffer> m_buffer{ m_device,vkDestroyBuffer };
-		VulkanObjectContainer<VkDeviceMemory> m_memory{ m_device, vkFreeMemory };
+		VkManagedAllocation m_allocation;
+		VkManagedResourceState m_state;
 
 
 
 	};
+
+	template<typename T>
+	inline T * VkManagedBuffer::Data(VkDeviceSize offset)
+	{
+		assert(mappedMemory != nullptr);
+		return reinterpret_cast<T*>(static_cast<char*>(mappedMemory) + offset);
+	}
 }
@@ -11,13 +11,15 @@ Vulkan::VkManagedCommandBuffer::VkManagedCommandBuffer(VkDevice device, VkComman
 	m_device = device;
 }
 
-VkCommandBuffer Vulkan::VkManagedCommandBuffer::Begin(VkCommandBufferUsageFlags usage, size_t index)
+VkCommandBuffer Vulkan::VkManagedCommandBuffer::Begin(VkCommandBufferUsageFlags usage, size_t index, const VkCommandBufferInheritanceInfo * inheritance)
 {
 	assert(bufferLevel != VK_COMMAND_BUFFER_LEVEL_MAX_ENUM);
+	assert(bufferLevel == VK_COMMAND_BUFFER_LEVEL_SECONDARY || inheritance == nullptr);
 
 	VkCommandBufferBeginInfo cmdBufferBI = {};
 	cmdBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	cmdBufferBI.flags = usage;
+	cmdBufferBI.pInheritanceInfo = inheritance;
 	VkResult result = vkBeginCommandBuffer(m_buffers[index], &cmdBufferBI);
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to begin managed command buffer, reason: " + VkResultToString(result));
@@ -69,7 +71,7 @@ void Vulkan::VkManagedCommandBuffer::Free()
 	}
 }
 
-VkResult Vulkan::VkManagedCommandBuffer::Submit(VkQueue queue, std::vector<VkPipelineStageFlags> waitStages, std::vector<VkSemaphore> signal, std::vector<VkSemaphore> wait)
+VkResult Vulkan::VkManagedCommandBuffer::Submit(VkQueue queue, std::vector<VkPipelineStageFlags> waitStages, std::vector<VkSemaphore> signal, std::vector<VkSemaphore> wait, VkFence fence)
 {
 	assert(bufferLevel != VK_COMMAND_BUFFER_LEVEL_MAX_ENUM);
 	if (!waitStages.empty())
@@ -86,10 +88,10 @@ VkResult Vulkan::VkManagedCommandBuffer::Submit(VkQueue queue, std::vector<VkPip
 	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signal.size());
 	submitInfo.pSignalSemaphores = signal.data();
 
-	return vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+	return vkQueueSubmit(queue, 1, &submitInfo, fence);
 }
 
-VkResult Vulkan::VkManagedCommandBuffer::Submit(VkQueue queue, std::vector<VkPipelineStageFlags> waitStages, std::vector<VkSemaphore> signal, std::vector<VkSemaphore> wait, size_t index)
+VkResult Vulkan::VkManagedCommandBuffer::Submit(VkQueue queue, std::vector<VkPipelineStageFlags> waitStages, std::vector<VkSemaphore> signal, std::vector<VkSemaphore> wait, size_t index, VkFence fence)
 {
 	assert(bufferLevel != VK_COMMAND_BUFFER_LEVEL_MAX_ENUM);
 	if (!waitStages.empty())
@@ -107,7 +109,7 @@ VkResult Vulkan::VkManagedCommandBuffer::Submit(VkQueue queue, std::vector<VkPip
 	submitInfo.pSignalSemaphores = signal.data();
 
 
-	return 	vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+	return 	vkQueueSubmit(queue, 1, &submitInfo, fence);
 }
 
 size_t Vulkan::VkManagedCommandBuffer::Size()
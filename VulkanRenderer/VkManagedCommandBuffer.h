@@ -9,8 +9,8 @@ namespace Vulkan
 	{
 	public:
 
-		///beging a specific command buffer with the provided flag
-		VkCommandBuffer Begin(VkCommandBufferUsageFlags usage, size_t index);
+		///beging a specific command buffer with the provided flag, secondary buffers continuing a render pass need the inheritance info
+		VkCommandBuffer Begin(VkCommandBufferUsageFlags usage, size_t index, const VkCommandBufferInheritanceInfo * inheritance = nullptr);
 		///begin all command buffers with the provided flags
 		std::vector<VkCommandBuffer> Begin(VkCommandBufferUsageFlags usage);
 		///End a specific command buffer
@@ -19,10 +19,10 @@ namespace Vulkan
 		void End();
 		///Called on the object in order to release its command buffers, command buffers always get released when their pool is released
 		void Free();
-		///Submit all contained command buffers
-		VkResult Submit(VkQueue queue, std::vector<VkPipelineStageFlags> waitStages, std::vector<VkSemaphore> signal, std::vector<VkSemaphore> wait);
-		///Submit specific command buffer
-		VkResult Submit(VkQueue queue, std::vector<VkPipelineStageFlags> waitStages, std::vector<VkSemaphore> signal, std::vector<VkSemaphore> wait, size_t index);
+		///Submit all contained command buffers, the fence is signaled once they completed
+		VkResult Submit(VkQueue queue, std::vector<VkPipelineStageFlags> waitStages, std::vector<VkSemaphore> signal, std::vector<VkSemaphore> wait, VkFence fence = VK_NULL_HANDLE);
+		///Submit specific command buffer, the fence is signaled once it completed
+		VkResult Submit(VkQueue queue, std::vector<VkPipelineStageFlags> waitStages, std::vector<VkSemaphore> signal, std::vector<VkSemaphore> wait, size_t index, VkFence fence = VK_NULL_HANDLE);
 		///Get current number of command buffers in the container
 		size_t Size();
 		///By default returns first command buffer, index can be specified
@@ -36,7 +36,8 @@ void Vulkan::VkManagedDescriptorSet::LoadCombinedSamplerImageArray(uint32_t dstS
 			descriptorVertexWrite.dstArrayElement = 0;
 			descriptorVertexWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 			descriptorVertexWrite.descriptorCount = imageCount;
-			descriptorVertexWrite.pImageInfo = combinedSamplerImages.data();
+			m_imageInfos.push_back(combinedSamplerImages);
+			descriptorVertexWrite.pImageInfo = m_imageInfos.back().data();
 		}
 		m_writes[dstSetIndex].push_back(descriptorVertexWrite);
 		m_descriptorCounts[VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER]++;
@@ -67,10 +68,37 @@ void Vulkan::VkManagedDescriptorSet::LoadCombinedSamplerImage(uint32_t dstSetInd
 		descriptorVertexWrite.dstArrayElement = 0;
 		descriptorVertexWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		descriptorVertexWrite.descriptorCount = 1;
-		descriptorVertexWrite.pImageInfo = &diffuseTextureInfo;
+		m_imageInfos.push_back({ diffuseTextureInfo });
+		descriptorVertexWrite.pImageInfo = m_imageInfos.back().data();
 	}
 	m_writes[dstSetIndex].push_back(descriptorVertexWrite);
-	m_descriptorCounts[VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER];
+	m_descriptorCounts[VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER]++;
+}
+
+void Vulkan::VkManagedDescriptorSet::LoadInputAttachment(uint32_t dstSetIndex, VkManagedImage * image, uint32_t dstBind)
+{
+	if (m_descriptorCounts[VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT] == m_totalDescriptorCounts[VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT])
+	{
+		throw std::runtime_error("Maximum number for descriptors of type VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT has been reached. Unable to load more descriptors");
+	}
+	VkDescriptorImageInfo attachmentInfo = {};
+	attachmentInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	attachmentInfo.imageView = *image;
+	attachmentInfo.sampler = VK_NULL_HANDLE;
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	{
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = m_internalSets[dstSetIndex];
+		descriptorWrite.dstBinding = dstBind;
+		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		descriptorWrite.descriptorCount = 1;
+		m_imageInfos.push_back({ attachmentInfo });
+		descriptorWrite.pImageInfo = m_imageInfos.back().data();
+	}
+	m_writes[dstSetIndex].push_back(descriptorWrite);
+	m_descriptorCounts[VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT]++;
 }
 
 void Vulkan::VkManagedDescriptorSet::LoadUniformBuffer(uint32_t dstSetIndex, VkManagedBuffer * buffer, uint32_t dstBind)
@@ -92,18 +120,61 @@ void Vulkan::VkManagedDescriptorSet::LoadUniformBuffer(uint32_t dstSetIndex, VkM
 		descriptorVertexWrite.dstArrayElement = 0;
 		descriptorVertexWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		descriptorVertexWrite.descriptorCount = 1;
-		descriptorVertexWrite.pBufferInfo = &bufferInfo;
+		m_bufferInfos.push_back(bufferInfo);
+		descriptorVertexWrite.pBufferInfo = &m_bufferInfos.back();
 	}
 	m_writes[dstSetIndex].push_back(descriptorVertexWrite);
 	m_descriptorCounts[VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER]++;
 }
 
+void Vulkan::VkManagedDescriptorSet::LoadUniformBufferDynamic(uint32_t dstSetIndex, VkBuffer buffer, VkDeviceSize range, uint32_t dstBind)
+{
+	if (m_descriptorCounts[VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC] == m_totalDescriptorCounts[VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC])
+	{
+		throw std::runtime_error("Maximum number for descriptors of type VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC has been reached. Unable to load more descriptors");
+	}
+	LoadBufferDynamic(dstSetIndex, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, buffer, range, dstBind);
+}
+
+void Vulkan::VkManagedDescriptorSet::LoadStorageBufferDynamic(uint32_t dstSetIndex, VkBuffer buffer, VkDeviceSize range, uint32_t dstBind)
+{
+	if (m_descriptorCounts[VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC] == m_totalDescriptorCounts[VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC])
+	{
+		throw std::runtime_error("Maximum number for descriptors of type VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC has been reached. Unable to load more descriptors");
+	}
+	LoadBufferDynamic(dstSetIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, buffer, range, dstBind);
+}
+
+void Vulkan::VkManagedDescriptorSet::LoadBufferDynamic(uint32_t dstSetIndex, VkDescriptorType type, VkBuffer buffer, VkDeviceSize range, uint32_t dstBind)
+{
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = buffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = range;
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	{
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = m_internalSets[dstSetIndex];
+		descriptorWrite.dstBinding = dstBind;
+		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.descriptorType = type;
+		descriptorWrite.descriptorCount = 1;
+		m_bufferInfos.push_back(bufferInfo);
+		descriptorWrite.pBufferInfo = &m_bufferInfos.back();
+	}
+	m_writes[dstSetIndex].push_back(descriptorWrite);
+	m_descriptorCounts[type]++;
+}
+
 void Vulkan::VkManagedDescriptorSet::ClearSetsWrites()
 {
 	for (std::vector<VkWriteDescriptorSet>& writes : m_writes)
 	{
 		writes.clear();
 	}
+	m_imageInfos.clear();
+	m_bufferInfos.clear();
 	for(uint32_t i = 0; i < VkDescriptorType::VK_DESCRIPTOR_TYPE_RANGE_SIZE;++i)
 	{
 		m_descriptorCounts[i] = 0;
@@ -142,6 +213,8 @@ void Vulkan::VkManagedDescriptorSet::WriteSets()
 		}
 		writes.clear();
 	}
+	m_imageInfos.clear();
+	m_bufferInfos.clear();
 }
 
 VkDescriptorSet Vulkan::VkManagedDescriptorSet::Set(uint32_t index)
@@ -160,6 +233,7 @@ Vulkan::VkManagedDescriptorSet::VkManagedDescriptorSet(VkDevice device, VkDescri
 	m_pool = pool;
 	m_internalSets = sets;
 	uint32_t setCount = static_cast<uint32_t>(sets.size());
+	m_writes.resize(setCount);
 	std::memcpy(m_totalDescriptorCounts, maxDescriptorCounts, sizeof(uint32_t) * 11);
 	for(uint32_t i = 0; i < 11; ++i)
 	{
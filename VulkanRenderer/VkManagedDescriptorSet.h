@@ -1,6 +1,7 @@
 #pragma once
 #include "VulkanObject.h"
 #include <vector>
+#include <list>
 
 namespace Vulkan
 {
@@ -12,6 +13,12 @@ namespace Vulkan
 		void LoadCombinedSamplerImageArray(uint32_t dstSetIndex,std::vector<VkManagedImage*> images, uint32_t dstBind,std::vector<VkSampler> samplers);
 		void LoadCombinedSamplerImage(uint32_t dstSetIndex, VkManagedImage * image, uint32_t dstBind, VkSampler sampler);
 		void LoadUniformBuffer(uint32_t dstSetIndex, VkManagedBuffer * buffer, uint32_t dstBind);
+		///Attachment read by a later subpass of the pass writing it, the image is in SHADER_READ_ONLY_OPTIMAL while it is read
+		void LoadInputAttachment(uint32_t dstSetIndex, VkManagedImage * image, uint32_t dstBind);
+		///Bind range bytes from the start of the buffer, the actual offset is provided as a dynamic offset when the set is bound
+		void LoadUniformBufferDynamic(uint32_t dstSetIndex, VkBuffer buffer, VkDeviceSize range, uint32_t dstBind);
+		///Same as LoadUniformBufferDynamic for shader storage buffers
+		void LoadStorageBufferDynamic(uint32_t dstSetIndex, VkBuffer buffer, VkDeviceSize range, uint32_t dstBind);
 		void ClearSetsWrites();
 		void ClearSetWrites(uint32_t setIndex);
 		void WriteSet(uint32_t setIndex);
@@ -19,11 +26,15 @@ namespace Vulkan
 		VkDescriptorSet Set(uint32_t setIndex);
 		size_t Size();
 	private:
+		void LoadBufferDynamic(uint32_t dstSetIndex, VkDescriptorType type, VkBuffer buffer, VkDeviceSize range, uint32_t dstBind);
 		VkManagedDescriptorSet(VkDevice device, VkDescriptorPool pool, std::vector<VkDescriptorSet> sets, uint32_t totalDescriptorCounts[11]);
 		friend class VkManagedDescriptorPool;
 	private:
 		std::vector<VkDescriptorSet> m_internalSets;
 		std::vector<std::vector<VkWriteDescriptorSet>> m_writes;
+		//pending writes point into these, list nodes keep their address until the writes are flushed
+		std::list<std::vector<VkDescriptorImageInfo>> m_imageInfos;
+		std::list<VkDescriptorBufferInfo> m_bufferInfos;
 		VkDevice m_device = VK_NULL_HANDLE;
 		VkDescriptorPool m_pool = VK_NULL_HANDLE;
 		uint32_t m_descriptorCounts[11]{ 0 };
@@ -1,6 +1,7 @@
 #include "VkManagedDevice.h"
 #include "VkManagedInstance.h"
 #include "VkManagedQueue.h"
+#include "VkManagedAllocator.h"
 #include <assert.h>
 
 const std::vector<VkFormat> k_depthFormats{
@@ -11,6 +12,8 @@ const std::vector<VkFormat> k_depthFormats{
 	VK_FORMAT_D16_UNORM
 };
 
+const VkDeviceSize k_allocatorBlockSize = 64 * 1024 * 1024;
+
 Vulkan::VkManagedDevice::VkManagedDevice(VkDeviceCreateInfo createInfo, VkPhysicalDeviceData * physicalDevice)
 {
 
@@ -29,10 +32,14 @@ Vulkan::VkManagedDevice::VkManagedDevice(VkDeviceCreateInfo createInfo, VkPhysic
 	}
 
 	GetAllQueues();
+	m_allocator = new VkManagedAllocator(this, k_allocatorBlockSize);
 }
 
 Vulkan::VkManagedDevice::~VkManagedDevice()
 {
+	if (m_allocator != nullptr)
+		delete m_allocator;
+
 	if(!m_queues.empty())
 	{
 		for (auto& qV : m_queues)
@@ -78,6 +85,11 @@ VkPhysicalDeviceLimits Vulkan::VkManagedDevice::GetPhysicalDeviceLimits()
 	return m_physicalDevice->deviceProperties.limits;
 }
 
+VkPhysicalDeviceFeatures Vulkan::VkManagedDevice::GetPhysicalDeviceFeatures()
+{
+	return m_physicalDevice->deviceFeatures;
+}
+
 VkFormat Vulkan::VkManagedDevice::Depthformat()
 {
 	return m_depthFormat;
@@ -179,6 +191,11 @@ bool Vulkan::VkManagedDevice::CheckFormatFeature(VkFormatFeatureFlags feature, V
 	}
 }
 
+Vulkan::VkManagedAllocator * Vulkan::VkManagedDevice::Allocator()
+{
+	return m_allocator;
+}
+
 VkFormat Vulkan::VkManagedDevice::FindDepthFormat()
 {
 	for (VkFormat format : k_depthFormats) {
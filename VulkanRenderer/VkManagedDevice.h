@@ -7,6 +7,7 @@ namespace Vulkan
 {
 	class VkManagedQueue;
 	class VkManagedInstance;
+	class VkManagedAllocator;
 	class VkManagedDevice
 	{
 
@@ -18,6 +19,8 @@ namespace Vulkan
 		uint32_t GetMemoryType(uint32_t desiredType, VkMemoryPropertyFlags memFlags);
 		VkPhysicalDevice PhysicalDevice();
 		VkPhysicalDeviceLimits GetPhysicalDeviceLimits();
+		///Features of the physical device, every supported feature is enabled on the device
+		VkPhysicalDeviceFeatures GetPhysicalDeviceFeatures();
 		VkFormat Depthformat();
 		void WaitForIdle();
 		VkSurfaceData GetPhysicalDeviceSurfaceData();
@@ -26,6 +29,7 @@ namespace Vulkan
 		void UnmarkQueue(VkManagedQueue * queue);
 		void UnmarkAllQueues();
 		bool CheckFormatFeature(VkFormatFeatureFlags feature, VkFormat format, VkImageTiling tiling);
+		VkManagedAllocator * Allocator();
 
 
 	private:
@@ -39,6 +43,7 @@ namespace Vulkan
 		std::vector<std::vector<VkManagedQueue*>> m_queues;
 		VkFormat m_depthFormat;
 		VkPhysicalDeviceData * m_physicalDevice = nullptr;
+		VkManagedAllocator * m_allocator = nullptr;
 
 	};
 }
\ No newline at end of file
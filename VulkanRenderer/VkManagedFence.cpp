@@ -0,0 +1,42 @@
+#include "VkManagedFence.h"
+#include "VkManagedDevice.h"
+
+Vulkan::VkManagedFence::VkManagedFence(VkManagedDevice * device, uint32_t fenceCount, bool signaled) : count(fenceCount)
+{
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = signaled ? VK_FENCE_CREATE_SIGNALED_BIT : 0;
+	m_device = *device;
+	m_fences.resize(fenceCount, VulkanObjectContainer<VkFence>{m_device, vkDestroyFence});
+
+	for (VulkanObjectContainer<VkFence>& fence : m_fences)
+	{
+		VkResult result = vkCreateFence(m_device, &fenceInfo, nullptr, ++fence);
+		if (result != VK_SUCCESS)
+			throw std::runtime_error("Unable to create fence. Reason: " + Vulkan::VkResultToString(result));
+	}
+}
+
+void Vulkan::VkManagedFence::Wait(uint32_t index, uint64_t timeout)
+{
+	VkResult result = vkWaitForFences(m_device, 1, --m_fences[index], VK_TRUE, timeout);
+	if (result != VK_SUCCESS && result != VK_TIMEOUT)
+		throw std::runtime_error("Unable to wait for fence. Reason: " + Vulkan::VkResultToString(result));
+}
+
+void Vulkan::VkManagedFence::Reset(uint32_t index)
+{
+	VkResult result = vkResetFences(m_device, 1, --m_fences[index]);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Unable to reset fence. Reason: " + Vulkan::VkResultToString(result));
+}
+
+bool Vulkan::VkManagedFence::IsSignaled(uint32_t index)
+{
+	return vkGetFenceStatus(m_device, m_fences[index]) == VK_SUCCESS;
+}
+
+VkFence Vulkan::VkManagedFence::GetFence(uint32_t index)
+{
+	return m_fences[index];
+}
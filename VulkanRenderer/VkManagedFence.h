@@ -0,0 +1,24 @@
+#pragma once
+#include "VulkanObject.h"
+#include <vector>
+namespace Vulkan
+{
+	class VkManagedDevice;
+	class VkManagedFence
+	{
+	public:
+		VkManagedFence(VkManagedDevice * device, uint32_t fenceCount, bool signaled);
+		VkManagedFence(const VkManagedFence& other) = delete;
+		VkManagedFence& operator=(const VkManagedFence& other) = delete;
+		const uint32_t count;
+		///Block until the device signals the fence
+		void Wait(uint32_t index, uint64_t timeout = UINT64_MAX);
+		///Return the fence to the unsignaled state, must not be pending in a queue
+		void Reset(uint32_t index);
+		bool IsSignaled(uint32_t index);
+		VkFence GetFence(uint32_t index);
+	private:
+		VulkanObjectContainer<VkDevice> m_device{ vkDestroyDevice,false };
+		std::vector<VulkanObjectContainer<VkFence>> m_fences;
+	};
+}
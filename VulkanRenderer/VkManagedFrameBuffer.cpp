@@ -83,12 +83,16 @@ void Vulkan::VkManagedFrameBuffer::Build(VkExtent2D extent, bool sample, bool co
 }
 
 void Vulkan::VkManagedFrameBuffer::Build(VkExtent2D extent, bool sampleColor, bool copyColor,  bool sampleDepth, bool copyDepth, VkFormat colorFormat, VkFormat depthFormat)
+{
+	Build(extent, sampleColor, copyColor, sampleDepth, copyDepth, colorFormat, depthFormat, {});
+}
+
+void Vulkan::VkManagedFrameBuffer::Build(VkExtent2D extent, bool sampleColor, bool copyColor, bool sampleDepth, bool copyDepth, VkFormat colorFormat, VkFormat depthFormat, const std::vector<VkFormat>& inputFormats)
 {
 	assert(depthFormat != VK_FORMAT_UNDEFINED);
 	assert(colorFormat != VK_FORMAT_UNDEFINED);
 
 	uint32_t usage = 0;
-	std::vector<VkImageView> attachments;
 
 	if (!m_mdevice->CheckFormatFeature(VkFormatFeatureFlagBits::VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT, colorFormat, VK_IMAGE_TILING_OPTIMAL))
 	{
@@ -101,11 +105,36 @@ void Vulkan::VkManagedFrameBuffer::Build(VkExtent2D extent, bool sampleColor, bo
 	if (copyColor)
 		usage = usage | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
+	//a color target handed in earlier is left to its owner
+	if (!m_ownsColor)
+	{
+		m_colorAttachment = nullptr;
+		m_ownsColor = true;
+	}
 	if (m_colorAttachment == nullptr)
 		m_colorAttachment = new VkManagedImage(m_mdevice);
 
 	m_colorAttachment->Build(extent, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1, VK_IMAGE_TILING_OPTIMAL, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, usage);
 
+	BuildDepthAndInputs(extent, sampleDepth, copyDepth, depthFormat, inputFormats);
+}
+
+void Vulkan::VkManagedFrameBuffer::Build(VkExtent2D extent, VkManagedImage * colorTarget, bool sampleDepth, bool copyDepth, VkFormat depthFormat, const std::vector<VkFormat>& inputFormats)
+{
+	assert(colorTarget != nullptr);
+	assert(depthFormat != VK_FORMAT_UNDEFINED);
+
+	if (m_ownsColor && m_colorAttachment != nullptr)
+		delete m_colorAttachment;
+	m_colorAttachment = colorTarget;
+	m_ownsColor = false;
+	BuildDepthAndInputs(extent, sampleDepth, copyDepth, depthFormat, inputFormats);
+}
+
+void Vulkan::VkManagedFrameBuffer::BuildDepthAndInputs(VkExtent2D extent, bool sampleDepth, bool copyDepth, VkFormat depthFormat, const std::vector<VkFormat>& inputFormats)
+{
+	//the color attachment is already built and always comes first
+	std::vector<VkImageView> attachments;
 	attachments.push_back(*m_colorAttachment);
 
 	if (!m_mdevice->CheckFormatFeature(VkFormatFeatureFlagBits::VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT, depthFormat, VK_IMAGE_TILING_OPTIMAL))
@@ -113,7 +142,7 @@ void Vulkan::VkManagedFrameBuffer::Build(VkExtent2D extent, bool sampleColor, bo
 		throw std::invalid_argument("Provided depth format does not support optimal tiling");
 	}
 
-	usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	uint32_t usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
 	if (sampleDepth)
 		usage = usage | VK_IMAGE_USAGE_SAMPLED_BIT;
 	if (copyDepth)
@@ -128,7 +157,21 @@ void Vulkan::VkManagedFrameBuffer::Build(VkExtent2D extent, bool sampleColor, bo
 
 	m_depthAttachment->Build(extent, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1, VK_IMAGE_TILING_OPTIMAL, depthFormat, depthAspect, usage);
 	attachments.push_back(*m_depthAttachment);
-	
+
+	//input attachments belong to whoever hands them in, the framebuffers over them are made per slot
+	for (VkFormat format : inputFormats)
+	{
+		if (!m_mdevice->CheckFormatFeature(VkFormatFeatureFlagBits::VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT, format, VK_IMAGE_TILING_OPTIMAL))
+		{
+			throw std::invalid_argument("Provided input attachment format does not support optimal tiling");
+		}
+	}
+	ReleaseSlots();
+	m_inputFormats = inputFormats;
+	m_extent = extent;
+	if (!inputFormats.empty())
+		return;
+
 	VkFramebufferCreateInfo framebufferInfo = {};
 	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 	framebufferInfo.renderPass = m_pass;
@@ -141,19 +184,66 @@ void Vulkan::VkManagedFrameBuffer::Build(VkExtent2D extent, bool sampleColor, bo
 
 	if (result != VK_SUCCESS) {
 		//clear attachments
-		m_colorAttachment->Clear();
+		if (m_ownsColor)
+			m_colorAttachment->Clear();
 		m_depthAttachment->Clear();
 
 		throw std::runtime_error("Unable to create frame buffer, reason: " + Vulkan::VkResultToString(result));
 	}
 }
 
+void Vulkan::VkManagedFrameBuffer::SetInputAttachments(uint32_t slot, const std::vector<VkManagedImage*>& inputs)
+{
+	assert(inputs.size() == m_inputFormats.size() && !inputs.empty());
+	assert(m_colorAttachment != nullptr && m_depthAttachment != nullptr);
+
+	std::vector<VkImageView> attachments;
+	attachments.push_back(*m_colorAttachment);
+	attachments.push_back(*m_depthAttachment);
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		assert(inputs[i] != nullptr && inputs[i]->format == m_inputFormats[i]);
+		attachments.push_back(*inputs[i]);
+	}
+
+	if (m_slotFramebuffers.size() <= slot)
+		m_slotFramebuffers.resize(slot + 1, VK_NULL_HANDLE);
+	if (m_slotFramebuffers[slot] != VK_NULL_HANDLE)
+	{
+		vkDestroyFramebuffer(m_device, m_slotFramebuffers[slot], nullptr);
+		m_slotFramebuffers[slot] = VK_NULL_HANDLE;
+	}
+
+	VkFramebufferCreateInfo framebufferInfo = {};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = m_pass;
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	framebufferInfo.pAttachments = attachments.data();
+	framebufferInfo.width = m_extent.width;
+	framebufferInfo.height = m_extent.height;
+	framebufferInfo.layers = 1;
+	VkResult result = vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &m_slotFramebuffers[slot]);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Unable to create frame buffer, reason: " + Vulkan::VkResultToString(result));
+}
+
+void Vulkan::VkManagedFrameBuffer::ReleaseSlots()
+{
+	for (VkFramebuffer framebuffer : m_slotFramebuffers)
+	{
+		if (framebuffer != VK_NULL_HANDLE)
+			vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+	}
+	m_slotFramebuffers.clear();
+}
+
 Vulkan::VkManagedFrameBuffer::~VkManagedFrameBuffer()
 {
-	if (m_colorAttachment != nullptr)
+	if (m_colorAttachment != nullptr && m_ownsColor)
 		delete m_colorAttachment;
 	if (m_depthAttachment != nullptr)
 		delete m_depthAttachment;
+	ReleaseSlots();
 }
 
 //Clear frame buffer internal data
@@ -161,10 +251,12 @@ void Vulkan::VkManagedFrameBuffer::Clear()
 {
 	if (m_framebuffer != VK_NULL_HANDLE)
 		++m_framebuffer;
-	if (m_colorAttachment != nullptr)
+	if (m_colorAttachment != nullptr && m_ownsColor)
 		delete m_colorAttachment;
 	if (m_depthAttachment != nullptr)
 		delete m_depthAttachment;
+	ReleaseSlots();
+	m_inputFormats.clear();
 }
 
 VkFramebuffer Vulkan::VkManagedFrameBuffer::FrameBuffer()
@@ -172,6 +264,14 @@ VkFramebuffer Vulkan::VkManagedFrameBuffer::FrameBuffer()
 	return m_framebuffer;
 }
 
+VkFramebuffer Vulkan::VkManagedFrameBuffer::FrameBuffer(uint32_t slot)
+{
+	if (m_inputFormats.empty())
+		return m_framebuffer;
+	assert(slot < m_slotFramebuffers.size() && m_slotFramebuffers[slot] != VK_NULL_HANDLE);
+	return m_slotFramebuffers[slot];
+}
+
 Vulkan::VkManagedImage * Vulkan::VkManagedFrameBuffer::ColorAttachment() const
 {
 	return this->m_colorAttachment;
@@ -181,3 +281,4 @@ Vulkan::VkManagedImage * Vulkan::VkManagedFrameBuffer::DepthAttachment() const
 {
 	return this->m_depthAttachment;
 }
+
@@ -1,6 +1,7 @@
 #pragma once
 #include "VulkanObject.h"
 #include <memory>
+#include <vector>
 namespace Vulkan
 {
 	enum VkManagedFrameBufferAttachment
@@ -17,6 +18,11 @@ namespace Vulkan
 		VkManagedFrameBuffer(VkManagedDevice * device, VkRenderPass pass);
 		void Build(VkExtent2D extent, bool sample, bool copy, VkFormat Format, VkManagedFrameBufferAttachment singleAttachment);
 		void Build(VkExtent2D extent, bool sampleColor, bool copyColor, bool sampleDepth, bool copyDepth, VkFormat colorFormat, VkFormat depthFormat);
+		///Color and depth followed by one attachment per input format, written and read again within the pass.
+		///The input images are owned elsewhere and handed in per slot with SetInputAttachments
+		void Build(VkExtent2D extent, bool sampleColor, bool copyColor, bool sampleDepth, bool copyDepth, VkFormat colorFormat, VkFormat depthFormat, const std::vector<VkFormat>& inputFormats);
+		///Same as above with an image owned elsewhere, such as a swapchain image, as the color attachment
+		void Build(VkExtent2D extent, VkManagedImage * colorTarget, bool sampleDepth, bool copyDepth, VkFormat depthFormat, const std::vector<VkFormat>& inputFormats);
 		VkManagedFrameBuffer(const VkManagedFrameBuffer&) = delete;
 		VkManagedFrameBuffer& operator=(const VkManagedFrameBuffer&) = delete;
 		~VkManagedFrameBuffer();
@@ -26,12 +32,25 @@ namespace Vulkan
 			return m_framebuffer;
 		}
 		VkFramebuffer FrameBuffer();
+		///Framebuffer over the inputs of slot, the only one there is without input attachments
+		VkFramebuffer FrameBuffer(uint32_t slot);
+		///Recreate the framebuffer of slot over inputs, the device must be done with the one it replaces
+		void SetInputAttachments(uint32_t slot, const std::vector<VkManagedImage*>& inputs);
 		VkManagedImage * ColorAttachment() const;
 		VkManagedImage * DepthAttachment() const;
 	private:
+		void BuildDepthAndInputs(VkExtent2D extent, bool sampleDepth, bool copyDepth, VkFormat depthFormat, const std::vector<VkFormat>& inputFormats);
+		void ReleaseSlots();
+	private:
 
 		VkManagedImage * m_colorAttachment = nullptr;
+		//false when the color attachment was handed in by the caller
+		bool m_ownsColor = true;
 		VkManagedImage * m_depthAttachment = nullptr;
+		std::vector<VkFormat> m_inputFormats;
+		//one framebuffer per slot when the inputs are handed in, they change with the frame that owns them
+		std::vector<VkFramebuffer> m_slotFramebuffers;
+		VkExtent2D m_extent = {};
 		VkManagedDevice * m_mdevice = nullptr;
 		VulkanObjectContainer<VkDevice> m_device{ vkDestroyDevice,false };
 		VulkanObjectContainer<VkFramebuffer> m_framebuffer { m_device, vkDestroyFramebuffer };
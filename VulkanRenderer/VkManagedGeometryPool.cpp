@@ -0,0 +1,110 @@
+#include "VkManagedGeometryPool.h"
+#include "VkManagedDevice.h"
+#include "VkManagedBuffer.h"
+#include "VulkanSystemStructs.h"
+#include <algorithm>
+#include <assert.h>
+
+//smallest device buffer created for a stream, avoids several grows while the first meshes are loaded
+static const VkDeviceSize k_minimumStreamCapacity = 1024 * 1024;
+
+Vulkan::VkManagedGeometryPool::VkManagedGeometryPool(VkManagedDevice * device, uint32_t frameCount)
+{
+	assert(device != nullptr);
+	assert(frameCount > 0);
+	m_mdevice = device;
+	m_retired.resize(frameCount);
+	m_vertices.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	m_indices.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+}
+
+Vulkan::VkManagedGeometryPool::~VkManagedGeometryPool()
+{
+	for (std::vector<VkManagedBuffer*>& frame : m_retired)
+	{
+		for (VkManagedBuffer * buffer : frame)
+			delete buffer;
+	}
+	delete m_vertices.buffer;
+	delete m_indices.buffer;
+}
+
+void Vulkan::VkManagedGeometryPool::BeginFrame(uint32_t frameIndex)
+{
+	assert(frameIndex < m_retired.size());
+	m_frameIndex = frameIndex;
+	for (VkManagedBuffer * buffer : m_retired[frameIndex])
+		delete buffer;
+	m_retired[frameIndex].clear();
+}
+
+bool Vulkan::VkManagedGeometryPool::Upload(VkCommandBuffer commandBuffer, const VkVertex * vertices, uint32_t vertexCount, const uint32_t * indices, uint32_t indexCount)
+{
+	bool uploaded = UploadStream(commandBuffer, m_vertices, vertices, sizeof(VkVertex) * static_cast<VkDeviceSize>(vertexCount));
+	uploaded = UploadStream(commandBuffer, m_indices, indices, sizeof(uint32_t) * static_cast<VkDeviceSize>(indexCount)) || uploaded;
+	return uploaded;
+}
+
+Vulkan::VkManagedBuffer * Vulkan::VkManagedGeometryPool::VertexBuffer()
+{
+	return m_vertices.buffer;
+}
+
+Vulkan::VkManagedBuffer * Vulkan::VkManagedGeometryPool::IndexBuffer()
+{
+	return m_indices.buffer;
+}
+
+bool Vulkan::VkManagedGeometryPool::UploadStream(VkCommandBuffer commandBuffer, Stream & stream, const void * data, VkDeviceSize size)
+{
+	if (size <= stream.uploaded)
+		return false;
+
+	if (size > stream.capacity)
+	{
+		VkDeviceSize capacity = std::max(std::max(size, stream.capacity * 2), k_minimumStreamCapacity);
+		VkManagedBuffer * grown = new VkManagedBuffer(m_mdevice);
+		try
+		{
+			grown->Build(stream.usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, capacity);
+		}
+		catch (...)
+		{
+			delete grown;
+			throw;
+		}
+
+		//previous contents move on the device, frames still in flight keep drawing from the old buffer
+		if (stream.buffer != nullptr)
+		{
+			if (stream.uploaded > 0)
+				stream.buffer->CopyTo(commandBuffer, grown, 0, 0, stream.uploaded);
+			Retire(stream.buffer);
+		}
+		stream.buffer = grown;
+		stream.capacity = capacity;
+	}
+
+	VkDeviceSize appended = size - stream.uploaded;
+	VkManagedBuffer * staging = new VkManagedBuffer(m_mdevice);
+	try
+	{
+		staging->Build(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, appended);
+	}
+	catch (...)
+	{
+		delete staging;
+		throw;
+	}
+	staging->Write(0, 0, static_cast<size_t>(appended), const_cast<char*>(static_cast<const char*>(data)) + stream.uploaded);
+	staging->CopyTo(commandBuffer, stream.buffer, 0, stream.uploaded, appended);
+	Retire(staging);
+
+	stream.uploaded = size;
+	return true;
+}
+
+void Vulkan::VkManagedGeometryPool::Retire(VkManagedBuffer * buffer)
+{
+	m_retired[m_frameIndex].push_back(buffer);
+}
\ No newline at end of file
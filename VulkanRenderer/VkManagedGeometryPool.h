@@ -0,0 +1,53 @@
+/*=========================================================
+VkManagedGeometryPool.h - Device local vertex and index
+storage for the internal mesh pool. Geometry is append only,
+so every stream remembers how much was already uploaded and
+only the newly appended range is staged and copied. Buffers
+replaced by a grow or used for staging are kept alive until
+their frame comes around again.
+==========================================================*/
+
+#pragma once
+#include "VulkanObject.h"
+#include <vector>
+
+namespace Vulkan
+{
+	class VkManagedDevice;
+	class VkManagedBuffer;
+	struct VkVertex;
+	class VkManagedGeometryPool
+	{
+	public:
+		VkManagedGeometryPool(VkManagedDevice * device, uint32_t frameCount);
+		~VkManagedGeometryPool();
+		VkManagedGeometryPool(const VkManagedGeometryPool&) = delete;
+		VkManagedGeometryPool& operator=(const VkManagedGeometryPool&) = delete;
+		///Release the buffers retired the last time this frame was recorded, the device must be done with that frame
+		void BeginFrame(uint32_t frameIndex);
+		///Record copies for everything past the uploaded high-water mark, returns false when the device already has all data.
+		///The copies are left unsynchronized, the caller orders them before draws and later copies out of the streams
+		bool Upload(VkCommandBuffer commandBuffer, const VkVertex * vertices, uint32_t vertexCount, const uint32_t * indices, uint32_t indexCount);
+		VkManagedBuffer * VertexBuffer();
+		VkManagedBuffer * IndexBuffer();
+
+	private:
+		struct Stream
+		{
+			VkManagedBuffer * buffer = nullptr;
+			VkDeviceSize capacity = 0;
+			VkDeviceSize uploaded = 0;
+			VkBufferUsageFlags usage = 0;
+		};
+
+		bool UploadStream(VkCommandBuffer commandBuffer, Stream& stream, const void * data, VkDeviceSize size);
+		void Retire(VkManagedBuffer * buffer);
+
+	private:
+		VkManagedDevice * m_mdevice = nullptr;
+		Stream m_vertices;
+		Stream m_indices;
+		uint32_t m_frameIndex = 0;
+		std::vector<std::vector<VkManagedBuffer*>> m_retired;
+	};
+}
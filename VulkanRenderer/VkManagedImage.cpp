@@ -59,6 +59,14 @@ Vulkan::VkManagedImage::VkManagedImage(VkDevice device, VkManagedImageFlag image
 	}
 }
 
+Vulkan::VkManagedImage::~VkManagedImage()
+{
+	++m_imageView;
+	++m_image;
+	if (m_mdevice != nullptr)
+		m_mdevice->Allocator()->Free(m_allocation);
+}
+
 Vulkan::VkManagedImage::operator VkImage()
 {
 	return m_image;
@@ -71,30 +79,29 @@ Vulkan::VkManagedImage::operator VkImageView()
 
 void Vulkan::VkManagedImage::Build(VkImageCreateInfo imageCI)
 {
+	++m_imageView;
+	++m_image;
+	m_mdevice->Allocator()->Free(m_allocation);
+
 	VkResult result = vkCreateImage(m_device, &imageCI, nullptr, ++m_image);
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Unable to create staging image. Reason: " + Vulkan::VkResultToString(result));
 
-	VkMemoryRequirements memRequirements = {};
-	vkGetImageMemoryRequirements(m_device, m_image, &memRequirements);
-
-	VkMemoryAllocateInfo memAI = {};
-	memAI.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memAI.allocationSize = memRequirements.size;
-	memAI.memoryTypeIndex = m_mdevice->GetMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-	result = vkAllocateMemory(m_device, &memAI, nullptr, ++m_imageMemory);
-	if (result != VK_SUCCESS)
-		throw std::runtime_error("Unable to allocate memory. Reason: " + Vulkan::VkResultToString(result));
+	try
+	{
+		AllocateMemory(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, imageCI.tiling);
+	}
+	catch (...)
+	{
+		throw;
+	}
 
-	result = vkBindImageMemory(m_device, m_image, m_imageMemory, 0);
-	if (result != VK_SUCCESS)
-		throw std::runtime_error("Unable to bind image memory. Reason: " + Vulkan::VkResultToString(result));
 	layers = imageCI.arrayLayers;
 	layout = imageCI.initialLayout;
 	format = imageCI.format;
 	m_imageExtent = imageCI.extent;
 	aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	m_state.Reset(imageCI.mipLevels, layers, layout);
 }
 
 void Vulkan::VkManagedImage::Build(VkExtent2D extent, VkMemoryPropertyFlags memProp, uint32_t layers, VkImageTiling tiling, VkFormat format, VkImageAspectFlags aspect, VkImageUsageFlags usage, VkImageCreateFlags flags)
@@ -124,27 +131,22 @@ void Vulkan::VkManagedImage::Build(VkExtent2D extent, VkMemoryPropertyFlags memP
 	imageCI.sharingMode = VkSharingMode::VK_SHARING_MODE_EXCLUSIVE;
 	imageCI.flags = flags;
 
+	++m_imageView;
+	++m_image;
+	m_mdevice->Allocator()->Free(m_allocation);
+
 	result = vkCreateImage(m_device, &imageCI, nullptr, ++m_image);
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Unable to create image. Reason: " + Vulkan::VkResultToString(result));
 
-	VkMemoryRequirements memRequirements = {};
-	vkGetImageMemoryRequirements(m_device, m_image, &memRequirements);
-
-	VkMemoryAllocateInfo memAI = {};
-	memAI.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memAI.allocationSize = memRequirements.size;
-	memAI.memoryTypeIndex = m_mdevice->GetMemoryType(memRequirements.memoryTypeBits, memProp);
-
-	result = vkAllocateMemory(m_device, &memAI, nullptr, ++m_imageMemory);
-
-	if (result != VK_SUCCESS)
-		throw std::runtime_error("Unable to allocate memory. Reason: " + Vulkan::VkResultToString(result));
-
-	result = vkBindImageMemory(m_device, m_image, m_imageMemory, 0);
-
-	if (result != VK_SUCCESS)
-		throw std::runtime_error("Unable to bind image memory. Reason: " + Vulkan::VkResultToString(result));
+	try
+	{
+		AllocateMemory(memProp, tiling);
+	}
+	catch (...)
+	{
+		throw;
+	}
 
 	VkImageViewCreateInfo viewCI = {};
 	viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -178,25 +180,27 @@ void Vulkan::VkManagedImage::Build(VkExtent2D extent, VkMemoryPropertyFlags memP
 	m_imageExtent = imageCI.extent;
 	this->aspect = aspect;
 	this->layout = imageCI.initialLayout;
+	m_state.Reset(1, layers, layout);
 }
 
 void Vulkan::VkManagedImage::Clear()
 {
-	++m_image;
-	++m_imageMemory;
 	++m_imageView;
+	++m_image;
+	if (m_mdevice != nullptr)
+		m_mdevice->Allocator()->Free(m_allocation);
 	layout = VK_IMAGE_LAYOUT_UNDEFINED;
 	format = VK_FORMAT_UNDEFINED;
 	aspect = 0;
 	layers = 0;
 	m_imageExtent = {};
-	
+	m_state.Reset(0, 0, layout);
 }
 
 void Vulkan::VkManagedImage::UpdateDependency(VkManagedDevice * device, bool clearInternalImage)
 {
 	assert(m_image == VK_NULL_HANDLE);
-	assert(m_imageMemory == VK_NULL_HANDLE);
+	assert(m_allocation.memory == VK_NULL_HANDLE);
 	assert(m_imageView == VK_NULL_HANDLE);
 	assert(device != nullptr);
 	m_mdevice = device;
@@ -204,13 +208,25 @@ void Vulkan::VkManagedImage::UpdateDependency(VkManagedDevice * device, bool cle
 	if (!clearInternalImage)
 	{
 		m_image.clear = false;
-		m_imageMemory.clear = false;
 	}
 	layout = VK_IMAGE_LAYOUT_UNDEFINED;
 	format = VK_FORMAT_UNDEFINED;
 	aspect = 0;
 	layers = 0;
 	m_imageExtent = {};
+	m_state.Reset(0, 0, layout);
+}
+
+void Vulkan::VkManagedImage::AllocateMemory(VkMemoryPropertyFlags memProp, VkImageTiling tiling)
+{
+	VkMemoryRequirements memRequirements = {};
+	vkGetImageMemoryRequirements(m_device, m_image, &memRequirements);
+
+	m_allocation = m_mdevice->Allocator()->Allocate(memRequirements, memProp, tiling == VK_IMAGE_TILING_LINEAR ? VK_VKM_RESOURCE_LINEAR : VK_VKM_RESOURCE_OPTIMAL);
+
+	VkResult result = vkBindImageMemory(m_device, m_image, m_allocation.memory, m_allocation.offset);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Unable to bind image memory. Reason: " + Vulkan::VkResultToString(result));
 }
 
 void Vulkan::VkManagedImage::Build(VkImage image, VkFormat format, VkExtent2D extent, uint32_t layers, VkImageAspectFlags aspect, VkImageLayout layout, VkImageCreateFlags flags) 
@@ -250,6 +266,7 @@ void Vulkan::VkManagedImage::Build(VkImage image, VkFormat format, VkExtent2D ex
 	m_imageExtent.depth = 1U;
 	this->aspect = aspect;
 	m_image = image;
+	m_state.Reset(1, layers, layout);
 }
 
 void Vulkan::VkManagedImage::LoadData(VkManagedCommandBuffer * buffer, uint32_t bufferIndex, VkManagedQueue * submitQueue, void * pixels, uint32_t bitAlignment, uint32_t width, uint32_t height, VkImageLayout finalLayout)
@@ -276,10 +293,9 @@ void Vulkan::VkManagedImage::LoadData(VkManagedCommandBuffer * buffer, uint32_t
 	
 	//copy data to staging image
 	VkDeviceSize imageMemorySize = width * height * bitAlignment;
-	void * data = nullptr;
-	vkMapMemory(m_device, stagingImage.m_imageMemory, 0, imageMemorySize, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageMemorySize));
-	vkUnmapMemory(m_device, stagingImage.m_imageMemory);
+	assert(stagingImage.m_allocation.mapped != nullptr);
+	memcpy(stagingImage.m_allocation.mapped, pixels, static_cast<size_t>(imageMemorySize));
+	m_mdevice->Allocator()->Flush(stagingImage.m_allocation, 0, VK_WHOLE_SIZE);
 	VkCommandBuffer recBuff = buffer->Begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, bufferIndex);
 	this->SetLayout(recBuff, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 0, layers, submitQueue->familyIndex);
 	stagingImage.Copy(recBuff, this, submitQueue->familyIndex);
@@ -290,177 +306,85 @@ void Vulkan::VkManagedImage::LoadData(VkManagedCommandBuffer * buffer, uint32_t
 
 void Vulkan::VkManagedImage::SetLayout(VkCommandBuffer buffer, VkImageLayout newLayout,uint32_t baseLayer, uint32_t layerCount, uint32_t dstQueueFamily)
 {
+	VkPipelineStageFlags stages;
+	VkAccessFlags access;
+	LayoutUse(newLayout, stages, access);
+	VkManagedBarrierBatch batch;
+	Use(batch, stages, access, newLayout, 0, VK_REMAINING_MIP_LEVELS, baseLayer, layerCount, dstQueueFamily);
+	batch.Flush(buffer);
+}
 
-	VkImageMemoryBarrier imageMemoryBarrier = {};
-	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	imageMemoryBarrier.oldLayout = layout;
-	imageMemoryBarrier.newLayout = newLayout;
-	if (dstQueueFamily == VK_QUEUE_FAMILY_IGNORED || (dstQueueFamily =! VK_QUEUE_FAMILY_IGNORED && dstQueueFamily == m_srcQueueFamily))
-	{
-		imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	}
-	else
+void Vulkan::VkManagedImage::Use(VkManagedBarrierBatch & batch, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout newLayout, uint32_t baseMipLevel, uint32_t levelCount, uint32_t baseLayer, uint32_t layerCount, uint32_t dstQueueFamily)
+{
+	//the image changes queue family the first time it is used with another one than before
+	uint32_t srcQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+	if (dstQueueFamily != VK_QUEUE_FAMILY_IGNORED && dstQueueFamily != m_srcQueueFamily)
 	{
-		if(m_srcQueueFamily == VK_QUEUE_FAMILY_IGNORED)
-		{
-			imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-
-
-		}
-		else
-		{
-			imageMemoryBarrier.srcQueueFamilyIndex = m_srcQueueFamily;
-			imageMemoryBarrier.dstQueueFamilyIndex = dstQueueFamily;
-		}
+		srcQueueFamily = m_srcQueueFamily;
 		m_srcQueueFamily = dstQueueFamily;
 	}
+	if (srcQueueFamily == VK_QUEUE_FAMILY_IGNORED)
+		dstQueueFamily = VK_QUEUE_FAMILY_IGNORED;
 
-	imageMemoryBarrier.image = m_image;
-
-	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-
-		if (format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT)
-			imageMemoryBarrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-	}
-	else
-		imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	VkImageSubresourceRange range = { BarrierAspect(), baseMipLevel, levelCount, baseLayer, layerCount };
+	m_state.Use(batch, m_image, range, stages, access, newLayout, srcQueueFamily, dstQueueFamily);
+	layout = m_state.Layout(0, 0);
+}
 
-	imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
-	imageMemoryBarrier.subresourceRange.levelCount = 1;
-	imageMemoryBarrier.subresourceRange.baseArrayLayer = baseLayer;
-	imageMemoryBarrier.subresourceRange.layerCount = layerCount;
+void Vulkan::VkManagedImage::Assume(VkImageLayout newLayout, VkPipelineStageFlags stages, VkAccessFlags access)
+{
+	m_state.Assume({ aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS }, stages, access, newLayout);
+	layout = newLayout;
+}
 
-	if (layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_PREINITIALIZED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_PREINITIALIZED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-	{
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-	{
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-	{
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
-	{
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
-	{
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) {
+VkImageLayout Vulkan::VkManagedImage::Layout(uint32_t mipLevel, uint32_t layer) const
+{
+	return m_state.Layout(mipLevel, layer);
+}
 
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) {
+VkImageAspectFlags Vulkan::VkManagedImage::BarrierAspect() const
+{
+	if ((aspect & VK_IMAGE_ASPECT_DEPTH_BIT) != 0 && (format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT))
+		return aspect | VK_IMAGE_ASPECT_STENCIL_BIT;
+	return aspect;
+}
 
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL && (newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-		|| newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL))
-	{
-		imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-		if (newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
-		{
-			imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		}
-		else //VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-		{
-			imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		}
-	}
-	else if (layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-	{
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-	{
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_GENERAL)
-	{
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT | VK_ACCESS_HOST_WRITE_BIT;
-	}
-	else if (layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_GENERAL)
+void Vulkan::VkManagedImage::LayoutUse(VkImageLayout layout, VkPipelineStageFlags & stages, VkAccessFlags & access)
+{
+	//the use a layout is usually moved to for, general layouts could be used by anything
+	switch (layout)
 	{
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT | VK_ACCESS_HOST_WRITE_BIT;
-	}
-	else
+	case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+		stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		access = VK_ACCESS_TRANSFER_READ_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+		stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		access = VK_ACCESS_TRANSFER_WRITE_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+		stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		access = VK_ACCESS_SHADER_READ_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+		stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+		stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+		stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		access = 0;
+		break;
+	case VK_IMAGE_LAYOUT_GENERAL:
+		stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		access = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		break;
+	default:
 		throw std::invalid_argument("Layout transition not supported.");
-
-	vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &imageMemoryBarrier
-	);
-	layout = newLayout;
+	}
 }
 
 void Vulkan::VkManagedImage::Copy(VkCommandBuffer buffer, VkManagedImage * dst, uint32_t queueFamily, VkOffset3D srcOffset, VkOffset3D dstOffset, VkImageSubresourceLayers srcLayers, VkImageSubresourceLayers dstLayers)
@@ -477,8 +401,11 @@ void Vulkan::VkManagedImage::Copy(VkCommandBuffer buffer, VkManagedImage * dst,
 	VkImageLayout oldLayout = layout == VK_IMAGE_LAYOUT_UNDEFINED || layout == VK_IMAGE_LAYOUT_PREINITIALIZED ? VK_IMAGE_LAYOUT_GENERAL : layout;
 	VkImageLayout dstOldLayout = (dst->layout == VK_IMAGE_LAYOUT_UNDEFINED || dst->layout == VK_IMAGE_LAYOUT_PREINITIALIZED) ? VK_IMAGE_LAYOUT_GENERAL : dst->layout;
 
-	SetLayout(buffer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, srcLayers.baseArrayLayer, srcLayers.layerCount, queueFamily);
-	dst->SetLayout(buffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, dstLayers.baseArrayLayer, dstLayers.layerCount, queueFamily);
+	//both images wait in one barrier before the copy and return to their layouts in one after it
+	VkManagedBarrierBatch batch;
+	Use(batch, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, srcLayers.mipLevel, 1, srcLayers.baseArrayLayer, srcLayers.layerCount, queueFamily);
+	dst->Use(batch, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, dstLayers.mipLevel, 1, dstLayers.baseArrayLayer, dstLayers.layerCount, queueFamily);
+	batch.Flush(buffer);
 
 	if (srcLayers.layerCount != 0 && srcLayers.aspectMask != 0)
 		copyData.srcSubresource = srcLayers;
@@ -496,6 +423,11 @@ void Vulkan::VkManagedImage::Copy(VkCommandBuffer buffer, VkManagedImage * dst,
 		1, &copyData
 	);
 
-	SetLayout(buffer, oldLayout, srcLayers.baseArrayLayer, srcLayers.layerCount, queueFamily);
-	dst->SetLayout(buffer, dstOldLayout, dstLayers.baseArrayLayer, dstLayers.layerCount, queueFamily);
+	VkPipelineStageFlags stages;
+	VkAccessFlags access;
+	LayoutUse(oldLayout, stages, access);
+	Use(batch, stages, access, oldLayout, srcLayers.mipLevel, 1, srcLayers.baseArrayLayer, srcLayers.layerCount, queueFamily);
+	LayoutUse(dstOldLayout, stages, access);
+	dst->Use(batch, stages, access, dstOldLayout, dstLayers.mipLevel, 1, dstLayers.baseArrayLayer, dstLayers.layerCount, queueFamily);
+	batch.Flush(buffer);
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include "VulkanObject.h"
+#include "VkManagedAllocator.h"
+#include "VkManagedResourceState.h"
 
 namespace Vulkan
 {
@@ -19,6 +21,7 @@ namespace Vulkan
 
 		VkManagedImage(VkManagedDevice * device, bool clearInternalImage = true);
 		VkManagedImage(VkDevice device, VkManagedImageFlag imageFlag = VkManagedImageFlag::Clear, VkManagedImageFlag memoryFlag = VkManagedImageFlag::Clear, VkManagedImageFlag viewFlag = VkManagedImageFlag::Clear);
+		~VkManagedImage();
 		operator VkImage();
 		operator VkImageView();
 		void Build(VkExtent2D extent, VkMemoryPropertyFlags memProp, uint32_t layers, VkImageTiling tiling, VkFormat format, VkImageAspectFlags aspect, VkImageUsageFlags usage, VkImageCreateFlags flags = 0);
@@ -27,12 +30,20 @@ namespace Vulkan
 		void UpdateDependency(VkManagedDevice * device, bool clearInternalImage = true);
 		void Build(VkImage image, VkFormat format, VkExtent2D extent, uint32_t layers, VkImageAspectFlags aspect, VkImageLayout layout, VkImageCreateFlags flags = 0);
 		void LoadData(VkManagedCommandBuffer * buffer, uint32_t bufferIndex, VkManagedQueue * submitQueue, void * pixels, uint32_t bitAlignment, uint32_t width, uint32_t height, VkImageLayout finalLayout);
+		///Move every mip level of the layers to newLayout right away, waiting on how each of them was last used
 		void SetLayout(VkCommandBuffer buffer, VkImageLayout newLayout, uint32_t baseLayer, uint32_t layerCount, uint32_t dstQueue);
+		///Queue what the mip levels and layers need before stages use them with access in newLayout, recorded when batch is flushed
+		void Use(VkManagedBarrierBatch& batch, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout newLayout,
+			uint32_t baseMipLevel = 0, uint32_t levelCount = VK_REMAINING_MIP_LEVELS, uint32_t baseLayer = 0, uint32_t layerCount = VK_REMAINING_ARRAY_LAYERS, uint32_t dstQueueFamily = VK_QUEUE_FAMILY_IGNORED);
+		///The whole image was left in newLayout by a render pass or a render graph, after a use by stages with access
+		void Assume(VkImageLayout newLayout, VkPipelineStageFlags stages = 0, VkAccessFlags access = 0);
+		VkImageLayout Layout(uint32_t mipLevel, uint32_t layer) const;
 		void Copy(VkCommandBuffer buffer, VkManagedImage * dst, uint32_t queueFamily = VK_QUEUE_FAMILY_IGNORED, VkOffset3D srcOffset = { 0,0,0 }, VkOffset3D dstOffset = { 0,0,0 }, VkImageSubresourceLayers srcLayers = { 0,0,0,1 }, VkImageSubresourceLayers dstLayers = { 0,0,0,1 });	
 	public:
 		VulkanObjectContainer<VkImage> image = VK_NULL_HANDLE;
 		VulkanObjectContainer<VkImageView> imageView = VK_NULL_HANDLE;
 		VulkanObjectContainer<VkDeviceMemory> imageMemory = VK_NULL_HANDLE;
+		///Layout of the first mip level and layer, of the whole image unless parts of it were moved on their own
 		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
 		VkFormat format = VK_FORMAT_UNDEFINED;
 		VkImageAspectFlags aspect = 0;
@@ -40,6 +51,10 @@ namespace Vulkan
 
 	private:
 		void Build(VkImageCreateInfo imageCI);
+		void AllocateMemory(VkMemoryPropertyFlags memProp, VkImageTiling tiling);
+		//depth and stencil of a combined format can only transition together
+		VkImageAspectFlags BarrierAspect() const;
+		static void LayoutUse(VkImageLayout layout, VkPipelineStageFlags& stages, VkAccessFlags& access);
 
 //		void CreateImage(uint32_t width, uint32_t height, uint32_t layerCount, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, Vulkan::VulkanObjectContainer<VkImage>& image, Vulkan::VulkanObjectContainer<VkDeviceMemory>& imageMemory, VkImageCreateFlags bits = 0);
 //		void CreateImageView(uint32_t layerCount, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, Vulkan::VulkanObjectContainer<VkImageView>& imageView, bool isCube = false);
@@ -49,9 +64,10 @@ namespace Vulkan
 		VulkanObjectContainer<VkDevice> m_device{ vkDestroyDevice, false };
 		VulkanObjectContainer<VkImage> m_image{ m_device,vkDestroyImage };
 		VulkanObjectContainer<VkImageView> m_imageView{ m_device, vkDestroyImageView };
-		VulkanObjectContainer<VkDeviceMemory> m_imageMemory{ m_device, vkFreeMemory };
+		VkManagedAllocation m_allocation;
 		VkExtent3D m_imageExtent = {};
 		uint32_t m_srcQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+		VkManagedResourceState m_state;
 		VkDevice m_deviceHandle = VK_NULL_HANDLE;
 	};
 }
\ No newline at end of file
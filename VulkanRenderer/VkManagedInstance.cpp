@@ -258,6 +258,7 @@ void Vulkan::VkManagedInstance::AcquirePhysicalDevices()
 		devices[i] = new VkPhysicalDeviceData();
 		devices[i]->device = systemDevices[i];
 		vkGetPhysicalDeviceProperties(systemDevices[i],&devices[i]->deviceProperties);
+		vkGetPhysicalDeviceFeatures(systemDevices[i], &devices[i]->deviceFeatures);
 
 	}
 }
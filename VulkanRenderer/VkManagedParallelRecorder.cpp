@@ -0,0 +1,166 @@
+#include "VkManagedParallelRecorder.h"
+#include "VkManagedDevice.h"
+#include "VkManagedCommandPool.h"
+#include "VkManagedCommandBuffer.h"
+#include <algorithm>
+#include <assert.h>
+
+Vulkan::VkManagedParallelRecorder::VkManagedParallelRecorder(VkManagedDevice * device, VkManagedQueue * queue, uint32_t workerCount, uint32_t frameCount, size_t itemsPerTask)
+{
+	assert(device != nullptr && queue != nullptr);
+	assert(workerCount > 0 && frameCount > 0 && itemsPerTask > 0);
+	m_itemsPerTask = itemsPerTask;
+
+	//the vector is never resized again, so workers can hold references into it
+	m_workers.resize(workerCount);
+	try
+	{
+		for (Worker& worker : m_workers)
+		{
+			worker.pool = new VkManagedCommandPool(device, queue);
+			worker.frameBuffers.resize(frameCount);
+		}
+	}
+	catch (...)
+	{
+		for (Worker& worker : m_workers)
+			delete worker.pool;
+		throw;
+	}
+
+	for (uint32_t i = 0; i < workerCount; ++i)
+		m_workers[i].thread = std::thread(&VkManagedParallelRecorder::WorkerLoop, this, i);
+}
+
+Vulkan::VkManagedParallelRecorder::~VkManagedParallelRecorder()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_exit = true;
+	}
+	m_jobReady.notify_all();
+
+	for (Worker& worker : m_workers)
+	{
+		if (worker.thread.joinable())
+			worker.thread.join();
+		for (std::vector<VkManagedCommandBuffer*>& frame : worker.frameBuffers)
+		{
+			for (VkManagedCommandBuffer * buffer : frame)
+			{
+				buffer->Free();
+				delete buffer;
+			}
+		}
+		delete worker.pool;
+	}
+}
+
+void Vulkan::VkManagedParallelRecorder::BeginFrame(uint32_t frameIndex)
+{
+	assert(frameIndex < m_workers[0].frameBuffers.size());
+	m_frameIndex = frameIndex;
+	for (Worker& worker : m_workers)
+		worker.usedBuffers = 0;
+}
+
+uint32_t Vulkan::VkManagedParallelRecorder::TaskCount(size_t count)
+{
+	size_t tasks = (count + m_itemsPerTask - 1) / m_itemsPerTask;
+	return static_cast<uint32_t>(std::min(tasks, m_workers.size()));
+}
+
+const std::vector<VkCommandBuffer>& Vulkan::VkManagedParallelRecorder::Record(const VkCommandBufferInheritanceInfo & inheritance, size_t count, RecordCallback callback)
+{
+	m_recorded.clear();
+	uint32_t tasks = TaskCount(count);
+	if (tasks == 0)
+		return m_recorded;
+
+	//even chunks, trailing workers stay idle when the count doesn't fill them
+	size_t chunkSize = (count + tasks - 1) / tasks;
+	tasks = static_cast<uint32_t>((count + chunkSize - 1) / chunkSize);
+	for (uint32_t i = 0; i < tasks; ++i)
+	{
+		m_workers[i].first = i * chunkSize;
+		m_workers[i].count = std::min(chunkSize, count - m_workers[i].first);
+		m_workers[i].recorded = VK_NULL_HANDLE;
+		m_workers[i].error = nullptr;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		m_inheritance = &inheritance;
+		m_callback = callback;
+		m_activeWorkers = tasks;
+		m_pendingWorkers = tasks;
+		m_jobGeneration++;
+		m_jobReady.notify_all();
+		m_jobDone.wait(lock, [this]() { return m_pendingWorkers == 0; });
+		m_callback = nullptr;
+	}
+
+	for (uint32_t i = 0; i < tasks; ++i)
+	{
+		if (m_workers[i].error)
+			std::rethrow_exception(m_workers[i].error);
+		m_recorded.push_back(m_workers[i].recorded);
+	}
+	return m_recorded;
+}
+
+uint32_t Vulkan::VkManagedParallelRecorder::WorkerCount()
+{
+	return static_cast<uint32_t>(m_workers.size());
+}
+
+void Vulkan::VkManagedParallelRecorder::WorkerLoop(uint32_t workerIndex)
+{
+	Worker& worker = m_workers[workerIndex];
+	uint64_t seenGeneration = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_jobReady.wait(lock, [&]() { return m_exit || m_jobGeneration != seenGeneration; });
+			if (m_exit)
+				return;
+			seenGeneration = m_jobGeneration;
+			if (workerIndex >= m_activeWorkers)
+				continue;
+		}
+
+		try
+		{
+			RecordTask(worker);
+		}
+		catch (...)
+		{
+			worker.error = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (--m_pendingWorkers == 0)
+				m_jobDone.notify_one();
+		}
+	}
+}
+
+void Vulkan::VkManagedParallelRecorder::RecordTask(Worker & worker)
+{
+	//buffers are allocated on the worker thread, its pool is never touched by any other thread
+	std::vector<VkManagedCommandBuffer*>& frame = worker.frameBuffers[m_frameIndex];
+	if (worker.usedBuffers == frame.size())
+	{
+		VkManagedCommandBuffer * buffer = nullptr;
+		worker.pool->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1, buffer);
+		frame.push_back(buffer);
+	}
+	VkManagedCommandBuffer * buffer = frame[worker.usedBuffers++];
+
+	VkCommandBuffer commandBuffer = buffer->Begin(VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, 0, m_inheritance);
+	m_callback(commandBuffer, worker.first, worker.count);
+	buffer->End(0);
+	worker.recorded = commandBuffer;
+}
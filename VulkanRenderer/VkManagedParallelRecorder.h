@@ -0,0 +1,75 @@
+/*=========================================================
+VkManagedParallelRecorder.h - Worker threads recording
+secondary command buffers. Every worker owns its command pool
+and a set of secondary buffers per frame, so pools are never
+shared between threads. A recorded range of items is split in
+chunks, one chunk per worker, and the buffers are returned in
+item order to be executed from the primary buffer.
+==========================================================*/
+
+#pragma once
+#include "VulkanObject.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+namespace Vulkan
+{
+	class VkManagedDevice;
+	class VkManagedQueue;
+	class VkManagedCommandPool;
+	class VkManagedCommandBuffer;
+	class VkManagedParallelRecorder
+	{
+	public:
+		typedef std::function<void(VkCommandBuffer buffer, size_t first, size_t count)> RecordCallback;
+		VkManagedParallelRecorder(VkManagedDevice * device, VkManagedQueue * queue, uint32_t workerCount, uint32_t frameCount, size_t itemsPerTask);
+		VkManagedParallelRecorder(const VkManagedParallelRecorder&) = delete;
+		VkManagedParallelRecorder& operator=(const VkManagedParallelRecorder&) = delete;
+		~VkManagedParallelRecorder();
+		///Hand out the secondary buffers of the frame from the start, the device must be done with that frame
+		void BeginFrame(uint32_t frameIndex);
+		///Number of buffers count items are split into
+		uint32_t TaskCount(size_t count);
+		///Record count items across the workers into secondary buffers continuing the inherited render pass, blocks until all are recorded
+		const std::vector<VkCommandBuffer>& Record(const VkCommandBufferInheritanceInfo& inheritance, size_t count, RecordCallback callback);
+		uint32_t WorkerCount();
+
+	private:
+		struct Worker
+		{
+			std::thread thread;
+			VkManagedCommandPool * pool = nullptr;
+			//secondary buffers of every frame, handed out in order while the frame is recorded
+			std::vector<std::vector<VkManagedCommandBuffer*>> frameBuffers;
+			uint32_t usedBuffers = 0;
+			size_t first = 0;
+			size_t count = 0;
+			VkCommandBuffer recorded = VK_NULL_HANDLE;
+			std::exception_ptr error;
+		};
+
+		void WorkerLoop(uint32_t workerIndex);
+		void RecordTask(Worker& worker);
+
+	private:
+		std::vector<Worker> m_workers;
+		uint32_t m_frameIndex = 0;
+		size_t m_itemsPerTask = 1;
+		std::vector<VkCommandBuffer> m_recorded;
+
+		//job shared with the workers, guarded by m_lock
+		std::mutex m_lock;
+		std::condition_variable m_jobReady;
+		std::condition_variable m_jobDone;
+		uint64_t m_jobGeneration = 0;
+		uint32_t m_pendingWorkers = 0;
+		uint32_t m_activeWorkers = 0;
+		bool m_exit = false;
+		const VkCommandBufferInheritanceInfo * m_inheritance = nullptr;
+		RecordCallback m_callback;
+	};
+}
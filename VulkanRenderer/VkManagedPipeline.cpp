@@ -25,7 +25,7 @@ void Vulkan::VkManagedPipeline::Build(VkManagedRenderPass * renderPass, Pipeline
 	m_device = renderPass->GetDevice();
 	VkResult result;
 	std::string vertCodeSPV = ReadBinaryFile(vertShader);
-	std::string fragCodeSPV = ReadBinaryFile(fragShader);
+	std::string fragCodeSPV = fragShader != nullptr ? ReadBinaryFile(fragShader) : std::string();
 
 	VulkanObjectContainer<VkShaderModule> vertShaderModule{ m_device, vkDestroyShaderModule };
 	VulkanObjectContainer<VkShaderModule> fragShaderModule{ m_device, vkDestroyShaderModule };
@@ -33,7 +33,8 @@ void Vulkan::VkManagedPipeline::Build(VkManagedRenderPass * renderPass, Pipeline
 	try
 	{
 		CreateShaderModule(vertCodeSPV, vertShaderModule);
-		CreateShaderModule(fragCodeSPV, fragShaderModule);
+		if (fragShader != nullptr)
+			CreateShaderModule(fragCodeSPV, fragShaderModule);
 	}
 	catch (...)
 	{
@@ -94,24 +95,6 @@ void Vulkan::VkManagedPipeline::Build(VkManagedRenderPass * renderPass, Pipeline
 	rasterizerStateCI.rasterizerDiscardEnable = VK_FALSE;
 	rasterizerStateCI.polygonMode = VK_POLYGON_MODE_FILL;
 	rasterizerStateCI.lineWidth = 1.0f;
-	switch (mode)
-	{
-	case Vulkan::Solid:
-		rasterizerStateCI.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizerStateCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		rasterizerStateCI.depthBiasEnable = VK_FALSE;
-		break;
-	case Vulkan::OmniDirectionalShadows:
-		rasterizerStateCI.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizerStateCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		rasterizerStateCI.depthBiasEnable = VK_FALSE;
-		break;
-	case Vulkan::ProjectedShadows:
-		rasterizerStateCI.cullMode = VK_CULL_MODE_FRONT_BIT;
-		rasterizerStateCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		rasterizerStateCI.depthBiasEnable = VK_TRUE;
-		break;
-	}
 
 	VkPipelineMultisampleStateCreateInfo multisamplingStateCI = {};
 	multisamplingStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
@@ -122,53 +105,20 @@ void Vulkan::VkManagedPipeline::Build(VkManagedRenderPass * renderPass, Pipeline
 	depthStencilStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 	depthStencilStateCI.depthTestEnable = VK_TRUE;
 	depthStencilStateCI.depthWriteEnable = VK_TRUE;
-	switch (mode)
-	{
-	case Vulkan::Solid:
-		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS;
-		break;
-	case Vulkan::OmniDirectionalShadows:
-		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		break;
-	case Vulkan::ProjectedShadows:
-		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		break;
-	}
 	depthStencilStateCI.depthBoundsTestEnable = VK_FALSE;
 
-	VkPipelineColorBlendAttachmentState colorBlendAttachmentState = {};
-
+	std::array<VkPipelineColorBlendAttachmentState, 3U> blendAttachmentStates = {};
 	VkPipelineColorBlendStateCreateInfo colorBlendingStateCI = {};
 	colorBlendingStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	switch (mode)
-	{
-	case Vulkan::Solid:
-		colorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachmentState.blendEnable = VK_FALSE;
-		colorBlendingStateCI.logicOpEnable = VK_FALSE;
-		colorBlendingStateCI.logicOp = VK_LOGIC_OP_COPY;
-		colorBlendingStateCI.attachmentCount = 1;
-		colorBlendingStateCI.pAttachments = &colorBlendAttachmentState;
-		break;
-	case Vulkan::OmniDirectionalShadows:
-		colorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachmentState.blendEnable = VK_FALSE;
-		colorBlendingStateCI.logicOpEnable = VK_FALSE;
-		colorBlendingStateCI.logicOp = VK_LOGIC_OP_COPY;
-		colorBlendingStateCI.attachmentCount = 1;
-		colorBlendingStateCI.pAttachments = &colorBlendAttachmentState;
-		break;
-	case Vulkan::ProjectedShadows:
-		colorBlendingStateCI.logicOpEnable = VK_FALSE;
-		colorBlendingStateCI.logicOp = VK_LOGIC_OP_COPY;
-		colorBlendingStateCI.attachmentCount = 0;
-		break;
-	}
+	colorBlendingStateCI.logicOpEnable = VK_FALSE;
+	colorBlendingStateCI.logicOp = VK_LOGIC_OP_COPY;
 
 	//LAYOUTS --- HARDCODED
-	std::array<VkDescriptorSetLayout, 2U> layouts{ m_vertSetLayout,m_fragSetLayout };
+	std::vector<VkDescriptorSetLayout> layouts{ m_vertSetLayout,m_fragSetLayout };
 	//!LAYOUTS
 
+	SetModeStates(mode, vertexInputCI, rasterizerStateCI, depthStencilStateCI, colorBlendingStateCI, blendAttachmentStates, layouts);
+
 	VkPipelineLayoutCreateInfo pipelineLayoutCI = {};
 	pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutCI.setLayoutCount = static_cast<uint32_t>(layouts.size());
@@ -203,7 +153,7 @@ void Vulkan::VkManagedPipeline::Build(VkManagedRenderPass * renderPass, Pipeline
 
 	VkGraphicsPipelineCreateInfo graphicsPipelineCI = {};
 	graphicsPipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	graphicsPipelineCI.stageCount = 2;
+	graphicsPipelineCI.stageCount = fragShader != nullptr ? 2 : 1;
 	graphicsPipelineCI.pStages = shaderStages;
 	graphicsPipelineCI.pVertexInputState = &vertexInputCI;
 	graphicsPipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
@@ -215,7 +165,7 @@ void Vulkan::VkManagedPipeline::Build(VkManagedRenderPass * renderPass, Pipeline
 	graphicsPipelineCI.pDynamicState = &dynamicStateCI;
 	graphicsPipelineCI.layout = m_pipelineLayout;
 	graphicsPipelineCI.renderPass = *renderPass;
-	graphicsPipelineCI.subpass = 0;
+	graphicsPipelineCI.subpass = mode == Vulkan::DeferredLighting ? 1 : 0;
 	graphicsPipelineCI.basePipelineHandle = VK_NULL_HANDLE;
 
 	result = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &graphicsPipelineCI, nullptr, ++m_pipeline);
@@ -234,7 +184,7 @@ void Vulkan::VkManagedPipeline::Build(VkManagedRenderPass * renderPass, Pipeline
 	m_device = renderPass->GetDevice();
 	VkResult result;
 	std::string vertCodeSPV = ReadBinaryFile(vertShader);
-	std::string fragCodeSPV = ReadBinaryFile(fragShader);
+	std::string fragCodeSPV = fragShader != nullptr ? ReadBinaryFile(fragShader) : std::string();
 
 	VulkanObjectContainer<VkShaderModule> vertShaderModule{ m_device, vkDestroyShaderModule };
 	VulkanObjectContainer<VkShaderModule> fragShaderModule{ m_device, vkDestroyShaderModule };
@@ -242,7 +192,8 @@ void Vulkan::VkManagedPipeline::Build(VkManagedRenderPass * renderPass, Pipeline
 	try
 	{
 		CreateShaderModule(vertCodeSPV, vertShaderModule);
-		CreateShaderModule(fragCodeSPV, fragShaderModule);
+		if (fragShader != nullptr)
+			CreateShaderModule(fragCodeSPV, fragShaderModule);
 	}
 	catch (...)
 	{
@@ -303,24 +254,6 @@ void Vulkan::VkManagedPipeline::Build(VkManagedRenderPass * renderPass, Pipeline
 	rasterizerStateCI.rasterizerDiscardEnable = VK_FALSE;
 	rasterizerStateCI.polygonMode = VK_POLYGON_MODE_FILL;
 	rasterizerStateCI.lineWidth = 1.0f;
-	switch (mode)
-	{
-	case Vulkan::Solid:
-		rasterizerStateCI.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizerStateCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		rasterizerStateCI.depthBiasEnable = VK_FALSE;
-		break;
-	case Vulkan::OmniDirectionalShadows:
-		rasterizerStateCI.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizerStateCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		rasterizerStateCI.depthBiasEnable = VK_FALSE;
-		break;
-	case Vulkan::ProjectedShadows:
-		rasterizerStateCI.cullMode = VK_CULL_MODE_FRONT_BIT;
-		rasterizerStateCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		rasterizerStateCI.depthBiasEnable = VK_TRUE;
-		break;
-	}
 
 	VkPipelineMultisampleStateCreateInfo multisamplingStateCI = {};
 	multisamplingStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
@@ -331,53 +264,20 @@ void Vulkan::VkManagedPipeline::Build(VkManagedRenderPass * renderPass, Pipeline
 	depthStencilStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 	depthStencilStateCI.depthTestEnable = VK_TRUE;
 	depthStencilStateCI.depthWriteEnable = VK_TRUE;
-	switch (mode)
-	{
-	case Vulkan::Solid:
-		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS;
-		break;
-	case Vulkan::OmniDirectionalShadows:
-		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		break;
-	case Vulkan::ProjectedShadows:
-		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		break;
-	}
 	depthStencilStateCI.depthBoundsTestEnable = VK_FALSE;
 
-	VkPipelineColorBlendAttachmentState colorBlendAttachmentState = {};
-
+	std::array<VkPipelineColorBlendAttachmentState, 3U> blendAttachmentStates = {};
 	VkPipelineColorBlendStateCreateInfo colorBlendingStateCI = {};
 	colorBlendingStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	switch (mode)
-	{
-	case Vulkan::Solid:
-		colorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachmentState.blendEnable = VK_FALSE;
-		colorBlendingStateCI.logicOpEnable = VK_FALSE;
-		colorBlendingStateCI.logicOp = VK_LOGIC_OP_COPY;
-		colorBlendingStateCI.attachmentCount = 1;
-		colorBlendingStateCI.pAttachments = &colorBlendAttachmentState;
-		break;
-	case Vulkan::OmniDirectionalShadows:
-		colorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachmentState.blendEnable = VK_FALSE;
-		colorBlendingStateCI.logicOpEnable = VK_FALSE;
-		colorBlendingStateCI.logicOp = VK_LOGIC_OP_COPY;
-		colorBlendingStateCI.attachmentCount = 1;
-		colorBlendingStateCI.pAttachments = &colorBlendAttachmentState;
-		break;
-	case Vulkan::ProjectedShadows:
-		colorBlendingStateCI.logicOpEnable = VK_FALSE;
-		colorBlendingStateCI.logicOp = VK_LOGIC_OP_COPY;
-		colorBlendingStateCI.attachmentCount = 0;
-		break;
-	}
+	colorBlendingStateCI.logicOpEnable = VK_FALSE;
+	colorBlendingStateCI.logicOp = VK_LOGIC_OP_COPY;
 
 	//LAYOUTS --- HARDCODED
-	std::array<VkDescriptorSetLayout, 2U> layouts{m_vertSetLayout,m_fragSetLayout};
+	std::vector<VkDescriptorSetLayout> layouts{ m_vertSetLayout,m_fragSetLayout };
 	//!LAYOUTS
 
+	SetModeStates(mode, vertexInputCI, rasterizerStateCI, depthStencilStateCI, colorBlendingStateCI, blendAttachmentStates, layouts);
+
 	VkPipelineLayoutCreateInfo pipelineLayoutCI = {};
 	pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutCI.setLayoutCount = static_cast<uint32_t>(layouts.size());
@@ -409,7 +309,7 @@ void Vulkan::VkManagedPipeline::Build(VkManagedRenderPass * renderPass, Pipeline
 
 	VkGraphicsPipelineCreateInfo graphicsPipelineCI = {};
 	graphicsPipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	graphicsPipelineCI.stageCount = 2;
+	graphicsPipelineCI.stageCount = fragShader != nullptr ? 2 : 1;
 	graphicsPipelineCI.pStages = shaderStages;
 	graphicsPipelineCI.pVertexInputState = &vertexInputCI;
 	graphicsPipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
@@ -421,7 +321,7 @@ void Vulkan::VkManagedPipeline::Build(VkManagedRenderPass * renderPass, Pipeline
 	graphicsPipelineCI.pDynamicState = &dynamicStateCI;
 	graphicsPipelineCI.layout = m_pipelineLayout;
 	graphicsPipelineCI.renderPass = *renderPass;
-	graphicsPipelineCI.subpass = 0;
+	graphicsPipelineCI.subpass = mode == Vulkan::DeferredLighting ? 1 : 0;
 	graphicsPipelineCI.basePipelineHandle = VK_NULL_HANDLE;
 
 	result = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &graphicsPipelineCI, nullptr, ++m_pipeline);
@@ -430,6 +330,154 @@ void Vulkan::VkManagedPipeline::Build(VkManagedRenderPass * renderPass, Pipeline
 	m_linkedPass = graphicsPipelineCI.renderPass;
 }
 
+void Vulkan::VkManagedPipeline::SetModeStates(PipelineMode mode, VkPipelineVertexInputStateCreateInfo & vertexInputCI, VkPipelineRasterizationStateCreateInfo & rasterizerStateCI,
+	VkPipelineDepthStencilStateCreateInfo & depthStencilStateCI, VkPipelineColorBlendStateCreateInfo & colorBlendingStateCI,
+	std::array<VkPipelineColorBlendAttachmentState, 3U> & blendAttachmentStates, std::vector<VkDescriptorSetLayout> & layouts)
+{
+	//box corners and the fullscreen triangle are generated from the vertex index
+	if (mode == Vulkan::BoundsQuery || mode == Vulkan::DeferredLighting)
+	{
+		vertexInputCI.vertexBindingDescriptionCount = 0;
+		vertexInputCI.vertexAttributeDescriptionCount = 0;
+	}
+	//only the position attribute is fetched
+	else if (mode == Vulkan::DepthPrepass)
+	{
+		vertexInputCI.vertexAttributeDescriptionCount = 1;
+	}
+
+	rasterizerStateCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizerStateCI.depthBiasEnable = VK_FALSE;
+	switch (mode)
+	{
+	case Vulkan::Solid:
+	case Vulkan::DepthPrepass:
+	case Vulkan::SolidDepthEqual:
+	case Vulkan::OmniDirectionalShadows:
+	case Vulkan::Deffered:
+		rasterizerStateCI.cullMode = VK_CULL_MODE_BACK_BIT;
+		break;
+	case Vulkan::ProjectedShadows:
+		rasterizerStateCI.cullMode = VK_CULL_MODE_FRONT_BIT;
+		rasterizerStateCI.depthBiasEnable = VK_TRUE;
+		break;
+	case Vulkan::BoundsQuery:
+	case Vulkan::DeferredLighting:
+		rasterizerStateCI.cullMode = VK_CULL_MODE_NONE;
+		break;
+	}
+
+	switch (mode)
+	{
+	case Vulkan::Solid:
+	case Vulkan::DepthPrepass:
+	case Vulkan::Deffered:
+		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS;
+		break;
+	case Vulkan::SolidDepthEqual:
+		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_EQUAL;
+		depthStencilStateCI.depthWriteEnable = VK_FALSE;
+		break;
+	case Vulkan::OmniDirectionalShadows:
+	case Vulkan::ProjectedShadows:
+		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		break;
+	case Vulkan::BoundsQuery:
+		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		depthStencilStateCI.depthWriteEnable = VK_FALSE;
+		break;
+	case Vulkan::DeferredLighting:
+		//the lighting subpass has no depth attachment
+		depthStencilStateCI.depthTestEnable = VK_FALSE;
+		depthStencilStateCI.depthWriteEnable = VK_FALSE;
+		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_ALWAYS;
+		break;
+	}
+
+	VkPipelineColorBlendAttachmentState& blendAttachmentState = blendAttachmentStates[0];
+	blendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	blendAttachmentState.blendEnable = VK_FALSE;
+	colorBlendingStateCI.attachmentCount = 1;
+	colorBlendingStateCI.pAttachments = blendAttachmentStates.data();
+	switch (mode)
+	{
+	case Vulkan::ProjectedShadows:
+	case Vulkan::Custom:
+		colorBlendingStateCI.attachmentCount = 0;
+		colorBlendingStateCI.pAttachments = nullptr;
+		break;
+	case Vulkan::BoundsQuery:
+	case Vulkan::DepthPrepass:
+		blendAttachmentState.colorWriteMask = 0;
+		break;
+	case Vulkan::Deffered:
+		//albedo, packed normal and view depth
+		blendAttachmentStates.fill(blendAttachmentState);
+		colorBlendingStateCI.attachmentCount = static_cast<uint32_t>(blendAttachmentStates.size());
+		break;
+	default:
+		break;
+	}
+
+	//the lighting subpass reads the G-buffer through a third set
+	if (mode == Vulkan::DeferredLighting)
+		layouts.push_back(m_inputSetLayout);
+}
+
+void Vulkan::VkManagedPipeline::BuildCompute(const char * compShader, std::vector<VkDescriptorSetLayoutBinding> bindings, std::vector<VkPushConstantRange> pushConstants)
+{
+	if (m_pipeline != VK_NULL_HANDLE)
+	{
+		++m_pipeline;
+		++m_pipelineLayout;
+	}
+	VkResult result;
+	std::string compCodeSPV = ReadBinaryFile(compShader);
+	VulkanObjectContainer<VkShaderModule> compShaderModule{ m_device, vkDestroyShaderModule };
+	try
+	{
+		CreateShaderModule(compCodeSPV, compShaderModule);
+	}
+	catch (...)
+	{
+		throw;
+	}
+
+	//compute pipelines own a single set described by the caller
+	VkDescriptorSetLayoutCreateInfo descSetLayoutCI = {};
+	descSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descSetLayoutCI.bindingCount = static_cast<uint32_t>(bindings.size());
+	descSetLayoutCI.pBindings = bindings.data();
+	result = vkCreateDescriptorSetLayout(m_device, &descSetLayoutCI, nullptr, ++m_compSetLayout);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Unable to create compute descriptor set layout. Reason: " + Vulkan::VkResultToString(result));
+
+	VkDescriptorSetLayout layout = m_compSetLayout;
+	VkPipelineLayoutCreateInfo pipelineLayoutCI = {};
+	pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCI.setLayoutCount = 1;
+	pipelineLayoutCI.pSetLayouts = &layout;
+	pipelineLayoutCI.pushConstantRangeCount = static_cast<uint32_t>(pushConstants.size());
+	pipelineLayoutCI.pPushConstantRanges = pushConstants.data();
+	result = vkCreatePipelineLayout(m_device, &pipelineLayoutCI, nullptr, ++m_pipelineLayout);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Unable to create pipeline layout. Reason: " + Vulkan::VkResultToString(result));
+
+	VkComputePipelineCreateInfo computePipelineCI = {};
+	computePipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	computePipelineCI.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	computePipelineCI.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	computePipelineCI.stage.module = compShaderModule;
+	computePipelineCI.stage.pName = "main";
+	computePipelineCI.layout = m_pipelineLayout;
+	computePipelineCI.basePipelineHandle = VK_NULL_HANDLE;
+
+	result = vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &computePipelineCI, nullptr, ++m_pipeline);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Unable to create compute pipeline. Reason: " + Vulkan::VkResultToString(result));
+	m_linkedPass = VK_NULL_HANDLE;
+}
+
 bool Vulkan::VkManagedPipeline::CreatedWithPass(VkRenderPass pass)
 {
 	return pass == m_linkedPass;
@@ -455,6 +503,16 @@ VkDescriptorSetLayout Vulkan::VkManagedPipeline::GetFragmentLayout() const
 	return m_fragSetLayout;
 }
 
+VkDescriptorSetLayout Vulkan::VkManagedPipeline::GetComputeLayout() const
+{
+	return m_compSetLayout;
+}
+
+VkDescriptorSetLayout Vulkan::VkManagedPipeline::GetInputLayout() const
+{
+	return m_inputSetLayout;
+}
+
 std::vector<VkDynamicState> Vulkan::VkManagedPipeline::GetDynamicStates()
 {
 	return m_activeDynamicStates;
@@ -600,18 +658,28 @@ void Vulkan::VkManagedPipeline::CreateDescriptorSetLayout_HARCODED()
 {
 	m_vertSetLayout = { m_device,vkDestroyDescriptorSetLayout };
 	m_fragSetLayout = { m_device, vkDestroyDescriptorSetLayout };
+	m_inputSetLayout = { m_device, vkDestroyDescriptorSetLayout };
 
 	VkDescriptorSetLayoutBinding vertexUBLB = {};
 	vertexUBLB.binding = 0;
 	vertexUBLB.descriptorCount = 1;
-	vertexUBLB.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	vertexUBLB.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
 	vertexUBLB.pImmutableSamplers = nullptr;
 	vertexUBLB.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
+	//instance indices of the draws that survived culling
+	VkDescriptorSetLayoutBinding vertexVisibleLB = {};
+	vertexVisibleLB.binding = 1;
+	vertexVisibleLB.descriptorCount = 1;
+	vertexVisibleLB.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	vertexVisibleLB.pImmutableSamplers = nullptr;
+	vertexVisibleLB.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	std::vector<VkDescriptorSetLayoutBinding> vertexBindings = { vertexUBLB, vertexVisibleLB };
 	VkDescriptorSetLayoutCreateInfo descSetLayoutCI = {};
 	descSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	descSetLayoutCI.bindingCount = 1;
-	descSetLayoutCI.pBindings = &vertexUBLB;
+	descSetLayoutCI.bindingCount = static_cast<uint32_t>(vertexBindings.size());
+	descSetLayoutCI.pBindings = vertexBindings.data();
 
 
 	VkResult result = vkCreateDescriptorSetLayout(m_device, &descSetLayoutCI, nullptr, ++m_vertSetLayout);
@@ -636,17 +704,56 @@ void Vulkan::VkManagedPipeline::CreateDescriptorSetLayout_HARCODED()
 	VkDescriptorSetLayoutBinding fragmentLightUBLB = {};
 	fragmentLightUBLB.binding = 1;
 	fragmentLightUBLB.descriptorCount = 1;
-	fragmentLightUBLB.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	fragmentLightUBLB.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	fragmentLightUBLB.pImmutableSamplers = nullptr;
 	fragmentLightUBLB.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-	std::vector<VkDescriptorSetLayoutBinding> bindings = { fragmentSamplerLB /*, shadowDepthSamplerLB*/, fragmentLightUBLB };
+	VkDescriptorSetLayoutBinding fragmentMaterialUBLB = {};
+	fragmentMaterialUBLB.binding = 2;
+	fragmentMaterialUBLB.descriptorCount = 1;
+	fragmentMaterialUBLB.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	fragmentMaterialUBLB.pImmutableSamplers = nullptr;
+	fragmentMaterialUBLB.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	//every light of the camera and the clusters they were binned into
+	VkDescriptorSetLayoutBinding fragmentLightListLB = {};
+	fragmentLightListLB.binding = 3;
+	fragmentLightListLB.descriptorCount = 1;
+	fragmentLightListLB.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	fragmentLightListLB.pImmutableSamplers = nullptr;
+	fragmentLightListLB.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutBinding fragmentClusterLB = {};
+	fragmentClusterLB.binding = 4;
+	fragmentClusterLB.descriptorCount = 1;
+	fragmentClusterLB.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	fragmentClusterLB.pImmutableSamplers = nullptr;
+	fragmentClusterLB.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings = { fragmentSamplerLB /*, shadowDepthSamplerLB*/, fragmentLightUBLB, fragmentMaterialUBLB, fragmentLightListLB, fragmentClusterLB };
 	descSetLayoutCI.bindingCount = static_cast<uint32_t>(bindings.size());
 	descSetLayoutCI.pBindings = bindings.data();
 
 	result = vkCreateDescriptorSetLayout(m_device, &descSetLayoutCI, nullptr, ++m_fragSetLayout);
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Unable to create fragment descriptor set layout. Reason: " + Vulkan::VkResultToString(result));
+
+	//albedo, packed normal and view depth written by the G-buffer subpass
+	std::vector<VkDescriptorSetLayoutBinding> inputBindings(3);
+	for (uint32_t i = 0; i < inputBindings.size(); ++i)
+	{
+		inputBindings[i].binding = i;
+		inputBindings[i].descriptorCount = 1;
+		inputBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		inputBindings[i].pImmutableSamplers = nullptr;
+		inputBindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	}
+	descSetLayoutCI.bindingCount = static_cast<uint32_t>(inputBindings.size());
+	descSetLayoutCI.pBindings = inputBindings.data();
+
+	result = vkCreateDescriptorSetLayout(m_device, &descSetLayoutCI, nullptr, ++m_inputSetLayout);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Unable to create input attachment descriptor set layout. Reason: " + Vulkan::VkResultToString(result));
 }
 
 void Vulkan::VkManagedPipeline::CreateShaderModule(std::string& code, VulkanObjectContainer<VkShaderModule>& shader)
@@ -1,6 +1,7 @@
 #pragma once
 #include "VulkanObject.h"
 #include <algorithm>
+#include <array>
 #include <vector>
 #include "VkManagedStructures.h"
 namespace Vulkan
@@ -11,7 +12,15 @@ namespace Vulkan
 		ProjectedShadows = 1,
 		OmniDirectionalShadows = 2,
 		Deffered = 3,
-		Custom = 4
+		Custom = 4,
+		//depth tested boxes without vertex input or color writes, drawn inside occlusion queries
+		BoundsQuery = 5,
+		//fullscreen triangle of the second deferred subpass, reads the G-buffer through input attachments
+		DeferredLighting = 6,
+		//position only depth writes ahead of the forward pass, no fragment shader is required
+		DepthPrepass = 7,
+		//forward shading over depth laid down by a DepthPrepass pipeline, only fragments with the stored depth pass
+		SolidDepthEqual = 8
 	};
 
 	struct VkDynamicStatesBlock;
@@ -22,8 +31,11 @@ namespace Vulkan
 	public:
 		VkManagedPipeline(VkManagedDevice * device);
 		VkManagedPipeline();
+		///fragShader may be null for depth only modes
 		void Build(VkManagedRenderPass * renderPass, PipelineMode mode, const char * vertShader, const char * fragShader, std::vector<VkDynamicState> dynamicStates, std::vector<VkPushConstantRange> pushConstants);
 		void Build(VkManagedRenderPass * renderPass, PipelineMode mode, const char * vertShader, const char * fragShader, std::vector<VkDynamicState> dynamicStates);
+		///Compute pipeline with one descriptor set made of the provided bindings
+		void BuildCompute(const char * compShader, std::vector<VkDescriptorSetLayoutBinding> bindings, std::vector<VkPushConstantRange> pushConstants);
 		
 		operator VkPipeline()
 		{
@@ -42,17 +54,25 @@ namespace Vulkan
 		VkPipelineLayout GetLayout() const;
 		VkDescriptorSetLayout GetVertexLayout() const;
 		VkDescriptorSetLayout GetFragmentLayout() const;
+		VkDescriptorSetLayout GetComputeLayout() const;
+		VkDescriptorSetLayout GetInputLayout() const;
 		std::vector<VkDynamicState> GetDynamicStates();
 		VkResult SetDynamicState(VkCommandBuffer buffer, VkDynamicStatesBlock states);
 		void SetPushConstant(VkCommandBuffer buffer, std::vector<VkPushConstant> vector);
 	private:
 		void CreateDescriptorSetLayout_HARCODED();
+		//vertex input, rasterization, depth, blending and set layouts that differ between modes, shared by both graphics Build overloads
+		void SetModeStates(PipelineMode mode, VkPipelineVertexInputStateCreateInfo& vertexInputCI, VkPipelineRasterizationStateCreateInfo& rasterizerStateCI,
+			VkPipelineDepthStencilStateCreateInfo& depthStencilStateCI, VkPipelineColorBlendStateCreateInfo& colorBlendingStateCI,
+			std::array<VkPipelineColorBlendAttachmentState, 3U>& blendAttachmentStates, std::vector<VkDescriptorSetLayout>& layouts);
 		void CreateShaderModule(std::string & code, VulkanObjectContainer<VkShaderModule>& shader);
 		std::string ReadBinaryFile(const char * filename);
 	private:
 		VulkanObjectContainer<VkDevice> m_device{ vkDestroyDevice,false };
 		VulkanObjectContainer<VkDescriptorSetLayout> m_vertSetLayout{m_device,vkDestroyDescriptorSetLayout};
 		VulkanObjectContainer<VkDescriptorSetLayout> m_fragSetLayout{m_device,vkDestroyDescriptorSetLayout};
+		VulkanObjectContainer<VkDescriptorSetLayout> m_compSetLayout{m_device,vkDestroyDescriptorSetLayout};
+		VulkanObjectContainer<VkDescriptorSetLayout> m_inputSetLayout{m_device,vkDestroyDescriptorSetLayout};
 		VulkanObjectContainer<VkPipeline> m_pipeline{ m_device,vkDestroyPipeline };
 		VulkanObjectContainer<VkPipelineLayout> m_pipelineLayout{ m_device, vkDestroyPipelineLayout };
 		VkRenderPass m_linkedPass = VK_NULL_HANDLE;
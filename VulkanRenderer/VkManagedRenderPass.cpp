@@ -7,7 +7,9 @@
 #include "VkManagedDescriptorSet.h"
 #include "VkManagedPipeline.h"
 #include "VkManagedBuffer.h"
+#include "VkManagedParallelRecorder.h"
 #include <array>
+#include <algorithm>
 #include <assert.h>
 
 
@@ -16,6 +18,9 @@ Vulkan::VkManagedRenderPass::VkManagedRenderPass(VkManagedDevice * device)
 	assert(device != nullptr);
 	m_mdevice = device;
 	m_device = *m_mdevice;
+	//without multiDrawIndirect every indirect command is issued on its own
+	if (m_mdevice->GetPhysicalDeviceFeatures().multiDrawIndirect == VK_TRUE)
+		m_maxIndirectDrawCount = std::max(m_mdevice->GetPhysicalDeviceLimits().maxDrawIndirectCount, 1u);
 }
 
 void Vulkan::VkManagedRenderPass::Build(VkExtent2D extent, VkFormat depthFormat)
@@ -76,11 +81,13 @@ void Vulkan::VkManagedRenderPass::Build(VkExtent2D extent, VkFormat depthFormat)
 	m_colorformat = VK_FORMAT_UNDEFINED;
 	m_depthFormat = depthFormat;
 	m_depthFinalLayout = depthAttachmentDesc.finalLayout;
+	m_firstSubpassColorAttachments.clear();
+	m_depthAttachment = 0;
 
 
 }
 
-void Vulkan::VkManagedRenderPass::Build(VkExtent2D extent, VkFormat colorFormat, VkFormat depthFormat)
+void Vulkan::VkManagedRenderPass::Build(VkExtent2D extent, VkFormat colorFormat, VkFormat depthFormat, VkImageLayout colorFinalLayout)
 {
 	assert(colorFormat != VK_FORMAT_UNDEFINED);
 	assert(depthFormat != VK_FORMAT_UNDEFINED);
@@ -93,15 +100,16 @@ void Vulkan::VkManagedRenderPass::Build(VkExtent2D extent, VkFormat colorFormat,
 	colorAttachmentDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachmentDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachmentDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachmentDesc.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachmentDesc.finalLayout = colorFinalLayout;
 	
 	VkAttachmentDescription depthAttachmentDesc = {};
 	depthAttachmentDesc.format = depthFormat;
 	depthAttachmentDesc.samples = VK_SAMPLE_COUNT_1_BIT;
 	depthAttachmentDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachmentDesc.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	//depth outlives the pass so it can be reduced into the occlusion pyramid
+	depthAttachmentDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	depthAttachmentDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	depthAttachmentDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
+	depthAttachmentDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachmentDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	depthAttachmentDesc.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
@@ -122,12 +130,13 @@ void Vulkan::VkManagedRenderPass::Build(VkExtent2D extent, VkFormat colorFormat,
 
 	std::array<VkSubpassDependency, 2> subPassDeps;
 
+	//depth is cleared by the pass as well, a swapchain image acquired for it is waited on at both stages
 	subPassDeps[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 	subPassDeps[0].dstSubpass = 0;
 	subPassDeps[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	subPassDeps[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	subPassDeps[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	subPassDeps[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	subPassDeps[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	subPassDeps[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 	subPassDeps[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
 	subPassDeps[1].srcSubpass = 0;
@@ -159,6 +168,136 @@ void Vulkan::VkManagedRenderPass::Build(VkExtent2D extent, VkFormat colorFormat,
 	m_depthFormat = depthFormat;
 	m_colorFinalLayout = colorAttachmentDesc.finalLayout;
 	m_depthFinalLayout = depthAttachmentDesc.finalLayout;
+	m_firstSubpassColorAttachments = { colorAttachmentRef.attachment };
+	m_depthAttachment = depthAttachmentRef.attachment;
+}
+
+void Vulkan::VkManagedRenderPass::BuildDeferred(VkExtent2D extent, VkFormat colorFormat, VkFormat depthFormat, VkImageLayout colorFinalLayout)
+{
+	assert(colorFormat != VK_FORMAT_UNDEFINED);
+	assert(depthFormat != VK_FORMAT_UNDEFINED);
+
+	//albedo, octahedral normal with specularity and linear view depth
+	std::vector<VkFormat> gBufferFormats = { VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_A2B10G10R10_UNORM_PACK32, VK_FORMAT_R32_SFLOAT };
+
+	VkAttachmentDescription colorAttachmentDesc = {};
+	colorAttachmentDesc.format = colorFormat;
+	colorAttachmentDesc.samples = VK_SAMPLE_COUNT_1_BIT;
+	//the lighting triangles only cover the camera regions, the rest keeps the clear color
+	colorAttachmentDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachmentDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachmentDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachmentDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachmentDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachmentDesc.finalLayout = colorFinalLayout;
+
+	VkAttachmentDescription depthAttachmentDesc = {};
+	depthAttachmentDesc.format = depthFormat;
+	depthAttachmentDesc.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachmentDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	//depth outlives the pass so it can be reduced into the occlusion pyramid
+	depthAttachmentDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	depthAttachmentDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachmentDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachmentDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachmentDesc.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	std::vector<VkAttachmentDescription> attachments{ colorAttachmentDesc, depthAttachmentDesc };
+	std::vector<VkAttachmentReference> gBufferWriteRefs;
+	std::vector<VkAttachmentReference> gBufferReadRefs;
+	//the G-buffer is never stored, tiled devices keep it in tile memory between the subpasses
+	for (size_t i = 0; i < gBufferFormats.size(); ++i)
+	{
+		VkAttachmentDescription gBufferAttachmentDesc = {};
+		gBufferAttachmentDesc.format = gBufferFormats[i];
+		gBufferAttachmentDesc.samples = VK_SAMPLE_COUNT_1_BIT;
+		gBufferAttachmentDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		gBufferAttachmentDesc.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		gBufferAttachmentDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		gBufferAttachmentDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		gBufferAttachmentDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		gBufferAttachmentDesc.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		attachments.push_back(gBufferAttachmentDesc);
+
+		uint32_t attachment = static_cast<uint32_t>(attachments.size() - 1);
+		gBufferWriteRefs.push_back({ attachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+		gBufferReadRefs.push_back({ attachment, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL });
+	}
+
+	VkAttachmentReference colorAttachmentRef = {};
+	colorAttachmentRef.attachment = 0;
+	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference depthAttachmentRef = {};
+	depthAttachmentRef.attachment = 1;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	std::array<VkSubpassDescription, 2> subPassDescs = {};
+	subPassDescs[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subPassDescs[0].colorAttachmentCount = static_cast<uint32_t>(gBufferWriteRefs.size());
+	subPassDescs[0].pColorAttachments = gBufferWriteRefs.data();
+	subPassDescs[0].pDepthStencilAttachment = &depthAttachmentRef;
+
+	//depth is not touched by the lighting subpass but its contents are needed after the pass
+	subPassDescs[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subPassDescs[1].colorAttachmentCount = 1;
+	subPassDescs[1].pColorAttachments = &colorAttachmentRef;
+	subPassDescs[1].inputAttachmentCount = static_cast<uint32_t>(gBufferReadRefs.size());
+	subPassDescs[1].pInputAttachments = gBufferReadRefs.data();
+	subPassDescs[1].preserveAttachmentCount = 1;
+	subPassDescs[1].pPreserveAttachments = &depthAttachmentRef.attachment;
+
+	std::array<VkSubpassDependency, 3> subPassDeps;
+
+	subPassDeps[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	subPassDeps[0].dstSubpass = 0;
+	subPassDeps[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	subPassDeps[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	subPassDeps[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	subPassDeps[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	subPassDeps[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	//each pixel only reads the G-buffer texel it covers, so the dependency stays within the tile
+	subPassDeps[1].srcSubpass = 0;
+	subPassDeps[1].dstSubpass = 1;
+	subPassDeps[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	subPassDeps[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	subPassDeps[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	subPassDeps[1].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+	subPassDeps[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	subPassDeps[2].srcSubpass = 1;
+	subPassDeps[2].dstSubpass = VK_SUBPASS_EXTERNAL;
+	subPassDeps[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	subPassDeps[2].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	subPassDeps[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	subPassDeps[2].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	subPassDeps[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	VkRenderPassCreateInfo renderPassCI = {};
+	renderPassCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCI.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassCI.pAttachments = attachments.data();
+	renderPassCI.subpassCount = static_cast<uint32_t>(subPassDescs.size());
+	renderPassCI.pSubpasses = subPassDescs.data();
+	renderPassCI.dependencyCount = static_cast<uint32_t>(subPassDeps.size());
+	renderPassCI.pDependencies = subPassDeps.data();
+
+	VkResult result = vkCreateRenderPass(m_device, &renderPassCI, nullptr, ++m_pass);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Unable to create deferred render pass. Reason: " + Vulkan::VkResultToString(result));
+
+	m_type = RenderPassType::Secondary_Offscreen_Deffered_Lights;
+	m_extent = extent;
+	m_colorformat = colorFormat;
+	m_depthFormat = depthFormat;
+	m_gBufferFormats = gBufferFormats;
+	m_colorFinalLayout = colorAttachmentDesc.finalLayout;
+	m_depthFinalLayout = depthAttachmentDesc.finalLayout;
+	m_firstSubpassColorAttachments.clear();
+	for (const VkAttachmentReference& reference : gBufferWriteRefs)
+		m_firstSubpassColorAttachments.push_back(reference.attachment);
+	m_depthAttachment = depthAttachmentRef.attachment;
 }
 
 void Vulkan::VkManagedRenderPass::SetPipeline(VkManagedPipeline * pipeline, VkDynamicStatesBlock dynamicStates, VkPipelineBindPoint bindPoint)
@@ -182,11 +321,78 @@ void Vulkan::VkManagedRenderPass::UpdateDynamicStates(VkDynamicStatesBlock dynam
 	m_currentPipelineStateBlock = dynamicStates;
 }
 
-void Vulkan::VkManagedRenderPass::PreRecordData(VkCommandBuffer commandBuffer, uint32_t frameBufferIndex)
+void Vulkan::VkManagedRenderPass::PreRecordData(VkCommandBuffer commandBuffer, uint32_t frameBufferIndex, uint32_t querySlot)
 {
-	assert(m_currentPipeline != nullptr);
+	assert(frameBufferIndex < m_fbSize);
+	//a pass begun by Begin keeps its command buffer and framebuffer until End
+	assert(!m_passOpen || (commandBuffer == m_currentCommandBuffer && frameBufferIndex == m_currentFBindex));
 	m_currentCommandBuffer = commandBuffer;
 	m_currentFBindex = frameBufferIndex;
+	m_currentQuerySlot = querySlot;
+}
+
+void Vulkan::VkManagedRenderPass::Begin(std::vector<VkClearValue> values, VkSubpassContents contents)
+{
+	assert(m_currentCommandBuffer != VK_NULL_HANDLE);
+	assert(!m_passOpen);
+
+	//queries can only be reset outside a pass, the views drawn until End share the slot's pool
+	if (m_currentQuerySlot < m_queryPools.size() && m_queryPools[m_currentQuerySlot] != VK_NULL_HANDLE)
+		vkCmdResetQueryPool(m_currentCommandBuffer, m_queryPools[m_currentQuerySlot], 0, m_queryCapacities[m_currentQuerySlot]);
+	BeginPass(values, contents);
+	m_passOpen = true;
+	m_passContents = contents;
+	m_passClearValues = values;
+}
+
+void Vulkan::VkManagedRenderPass::ClearRegion(const VkRect2D & rect, VkManagedParallelRecorder * recorder)
+{
+	assert(m_passOpen);
+
+	std::vector<VkClearAttachment> clears;
+	for (size_t i = 0; i < m_firstSubpassColorAttachments.size(); ++i)
+	{
+		assert(m_firstSubpassColorAttachments[i] < m_passClearValues.size());
+		VkClearAttachment clear = {};
+		clear.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		clear.colorAttachment = static_cast<uint32_t>(i);
+		clear.clearValue = m_passClearValues[m_firstSubpassColorAttachments[i]];
+		clears.push_back(clear);
+	}
+	assert(m_depthAttachment < m_passClearValues.size());
+	VkClearAttachment depthClear = {};
+	depthClear.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	depthClear.clearValue = m_passClearValues[m_depthAttachment];
+	clears.push_back(depthClear);
+
+	VkClearRect clearRect = {};
+	clearRect.rect = rect;
+	clearRect.baseArrayLayer = 0;
+	clearRect.layerCount = 1;
+	if (m_passContents == VkSubpassContents::VK_SUBPASS_CONTENTS_INLINE)
+	{
+		vkCmdClearAttachments(m_currentCommandBuffer, static_cast<uint32_t>(clears.size()), clears.data(), 1, &clearRect);
+		return;
+	}
+
+	//a subpass begun for secondary buffers takes no commands from the primary one
+	assert(recorder != nullptr);
+	VkCommandBufferInheritanceInfo inheritance = Inheritance();
+	const std::vector<VkCommandBuffer>& secondaries = recorder->Record(inheritance, 1,
+		[&](VkCommandBuffer buffer, size_t first, size_t count)
+	{
+		vkCmdClearAttachments(buffer, static_cast<uint32_t>(clears.size()), clears.data(), 1, &clearRect);
+	});
+	vkCmdExecuteCommands(m_currentCommandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+}
+
+void Vulkan::VkManagedRenderPass::End()
+{
+	assert(m_passOpen);
+	RecordLighting();
+	vkCmdEndRenderPass(m_currentCommandBuffer);
+	m_passOpen = false;
+	m_passClearValues.clear();
 }
 
 void Vulkan::VkManagedRenderPass::Record(std::vector<VkClearValue> values,std::vector<VkManagedDescriptorSet*> descriptors, std::vector<VkPushConstant>& pushConstants, VkManagedBuffer * indexBuffer, VkManagedBuffer * vertexBuffer, std::vector<VkIndexedDraw>& draws)
@@ -194,6 +400,94 @@ void Vulkan::VkManagedRenderPass::Record(std::vector<VkClearValue> values,std::v
 	assert(m_currentCommandBuffer != VK_NULL_HANDLE);
 	assert(m_currentPipeline != nullptr);
 
+	//inside a pass of Begin only the draws are recorded, values are the ones Begin cleared with
+	bool ownPass = !m_passOpen;
+	if (ownPass)
+	{
+		ResetQueries();
+		BeginPass(values, VkSubpassContents::VK_SUBPASS_CONTENTS_INLINE);
+	}
+	else if (m_passContents != VkSubpassContents::VK_SUBPASS_CONTENTS_INLINE)
+	{
+		throw std::runtime_error("Inline draws recorded in a pass begun for secondary command buffers");
+	}
+	if (m_depthPrepassPipeline != nullptr)
+		RecordDraws(m_currentCommandBuffer, m_depthPrepassPipeline, descriptors, pushConstants, indexBuffer, vertexBuffer, draws, 0, draws.size());
+	RecordDraws(m_currentCommandBuffer, m_currentPipeline, descriptors, pushConstants, indexBuffer, vertexBuffer, draws, 0, draws.size());
+	if (m_queryDraws != nullptr)
+		RecordQueries(m_currentCommandBuffer, 0, m_queryDraws->size());
+	if (ownPass)
+	{
+		RecordLighting();
+		vkCmdEndRenderPass(m_currentCommandBuffer);
+	}
+	m_queryDraws = nullptr;
+	m_depthPrepassPipeline = nullptr;
+}
+
+void Vulkan::VkManagedRenderPass::Record(std::vector<VkClearValue> values, std::vector<VkManagedDescriptorSet*> descriptors, std::vector<VkPushConstant>& pushConstants, VkManagedBuffer * indexBuffer, VkManagedBuffer * vertexBuffer, std::vector<VkIndexedDraw>& draws, VkManagedParallelRecorder * recorder)
+{
+	assert(m_currentCommandBuffer != VK_NULL_HANDLE);
+	assert(m_currentPipeline != nullptr);
+	assert(recorder != nullptr);
+
+	//splitting a short draw list costs more in thread handoff than it saves, a pass of Begin decided that for all of its views
+	bool inlineDraws = m_passOpen ? m_passContents == VkSubpassContents::VK_SUBPASS_CONTENTS_INLINE : recorder->TaskCount(draws.size()) < 2;
+	if (inlineDraws)
+	{
+		Record(values, descriptors, pushConstants, indexBuffer, vertexBuffer, draws);
+		return;
+	}
+
+	VkCommandBufferInheritanceInfo inheritance = Inheritance();
+
+	bool ownPass = !m_passOpen;
+	if (ownPass)
+	{
+		ResetQueries();
+		BeginPass(values, VkSubpassContents::VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	}
+	//no state is inherited by secondary buffers, every chunk binds its own
+	std::vector<VkCommandBuffer> secondaries;
+	//secondaries execute in order, so all of the pre-pass depth is there before the first shaded draw
+	if (m_depthPrepassPipeline != nullptr)
+	{
+		secondaries = recorder->Record(inheritance, draws.size(),
+			[&](VkCommandBuffer buffer, size_t first, size_t count)
+		{
+			RecordDraws(buffer, m_depthPrepassPipeline, descriptors, pushConstants, indexBuffer, vertexBuffer, draws, first, count);
+		});
+	}
+	const std::vector<VkCommandBuffer>& drawSecondaries = recorder->Record(inheritance, draws.size(),
+		[&](VkCommandBuffer buffer, size_t first, size_t count)
+	{
+		RecordDraws(buffer, m_currentPipeline, descriptors, pushConstants, indexBuffer, vertexBuffer, draws, first, count);
+	});
+	secondaries.insert(secondaries.end(), drawSecondaries.begin(), drawSecondaries.end());
+	//boxes are executed last so they are tested against the finished depth
+	if (m_queryDraws != nullptr && !m_queryDraws->empty())
+	{
+		const std::vector<VkCommandBuffer>& querySecondaries = recorder->Record(inheritance, m_queryDraws->size(),
+			[&](VkCommandBuffer buffer, size_t first, size_t count)
+		{
+			RecordQueries(buffer, first, count);
+		});
+		secondaries.insert(secondaries.end(), querySecondaries.begin(), querySecondaries.end());
+	}
+	//a view of a shared pass may have nothing visible
+	if (!secondaries.empty())
+		vkCmdExecuteCommands(m_currentCommandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+	if (ownPass)
+	{
+		RecordLighting();
+		vkCmdEndRenderPass(m_currentCommandBuffer);
+	}
+	m_queryDraws = nullptr;
+	m_depthPrepassPipeline = nullptr;
+}
+
+void Vulkan::VkManagedRenderPass::BeginPass(std::vector<VkClearValue>& values, VkSubpassContents contents)
+{
 	VkRenderPassBeginInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	renderPassInfo.clearValueCount = static_cast<uint32_t>(values.size());
@@ -202,43 +496,262 @@ void Vulkan::VkManagedRenderPass::Record(std::vector<VkClearValue> values,std::v
 	renderPassInfo.renderArea.offset = { 0, 0 };
 	renderPassInfo.renderArea.extent = m_extent;
 
-	renderPassInfo.framebuffer = *m_fbs[m_currentFBindex];
+	renderPassInfo.framebuffer = m_fbs[m_currentFBindex]->FrameBuffer(m_currentQuerySlot);
 	
-	vkCmdBeginRenderPass(m_currentCommandBuffer, &renderPassInfo, VkSubpassContents::VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(m_currentCommandBuffer, &renderPassInfo, contents);
+}
+
+VkCommandBufferInheritanceInfo Vulkan::VkManagedRenderPass::Inheritance()
+{
+	VkCommandBufferInheritanceInfo inheritance = {};
+	inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritance.renderPass = m_pass;
+	inheritance.subpass = 0;
+	inheritance.framebuffer = m_fbs[m_currentFBindex]->FrameBuffer(m_currentQuerySlot);
+	return inheritance;
+}
+
+void Vulkan::VkManagedRenderPass::RecordDraws(VkCommandBuffer commandBuffer, VkManagedPipeline * pipeline, std::vector<VkManagedDescriptorSet*>& descriptors, std::vector<VkPushConstant>& pushConstants, VkManagedBuffer * indexBuffer, VkManagedBuffer * vertexBuffer, std::vector<VkIndexedDraw>& draws, size_t first, size_t count)
+{
+	//only reads pass state besides the atomic statistics, so chunks of the same draw list can be recorded from several threads
 	VkBuffer vertexBuffers[] = { *vertexBuffer };
 	VkDeviceSize offset =  0 ;
-	vkCmdBindVertexBuffers(m_currentCommandBuffer, 0, 1, vertexBuffers, &offset);
-	vkCmdBindIndexBuffer(m_currentCommandBuffer, *indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-	vkCmdBindPipeline(m_currentCommandBuffer, m_currentPipelineBindpoint, *m_currentPipeline);
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, &offset);
+	vkCmdBindIndexBuffer(commandBuffer, *indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindPipeline(commandBuffer, m_currentPipelineBindpoint, *pipeline);
 
 	uint32_t diffSets = static_cast<uint32_t>(descriptors.size());
-	size_t drawCount = draws.size();
+	size_t drawEnd = first + count;
+	assert(diffSets <= VkIndexedDraw::k_maxDescriptorSets);
+	assert(drawEnd <= draws.size());
+	VkDescriptorSet descSets[VkIndexedDraw::k_maxDescriptorSets];
 
+	//dynamic state and push constants are the same for the whole pass, so they are issued once per command buffer
+	if (VK_INCOMPLETE == pipeline->SetDynamicState(commandBuffer, m_currentPipelineStateBlock))
+	{
+		throw std::runtime_error("Incomplete state block provided for the bound pipeline.");
+	}
+	if (pushConstants.size() > 0)
+	{
+		pipeline->SetPushConstant(commandBuffer, pushConstants);
+	}
+	uint32_t passStateCommands = static_cast<uint32_t>(pipeline->GetDynamicStates().size() + pushConstants.size());
+	uint32_t elided = count > 0 ? static_cast<uint32_t>(count - 1) * passStateCommands : 0;
 
-	for (uint32_t j = 0; j<drawCount; ++j)
+	//sets and offsets last bound in this command buffer, draws sharing them skip the bind
+	const VkIndexedDraw * bound = nullptr;
+	for (size_t j = first; j < drawEnd; ++j)
 	{
-		std::vector<VkDescriptorSet> descSets;
-		descSets.resize(diffSets,VK_NULL_HANDLE);
-		for (uint32_t i = 0; i < diffSets; ++i)
+		const VkIndexedDraw& draw = draws[j];
+		if (bound != nullptr && SameBindings(*bound, draw, diffSets))
 		{
-			assert(descriptors[i]->Size() == drawCount); // internal set count must be the same as draw count
-			descSets[i] = descriptors[i]->Set(j);
-
+			elided++;
+		}
+		else
+		{
+			//sets are shared between draws, each draw picks its internal set and the offsets into dynamic buffers
+			for (uint32_t i = 0; i < diffSets; ++i)
+			{
+				assert(draw.descriptorSets[i] < descriptors[i]->Size());
+				descSets[i] = descriptors[i]->Set(draw.descriptorSets[i]);
+			}
+			vkCmdBindDescriptorSets(commandBuffer, m_currentPipelineBindpoint, *pipeline, 0, diffSets, descSets, draw.dynamicOffsetCount, draw.dynamicOffsets);
+			bound = &draw;
 		}
-		vkCmdBindDescriptorSets(m_currentCommandBuffer, m_currentPipelineBindpoint, *m_currentPipeline, 0, static_cast<uint32_t>(descSets.size()), descSets.data(), 0, nullptr);
-		if (VK_INCOMPLETE == m_currentPipeline->SetDynamicState(m_currentCommandBuffer, m_currentPipelineStateBlock))
+
+		if (draw.indirectBuffer != VK_NULL_HANDLE)
 		{
-			throw std::runtime_error("Incomplete state block provided for the bound pipeline.");
+			//adjacent commands sharing all bindings go out as one multi draw
+			uint32_t drawCount = 1;
+			while (j + 1 < drawEnd && drawCount < m_maxIndirectDrawCount)
+			{
+				const VkIndexedDraw& next = draws[j + 1];
+				if (next.indirectBuffer != draw.indirectBuffer || next.indirectOffset != draw.indirectOffset + drawCount * sizeof(VkDrawIndexedIndirectCommand) || !SameBindings(draw, next, diffSets))
+					break;
+				drawCount++;
+				elided++;
+				j++;
+			}
+			vkCmdDrawIndexedIndirect(commandBuffer, draw.indirectBuffer, draw.indirectOffset, drawCount, sizeof(VkDrawIndexedIndirectCommand));
 		}
-		if (pushConstants.size() > 0)
+		else
 		{
-			m_currentPipeline->SetPushConstant(m_currentCommandBuffer, pushConstants);
+			vkCmdDrawIndexed(commandBuffer, draw.indexCount, draw.instanceCount, draw.indexStart, draw.vertexOffset, draw.firstInstance);
 		}
+	}
+	m_elidedCommands += elided;
+}
 
-		vkCmdDrawIndexed(m_currentCommandBuffer, draws[j].indexCount, 1, draws[j].indexStart, draws[j].vertexOffset, 0);
+uint32_t Vulkan::VkManagedRenderPass::ElidedCommandCount()
+{
+	return m_elidedCommands;
+}
 
+void Vulkan::VkManagedRenderPass::ResetStatistics()
+{
+	m_elidedCommands = 0;
+}
+
+void Vulkan::VkManagedRenderPass::ReserveOcclusionQueries(uint32_t querySlot, uint32_t count)
+{
+	if (m_queryPools.size() <= querySlot)
+	{
+		m_queryPools.resize(querySlot + 1, VK_NULL_HANDLE);
+		m_queryCapacities.resize(querySlot + 1, 0);
 	}
-	vkCmdEndRenderPass(m_currentCommandBuffer);
+	if (count <= m_queryCapacities[querySlot])
+		return;
+
+	//pools have a fixed size, a larger one replaces the old one
+	uint32_t capacity = std::max(count, m_queryCapacities[querySlot] * 2);
+	if (m_queryPools[querySlot] != VK_NULL_HANDLE)
+		vkDestroyQueryPool(m_device, m_queryPools[querySlot], nullptr);
+	m_queryPools[querySlot] = VK_NULL_HANDLE;
+	m_queryCapacities[querySlot] = 0;
+
+	VkQueryPoolCreateInfo queryPoolCI = {};
+	queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolCI.queryType = VK_QUERY_TYPE_OCCLUSION;
+	queryPoolCI.queryCount = capacity;
+	VkResult result = vkCreateQueryPool(m_device, &queryPoolCI, nullptr, &m_queryPools[querySlot]);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Unable to create occlusion query pool. Reason: " + Vulkan::VkResultToString(result));
+	m_queryCapacities[querySlot] = capacity;
+}
+
+void Vulkan::VkManagedRenderPass::SetOcclusionQueries(VkManagedPipeline * boundsPipeline, const std::vector<VkOcclusionQueryDraw> * queries)
+{
+	assert(boundsPipeline != nullptr);
+	if (!boundsPipeline->CreatedWithPass(m_pass))
+		throw std::runtime_error("Provided pipeline was not created with this render pass");
+	m_boundsPipeline = boundsPipeline;
+	m_queryDraws = queries;
+}
+
+bool Vulkan::VkManagedRenderPass::OcclusionResults(uint32_t querySlot, uint32_t first, uint32_t count, std::vector<uint64_t>& samples)
+{
+	samples.resize(count);
+	if (count == 0)
+		return true;
+	if (querySlot >= m_queryPools.size() || first + count > m_queryCapacities[querySlot])
+		return false;
+
+	VkResult result = vkGetQueryPoolResults(m_device, m_queryPools[querySlot], first, count, count * sizeof(uint64_t), samples.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result == VK_NOT_READY)
+		return false;
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Unable to read occlusion query results. Reason: " + Vulkan::VkResultToString(result));
+	return true;
+}
+
+void Vulkan::VkManagedRenderPass::ResetQueries()
+{
+	if (m_queryDraws == nullptr || m_queryDraws->empty())
+		return;
+	//queries can only be reset outside a pass, so the range used by the boxes is reset ahead of it
+	uint32_t first = UINT32_MAX;
+	uint32_t last = 0;
+	for (const VkOcclusionQueryDraw& query : *m_queryDraws)
+	{
+		first = std::min(first, query.query);
+		last = std::max(last, query.query);
+	}
+	assert(m_currentQuerySlot < m_queryPools.size() && last < m_queryCapacities[m_currentQuerySlot]);
+	vkCmdResetQueryPool(m_currentCommandBuffer, m_queryPools[m_currentQuerySlot], first, last - first + 1);
+}
+
+void Vulkan::VkManagedRenderPass::RecordQueries(VkCommandBuffer commandBuffer, size_t first, size_t count)
+{
+	VkQueryPool pool = m_queryPools[m_currentQuerySlot];
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, *m_boundsPipeline);
+	if (VK_INCOMPLETE == m_boundsPipeline->SetDynamicState(commandBuffer, m_currentPipelineStateBlock))
+	{
+		throw std::runtime_error("Incomplete state block provided for the bounds pipeline.");
+	}
+	//a non precise query only tells whether any sample passed, which is all visibility needs
+	for (size_t q = first; q < first + count; ++q)
+	{
+		const VkOcclusionQueryDraw& query = (*m_queryDraws)[q];
+		vkCmdPushConstants(commandBuffer, *m_boundsPipeline, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(query.boxToClip), query.boxToClip);
+		vkCmdBeginQuery(commandBuffer, pool, query.query, 0);
+		vkCmdDraw(commandBuffer, 36, 1, 0, 0);
+		vkCmdEndQuery(commandBuffer, pool, query.query);
+	}
+}
+
+void Vulkan::VkManagedRenderPass::SetDepthPrepass(VkManagedPipeline * depthPipeline)
+{
+	assert(depthPipeline != nullptr);
+	if (!depthPipeline->CreatedWithPass(m_pass))
+		throw std::runtime_error("Provided pipeline was not created with this render pass");
+	m_depthPrepassPipeline = depthPipeline;
+}
+
+void Vulkan::VkManagedRenderPass::SetDeferredLighting(VkManagedPipeline * lightingPipeline, const std::vector<VkManagedDescriptorSet*>& descriptors, const VkIndexedDraw & binding, const std::vector<VkPushConstant>& pushConstants)
+{
+	assert(lightingPipeline != nullptr);
+	assert(descriptors.size() < VkIndexedDraw::k_maxDescriptorSets);
+	if (m_type != RenderPassType::Secondary_Offscreen_Deffered_Lights)
+		throw std::runtime_error("Deferred lighting can only be recorded in a deferred render pass");
+	if (!lightingPipeline->CreatedWithPass(m_pass))
+		throw std::runtime_error("Provided pipeline was not created with this render pass");
+	LightingDraw lighting;
+	lighting.pipeline = lightingPipeline;
+	lighting.descriptors = descriptors;
+	lighting.binding = binding;
+	lighting.pushConstants = pushConstants;
+	lighting.states = m_currentPipelineStateBlock;
+	m_lightingDraws.push_back(lighting);
+}
+
+void Vulkan::VkManagedRenderPass::RecordLighting()
+{
+	if (m_type != RenderPassType::Secondary_Offscreen_Deffered_Lights)
+		return;
+	//the lighting subpass is always entered, pixels no lighting triangle covers keep the clear color
+	vkCmdNextSubpass(m_currentCommandBuffer, VkSubpassContents::VK_SUBPASS_CONTENTS_INLINE);
+
+	//one triangle per view, each trimmed to its view by the dynamic states it was queued with
+	for (LightingDraw& lighting : m_lightingDraws)
+	{
+		vkCmdBindPipeline(m_currentCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, *lighting.pipeline);
+		if (VK_INCOMPLETE == lighting.pipeline->SetDynamicState(m_currentCommandBuffer, lighting.states))
+		{
+			throw std::runtime_error("Incomplete state block provided for the lighting pipeline.");
+		}
+		//set 0 holds per object data the lighting triangle does not read
+		uint32_t setCount = static_cast<uint32_t>(lighting.descriptors.size());
+		VkDescriptorSet descSets[VkIndexedDraw::k_maxDescriptorSets];
+		for (uint32_t i = 0; i < setCount; ++i)
+		{
+			assert(lighting.binding.descriptorSets[i] < lighting.descriptors[i]->Size());
+			descSets[i] = lighting.descriptors[i]->Set(lighting.binding.descriptorSets[i]);
+		}
+		vkCmdBindDescriptorSets(m_currentCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, *lighting.pipeline, 1, setCount, descSets, lighting.binding.dynamicOffsetCount, lighting.binding.dynamicOffsets);
+		if (lighting.pushConstants.size() > 0)
+		{
+			lighting.pipeline->SetPushConstant(m_currentCommandBuffer, lighting.pushConstants);
+		}
+		vkCmdDraw(m_currentCommandBuffer, 3, 1, 0, 0);
+	}
+	m_lightingDraws.clear();
+}
+
+bool Vulkan::VkManagedRenderPass::SameBindings(const VkIndexedDraw & a, const VkIndexedDraw & b, uint32_t setCount)
+{
+	if (a.dynamicOffsetCount != b.dynamicOffsetCount)
+		return false;
+	for (uint32_t i = 0; i < setCount; ++i)
+	{
+		if (a.descriptorSets[i] != b.descriptorSets[i])
+			return false;
+	}
+	for (uint32_t i = 0; i < a.dynamicOffsetCount; ++i)
+	{
+		if (a.dynamicOffsets[i] != b.dynamicOffsets[i])
+			return false;
+	}
+	return true;
 }
 
 Vulkan::VkManagedRenderPass::VkManagedRenderPass()
@@ -249,6 +762,11 @@ Vulkan::VkManagedRenderPass::~VkManagedRenderPass()
 {
 	for (VkManagedFrameBuffer* buffer : m_fbs)
 		delete(buffer);
+	for (VkQueryPool pool : m_queryPools)
+	{
+		if (pool != VK_NULL_HANDLE)
+			vkDestroyQueryPool(m_device, pool, nullptr);
+	}
 }
 
 //void Vulkan::VkManagedRenderPass::CreateAsForwardOmniShadowmapPass(VkDevice device, int32_t width, int32_t height, std::shared_ptr<VulkanImageUnit> imageUnit, std::shared_ptr<VulkanCommandUnit> cmdUnit, VkFormat imageFormat, VkFormat depthFormat)
@@ -355,26 +873,27 @@ void Vulkan::VkManagedRenderPass::SetFrameBufferCount(uint32_t count, bool setFi
 			m_fbs.push_back(new VkManagedFrameBuffer(m_mdevice, m_pass));
 			if (m_colorformat == VK_FORMAT_UNDEFINED)
 			{
-				m_fbs[size]->Build(m_extent, sampleDepth, copyDepth, m_depthFormat, VkManagedFrameBufferAttachment::DepthAttachment);
+				m_fbs[size + i]->Build(m_extent, sampleDepth, copyDepth, m_depthFormat, VkManagedFrameBufferAttachment::DepthAttachment);
 				if(setFinalLayout)
-					m_fbs[size]->DepthAttachment()->layout = m_depthFinalLayout;
+					m_fbs[size + i]->DepthAttachment()->Assume(m_depthFinalLayout);
 			}
 			else if (m_depthFormat == VK_FORMAT_UNDEFINED)
 			{
-				m_fbs[size]->Build(m_extent, sampleColor, copyColor, m_colorformat, VkManagedFrameBufferAttachment::ColorAttachment);
+				m_fbs[size + i]->Build(m_extent, sampleColor, copyColor, m_colorformat, VkManagedFrameBufferAttachment::ColorAttachment);
 				if(setFinalLayout)
-					m_fbs[size]->ColorAttachment()->layout = m_colorFinalLayout;
+					m_fbs[size + i]->ColorAttachment()->Assume(m_colorFinalLayout);
 			}
 			else
 			{
-				m_fbs[size]->Build(m_extent, sampleColor, copyColor, sampleDepth, copyDepth, m_colorformat, m_depthFormat);
+				m_fbs[size + i]->Build(m_extent, sampleColor, copyColor, sampleDepth, copyDepth, m_colorformat, m_depthFormat, m_gBufferFormats);
 				if(setFinalLayout)
 				{
-					m_fbs[size]->DepthAttachment()->layout = m_depthFinalLayout;
-					m_fbs[size]->ColorAttachment()->layout = m_colorFinalLayout;
+					m_fbs[size + i]->DepthAttachment()->Assume(m_depthFinalLayout);
+					m_fbs[size + i]->ColorAttachment()->Assume(m_colorFinalLayout);
 				}
 
 			}
+			m_fbSize++;
 		}
 	}
 	catch (...)
@@ -385,6 +904,31 @@ void Vulkan::VkManagedRenderPass::SetFrameBufferCount(uint32_t count, bool setFi
 
 }
 
+void Vulkan::VkManagedRenderPass::SetFrameBufferTargets(const std::vector<VkManagedImage*>& colorTargets, bool setFinalLayout, bool sampleDepth, bool copyDepth)
+{
+	assert(m_colorformat != VK_FORMAT_UNDEFINED && m_depthFormat != VK_FORMAT_UNDEFINED);
+	assert(!m_passOpen);
+
+	//targets are replaced as a whole, a new swapchain comes with new images
+	for (VkManagedFrameBuffer* buffer : m_fbs)
+		delete(buffer);
+	m_fbs.clear();
+	m_fbSize = 0;
+
+	for (VkManagedImage * target : colorTargets)
+	{
+		assert(target != nullptr && target->format == m_colorformat);
+		m_fbs.push_back(new VkManagedFrameBuffer(m_mdevice, m_pass));
+		m_fbSize++;
+		m_fbs.back()->Build(m_extent, target, sampleDepth, copyDepth, m_depthFormat, m_gBufferFormats);
+		if (setFinalLayout)
+		{
+			target->Assume(m_colorFinalLayout);
+			m_fbs.back()->DepthAttachment()->Assume(m_depthFinalLayout);
+		}
+	}
+}
+
 VkExtent2D Vulkan::VkManagedRenderPass::GetExtent()
 {
 	return m_extent;
@@ -437,6 +981,18 @@ Vulkan::VkManagedImage * Vulkan::VkManagedRenderPass::GetAttachment(size_t index
 	}
 }
 
+const std::vector<VkFormat>& Vulkan::VkManagedRenderPass::GetInputFormats() const
+{
+	return m_gBufferFormats;
+}
+
+void Vulkan::VkManagedRenderPass::SetInputAttachments(uint32_t slot, const std::vector<VkManagedImage*>& inputs)
+{
+	assert(!m_passOpen);
+	for (size_t i = 0; i < m_fbSize; ++i)
+		m_fbs[i]->SetInputAttachments(slot, inputs);
+}
+
 Vulkan::VkManagedRenderPass::operator VkRenderPass() const
 {
 	return m_pass;
@@ -2,6 +2,8 @@
 #include "VulkanObject.h"
 #include <memory>
 #include <map>
+#include <atomic>
+#include <vector>
 #include "VkManagedStructures.h"
 
 namespace Vulkan
@@ -26,6 +28,7 @@ namespace Vulkan
 	class VkManagedQueue;
 	class VkManagedPipeline;
 	class VkManagedBuffer;
+	class VkManagedParallelRecorder;
 
 	class VkManagedRenderPass
 	{
@@ -33,14 +36,28 @@ namespace Vulkan
 
 		VkManagedRenderPass(VkManagedDevice * device);
 		void Build(VkExtent2D extent, VkFormat depthFormat);
-		void Build(VkExtent2D extent, VkFormat colorFormat, VkFormat depthFormat);
+		///Color is left in colorFinalLayout, PRESENT_SRC_KHR when the pass draws straight into swapchain images
+		void Build(VkExtent2D extent, VkFormat colorFormat, VkFormat depthFormat, VkImageLayout colorFinalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		///Two subpasses, the first writes albedo, packed normal and view depth, the second reads them as input attachments and writes the lit color
+		void BuildDeferred(VkExtent2D extent, VkFormat colorFormat, VkFormat depthFormat, VkImageLayout colorFinalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 		void SetPipeline(VkManagedPipeline * pipeline, VkDynamicStatesBlock dynamicStates, VkPipelineBindPoint bindPoint);
 		void UpdateDynamicStates(VkDynamicStatesBlock dynamicStates);
-		void PreRecordData(VkCommandBuffer commandBuffer, uint32_t frameBufferIndex);
+		///Framebuffer the next passes draw into, occlusion queries go to the pool of querySlot and a deferred pass reads the G-buffer of querySlot
+		void PreRecordData(VkCommandBuffer commandBuffer, uint32_t frameBufferIndex, uint32_t querySlot);
+		///Begin the pass once for several views, every Record until End draws into it. Without Begin each Record begins and ends its own pass
+		void Begin(std::vector<VkClearValue> values, VkSubpassContents contents);
+		///Clear what the first subpass writes inside rect to the values of Begin, for a view drawn over an earlier one. The recorder is only used by secondary contents
+		void ClearRegion(const VkRect2D& rect, VkManagedParallelRecorder * recorder);
+		///Record the lighting queued by every view and end the pass of Begin
+		void End();
 		void Record(std::vector<VkClearValue> values, std::vector<VkManagedDescriptorSet*> descriptors, std::vector<VkPushConstant>& pushConstants, VkManagedBuffer * indexBuffer, VkManagedBuffer * vertexBuffer, std::vector<VkIndexedDraw>& draws);
+		///Record the draws into secondary buffers from the recorder's worker threads and execute them inside the pass
+		void Record(std::vector<VkClearValue> values, std::vector<VkManagedDescriptorSet*> descriptors, std::vector<VkPushConstant>& pushConstants, VkManagedBuffer * indexBuffer, VkManagedBuffer * vertexBuffer, std::vector<VkIndexedDraw>& draws, VkManagedParallelRecorder * recorder);
 		VkManagedRenderPass();
 		~VkManagedRenderPass();
 		void SetFrameBufferCount(uint32_t count, bool setFinalLayout, bool sampleColor, bool copyColor, bool sampleDepth, bool copyDepth);
+		///Replace the framebuffers with one per target, each drawing into its target with its own depth, the G-buffer is set per slot
+		void SetFrameBufferTargets(const std::vector<VkManagedImage*>& colorTargets, bool setFinalLayout, bool sampleDepth, bool copyDepth);
 		operator VkRenderPass() const;
 		VkExtent2D GetExtent();
 		VkExtent3D GetExtent3D();
@@ -49,6 +66,24 @@ namespace Vulkan
 		VkFramebuffer GetFrameBuffer(uint32_t index = 0);
 		std::vector<VkFramebuffer> GetFrameBuffers();
 		Vulkan::VkManagedImage * GetAttachment(size_t index, VkImageUsageFlagBits attachmentType);
+		///Formats of the G-buffer of a deferred pass, in the order the lighting subpass reads them
+		const std::vector<VkFormat>& GetInputFormats() const;
+		///Point every framebuffer at the G-buffer of slot, the device must be done with the frames that last drew with the slot
+		void SetInputAttachments(uint32_t slot, const std::vector<VkManagedImage*>& inputs);
+		///Bind, dynamic state and push constant commands skipped since the last reset because the same state was already set
+		uint32_t ElidedCommandCount();
+		void ResetStatistics();
+		///Grow the occlusion query pool of a slot to count queries, the device must be done with the frame that last used the slot
+		void ReserveOcclusionQueries(uint32_t querySlot, uint32_t count);
+		///Boxes drawn with boundsPipeline after the draws of the next Record, each one inside its query. Their queries are reset before the pass begins, Begin resets the whole pool
+		void SetOcclusionQueries(VkManagedPipeline * boundsPipeline, const std::vector<VkOcclusionQueryDraw> * queries);
+		///Draw everything with depthPipeline before the draws of the next Record, with the same descriptors and push constants
+		void SetDepthPrepass(VkManagedPipeline * depthPipeline);
+		///Passed samples of count queries of a completed frame, false while any of them is not available
+		bool OcclusionResults(uint32_t querySlot, uint32_t first, uint32_t count, std::vector<uint64_t>& samples);
+		///Fullscreen triangle recorded in the lighting subpass of the next Record of a deferred pass, or at End with the dynamic states of the last SetPipeline.
+		///Descriptors are bound from set 1 with the sets and offsets of binding, the push constant data has to stay valid until then
+		void SetDeferredLighting(VkManagedPipeline * lightingPipeline, const std::vector<VkManagedDescriptorSet*>& descriptors, const VkIndexedDraw& binding, const std::vector<VkPushConstant>& pushConstants);
 
 	private:
 
@@ -64,6 +99,15 @@ namespace Vulkan
 			RenderPassCount = 7
 		};
 	
+	private:
+		void BeginPass(std::vector<VkClearValue>& values, VkSubpassContents contents);
+		VkCommandBufferInheritanceInfo Inheritance();
+		static bool SameBindings(const VkIndexedDraw& a, const VkIndexedDraw& b, uint32_t setCount);
+		void RecordDraws(VkCommandBuffer commandBuffer, VkManagedPipeline * pipeline, std::vector<VkManagedDescriptorSet*>& descriptors, std::vector<VkPushConstant>& pushConstants, VkManagedBuffer * indexBuffer, VkManagedBuffer * vertexBuffer, std::vector<VkIndexedDraw>& draws, size_t first, size_t count);
+		void ResetQueries();
+		void RecordQueries(VkCommandBuffer commandBuffer, size_t first, size_t count);
+		void RecordLighting();
+
 	private:
 
 		VkImageLayout m_colorFinalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -73,15 +117,46 @@ namespace Vulkan
 		VkPipelineBindPoint m_currentPipelineBindpoint = VkPipelineBindPoint::VK_PIPELINE_BIND_POINT_MAX_ENUM;
 		VkCommandBuffer m_currentCommandBuffer = VK_NULL_HANDLE;
 		uint32_t m_currentFBindex = 0;
-		RenderPassType m_type;
+		uint32_t m_currentQuerySlot = 0;
+		//pass begun by Begin and shared by every Record until End
+		bool m_passOpen = false;
+		VkSubpassContents m_passContents = VK_SUBPASS_CONTENTS_INLINE;
+		std::vector<VkClearValue> m_passClearValues;
+		//attachment indices of the first subpass color references and of depth, for region clears
+		std::vector<uint32_t> m_firstSubpassColorAttachments;
+		uint32_t m_depthAttachment = 0;
+		RenderPassType m_type = Uninitialized;
 		VkFormat m_colorformat;
 		VkFormat m_depthFormat;
+		//attachments after color and depth that only live inside the pass
+		std::vector<VkFormat> m_gBufferFormats;
 		VkExtent2D m_extent;
 		VkManagedDevice * m_mdevice = nullptr;
 		VulkanObjectContainer<VkDevice> m_device{ vkDestroyDevice, false };
 		VulkanObjectContainer<VkRenderPass> m_pass{ m_device, vkDestroyRenderPass };
 		std::vector<VkManagedFrameBuffer*> m_fbs;
 		size_t m_fbSize = 0;
+		//written by every recording thread
+		std::atomic<uint32_t> m_elidedCommands{ 0 };
+		uint32_t m_maxIndirectDrawCount = 1;
+		//one occlusion query pool per slot, replaced by a larger one when it runs out
+		std::vector<VkQueryPool> m_queryPools;
+		std::vector<uint32_t> m_queryCapacities;
+		VkManagedPipeline * m_boundsPipeline = nullptr;
+		//boxes of the next Record only
+		const std::vector<VkOcclusionQueryDraw> * m_queryDraws = nullptr;
+		//depth only pipeline of the next Record only
+		VkManagedPipeline * m_depthPrepassPipeline = nullptr;
+		//lighting subpass of the next Record or of every view until End
+		struct LightingDraw
+		{
+			VkManagedPipeline * pipeline = nullptr;
+			std::vector<VkManagedDescriptorSet*> descriptors;
+			VkIndexedDraw binding;
+			std::vector<VkPushConstant> pushConstants;
+			VkDynamicStatesBlock states;
+		};
+		std::vector<LightingDraw> m_lightingDraws;
 
 	};
 }
\ No newline at end of file
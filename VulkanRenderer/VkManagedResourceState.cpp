@@ -0,0 +1,247 @@
+#include "VkManagedResourceState.h"
+#include <assert.h>
+
+void Vulkan::VkManagedBarrierBatch::Add(VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages, const VkImageMemoryBarrier & barrier)
+{
+	Add(srcStages, dstStages);
+	m_images.push_back(barrier);
+}
+
+void Vulkan::VkManagedBarrierBatch::Add(VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages, const VkBufferMemoryBarrier & barrier)
+{
+	Add(srcStages, dstStages);
+	m_buffers.push_back(barrier);
+}
+
+void Vulkan::VkManagedBarrierBatch::Add(VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages)
+{
+	//a barrier needs stages on both sides, nothing before or after waits at the ends of the pipeline
+	m_srcStages |= srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	m_dstStages |= dstStages != 0 ? dstStages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+}
+
+bool Vulkan::VkManagedBarrierBatch::Empty() const
+{
+	return m_srcStages == 0;
+}
+
+void Vulkan::VkManagedBarrierBatch::Flush(VkCommandBuffer commandBuffer)
+{
+	if (Empty())
+		return;
+	vkCmdPipelineBarrier(commandBuffer, m_srcStages, m_dstStages, 0,
+		0, nullptr,
+		static_cast<uint32_t>(m_buffers.size()), m_buffers.data(),
+		static_cast<uint32_t>(m_images.size()), m_images.data());
+	Clear();
+}
+
+void Vulkan::VkManagedBarrierBatch::Clear()
+{
+	m_srcStages = 0;
+	m_dstStages = 0;
+	m_images.clear();
+	m_buffers.clear();
+}
+
+void Vulkan::VkManagedResourceState::Reset(uint32_t mipLevels, uint32_t layers, VkImageLayout layout)
+{
+	m_mipLevels = mipLevels;
+	m_layers = layers;
+	VkManagedSubresourceState state;
+	state.layout = layout;
+	m_states.assign(static_cast<size_t>(mipLevels) * layers, state);
+}
+
+void Vulkan::VkManagedResourceState::Use(VkManagedBarrierBatch & batch, VkImage image, const VkImageSubresourceRange & range, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout,
+	uint32_t srcQueueFamily, uint32_t dstQueueFamily)
+{
+	assert(image != VK_NULL_HANDLE);
+	assert(layout != VK_IMAGE_LAYOUT_UNDEFINED && layout != VK_IMAGE_LAYOUT_PREINITIALIZED);
+	uint32_t levelCount;
+	uint32_t layerCount;
+	Resolve(range, levelCount, layerCount);
+
+	//ownership only moves with a barrier, whether or not the use has to wait
+	bool ownershipTransfer = srcQueueFamily != dstQueueFamily && srcQueueFamily != VK_QUEUE_FAMILY_IGNORED && dstQueueFamily != VK_QUEUE_FAMILY_IGNORED;
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.dstAccessMask = access;
+	barrier.newLayout = layout;
+	barrier.srcQueueFamilyIndex = ownershipTransfer ? srcQueueFamily : VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = ownershipTransfer ? dstQueueFamily : VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+
+	//subresources left the same way move on together and share one barrier
+	auto place = [&](uint32_t baseLevel, uint32_t levels, uint32_t baseLayer, uint32_t layers)
+	{
+		VkManagedSubresourceState state = m_states[baseLevel * m_layers + baseLayer];
+		VkPipelineStageFlags srcStages;
+		if (Advance(state, true, stages, access, layout, srcStages, barrier.srcAccessMask, barrier.oldLayout) || ownershipTransfer)
+		{
+			barrier.subresourceRange = { range.aspectMask, baseLevel, levels, baseLayer, layers };
+			batch.Add(srcStages, stages, barrier);
+		}
+		for (uint32_t level = baseLevel; level < baseLevel + levels; ++level)
+		{
+			for (uint32_t layer = baseLayer; layer < baseLayer + layers; ++layer)
+				m_states[level * m_layers + layer] = state;
+		}
+	};
+
+	const VkManagedSubresourceState& first = m_states[range.baseMipLevel * m_layers + range.baseArrayLayer];
+	bool uniform = true;
+	for (uint32_t level = range.baseMipLevel; level < range.baseMipLevel + levelCount && uniform; ++level)
+	{
+		for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + layerCount && uniform; ++layer)
+			uniform = SameState(m_states[level * m_layers + layer], first);
+	}
+	if (uniform)
+	{
+		place(range.baseMipLevel, levelCount, range.baseArrayLayer, layerCount);
+		return;
+	}
+
+	//otherwise every level is split into runs of layers left the same way
+	for (uint32_t level = range.baseMipLevel; level < range.baseMipLevel + levelCount; ++level)
+	{
+		uint32_t end = range.baseArrayLayer + layerCount;
+		uint32_t layer = range.baseArrayLayer;
+		while (layer < end)
+		{
+			uint32_t runEnd = layer + 1;
+			while (runEnd < end && SameState(m_states[level * m_layers + runEnd], m_states[level * m_layers + layer]))
+				runEnd++;
+			place(level, 1, layer, runEnd - layer);
+			layer = runEnd;
+		}
+	}
+}
+
+void Vulkan::VkManagedResourceState::Use(VkManagedBarrierBatch & batch, VkBuffer buffer, VkPipelineStageFlags stages, VkAccessFlags access)
+{
+	assert(buffer != VK_NULL_HANDLE);
+	assert(m_states.size() == 1);
+	VkPipelineStageFlags srcStages;
+	VkAccessFlags srcAccess;
+	VkImageLayout oldLayout;
+	if (!Advance(m_states[0], false, stages, access, VK_IMAGE_LAYOUT_UNDEFINED, srcStages, srcAccess, oldLayout))
+		return;
+
+	//a buffer written after reads only has to wait for them, there is no memory to make visible
+	if (srcAccess == 0)
+	{
+		batch.Add(srcStages, stages);
+		return;
+	}
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = access;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	batch.Add(srcStages, stages, barrier);
+}
+
+void Vulkan::VkManagedResourceState::Assume(const VkImageSubresourceRange & range, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout)
+{
+	uint32_t levelCount;
+	uint32_t layerCount;
+	Resolve(range, levelCount, layerCount);
+	VkManagedSubresourceState state;
+	state.layout = layout;
+	if ((access & k_writeAccess) != 0)
+	{
+		state.writeStages = stages;
+		state.writeAccess = access & k_writeAccess;
+	}
+	else
+	{
+		state.readStages = stages;
+	}
+	for (uint32_t level = range.baseMipLevel; level < range.baseMipLevel + levelCount; ++level)
+	{
+		for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + layerCount; ++layer)
+			m_states[level * m_layers + layer] = state;
+	}
+}
+
+VkImageLayout Vulkan::VkManagedResourceState::Layout(uint32_t mipLevel, uint32_t layer) const
+{
+	assert(mipLevel < m_mipLevels && layer < m_layers);
+	return m_states[mipLevel * m_layers + layer].layout;
+}
+
+uint32_t Vulkan::VkManagedResourceState::MipLevels() const
+{
+	return m_mipLevels;
+}
+
+uint32_t Vulkan::VkManagedResourceState::Layers() const
+{
+	return m_layers;
+}
+
+bool Vulkan::VkManagedResourceState::Advance(VkManagedSubresourceState & state, bool isImage, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout,
+	VkPipelineStageFlags & srcStages, VkAccessFlags & srcAccess, VkImageLayout & oldLayout)
+{
+	//reads wait for a write they were not made visible to, writes for every use before them
+	bool write = (access & k_writeAccess) != 0;
+	bool wait = isImage && state.layout != layout;
+	if (write)
+		wait = wait || state.writeStages != 0 || state.readStages != 0;
+	else
+		wait = wait || (state.writeAccess != 0 && (stages & ~state.visibleStages) != 0);
+
+	srcStages = state.writeStages | state.readStages;
+	if (srcStages == 0)
+		srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	srcAccess = state.writeAccess;
+	oldLayout = state.layout;
+
+	//a layout change writes the whole subresource, the barrier makes that write visible to its destination stages only
+	bool transition = isImage && state.layout != layout;
+	if (isImage)
+		state.layout = layout;
+	if (write)
+	{
+		state.writeStages = stages;
+		state.writeAccess = access & k_writeAccess;
+		state.visibleStages = 0;
+		state.readStages = 0;
+	}
+	else if (transition)
+	{
+		state.writeStages = stages;
+		state.writeAccess = VK_ACCESS_MEMORY_WRITE_BIT;
+		state.visibleStages = stages;
+		state.readStages = 0;
+	}
+	else if (wait)
+	{
+		//earlier readers were waited on as well
+		state.visibleStages |= stages;
+		state.readStages = stages;
+	}
+	else
+	{
+		state.readStages |= stages;
+	}
+	return wait;
+}
+
+bool Vulkan::VkManagedResourceState::SameState(const VkManagedSubresourceState & a, const VkManagedSubresourceState & b)
+{
+	return a.layout == b.layout && a.writeStages == b.writeStages && a.writeAccess == b.writeAccess && a.visibleStages == b.visibleStages && a.readStages == b.readStages;
+}
+
+void Vulkan::VkManagedResourceState::Resolve(const VkImageSubresourceRange & range, uint32_t & levelCount, uint32_t & layerCount) const
+{
+	assert(range.baseMipLevel < m_mipLevels && range.baseArrayLayer < m_layers);
+	levelCount = range.levelCount == VK_REMAINING_MIP_LEVELS ? m_mipLevels - range.baseMipLevel : range.levelCount;
+	layerCount = range.layerCount == VK_REMAINING_ARRAY_LAYERS ? m_layers - range.baseArrayLayer : range.layerCount;
+	assert(range.baseMipLevel + levelCount <= m_mipLevels && range.baseArrayLayer + layerCount <= m_layers);
+}
@@ -0,0 +1,81 @@
+/*=========================================================
+VkManagedResourceState.h - Last use of every mip level and
+array layer of an image, or of a whole buffer. A new use
+only waits when it has to: for a layout change, for a write
+not yet made visible to its stages, or as a write after
+earlier uses. The wait covers just the stages that used the
+subresource and makes only written memory available.
+Barriers go to a batch, so several resources transition with
+a single vkCmdPipelineBarrier.
+==========================================================*/
+
+#pragma once
+#include "VulkanObject.h"
+#include <vector>
+
+namespace Vulkan
+{
+	//how a subresource was left by the uses recorded so far
+	struct VkManagedSubresourceState
+	{
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags writeStages = 0;
+		VkAccessFlags writeAccess = 0;
+		//stages the last write was already made visible to
+		VkPipelineStageFlags visibleStages = 0;
+		VkPipelineStageFlags readStages = 0;
+	};
+
+	class VkManagedBarrierBatch
+	{
+	public:
+		void Add(VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages, const VkImageMemoryBarrier& barrier);
+		void Add(VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages, const VkBufferMemoryBarrier& barrier);
+		///Execution dependency alone, for a use that waits without memory to make visible
+		void Add(VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages);
+		bool Empty() const;
+		///Record everything queued as one barrier and start over, nothing is recorded for an empty batch
+		void Flush(VkCommandBuffer commandBuffer);
+		void Clear();
+
+	private:
+		VkPipelineStageFlags m_srcStages = 0;
+		VkPipelineStageFlags m_dstStages = 0;
+		std::vector<VkImageMemoryBarrier> m_images;
+		std::vector<VkBufferMemoryBarrier> m_buffers;
+	};
+
+	class VkManagedResourceState
+	{
+	public:
+		//accesses that leave data a later use has to be made to see
+		static const VkAccessFlags k_writeAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+		///Every one of the mipLevels x layers subresources starts in layout with nothing to wait for, a buffer has one
+		void Reset(uint32_t mipLevels, uint32_t layers, VkImageLayout layout);
+		///Queue what range of image needs before stages use it with access in layout, subresources left the same way share a barrier
+		void Use(VkManagedBarrierBatch& batch, VkImage image, const VkImageSubresourceRange& range, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout,
+			uint32_t srcQueueFamily = VK_QUEUE_FAMILY_IGNORED, uint32_t dstQueueFamily = VK_QUEUE_FAMILY_IGNORED);
+		///Queue what buffer needs before stages use it with access
+		void Use(VkManagedBarrierBatch& batch, VkBuffer buffer, VkPipelineStageFlags stages, VkAccessFlags access);
+		///Record a use ordered by other means, like a render pass or a render graph, no stages leave nothing to wait for
+		void Assume(const VkImageSubresourceRange& range, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout);
+		VkImageLayout Layout(uint32_t mipLevel, uint32_t layer) const;
+		uint32_t MipLevels() const;
+		uint32_t Layers() const;
+		///Move state on to a use by stages with access in layout. True when the use has to wait, srcStages, srcAccess and oldLayout describe the barrier then
+		static bool Advance(VkManagedSubresourceState& state, bool isImage, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout,
+			VkPipelineStageFlags& srcStages, VkAccessFlags& srcAccess, VkImageLayout& oldLayout);
+
+	private:
+		static bool SameState(const VkManagedSubresourceState& a, const VkManagedSubresourceState& b);
+		void Resolve(const VkImageSubresourceRange& range, uint32_t& levelCount, uint32_t& layerCount) const;
+
+	private:
+		//mip major, layers of one level next to each other
+		std::vector<VkManagedSubresourceState> m_states;
+		uint32_t m_mipLevels = 0;
+		uint32_t m_layers = 0;
+	};
+}
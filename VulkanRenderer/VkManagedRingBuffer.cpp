@@ -0,0 +1,96 @@
+#include "VkManagedRingBuffer.h"
+#include "VkManagedDevice.h"
+#include <algorithm>
+#include <assert.h>
+
+Vulkan::VkManagedRingBuffer::VkManagedRingBuffer(VkManagedDevice * device, VkBufferUsageFlags usage, VkDeviceSize frameSize, uint32_t frameCount) : m_buffer(device)
+{
+	assert(device != nullptr);
+	assert(frameCount > 0);
+	m_mdevice = device;
+	m_usage = usage;
+	m_frameCount = frameCount;
+
+	VkPhysicalDeviceLimits limits = device->GetPhysicalDeviceLimits();
+	if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+		m_alignment = std::max(m_alignment, limits.minUniformBufferOffsetAlignment);
+	if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+		m_alignment = std::max(m_alignment, limits.minStorageBufferOffsetAlignment);
+
+	m_frameSize = AlignedSize(frameSize);
+	Build();
+}
+
+void Vulkan::VkManagedRingBuffer::BeginFrame(uint32_t frameIndex)
+{
+	assert(frameIndex < m_frameCount);
+	m_frameIndex = frameIndex;
+	m_head = 0;
+}
+
+void * Vulkan::VkManagedRingBuffer::Allocate(VkDeviceSize size, VkDeviceSize & offset)
+{
+	VkDeviceSize sliceSize = AlignedSize(size);
+	if (m_head + sliceSize > m_frameSize)
+		throw std::runtime_error("Unable to allocate from ring buffer. Reason: Frame region exhausted, reserve a larger frame size.");
+
+	offset = m_frameIndex * m_frameSize + m_head;
+	m_head += sliceSize;
+	return m_buffer.Data<char>(offset);
+}
+
+void Vulkan::VkManagedRingBuffer::EndFrame()
+{
+	if (m_head == 0)
+		return;
+	m_buffer.Flush(m_frameIndex * m_frameSize, m_head);
+}
+
+bool Vulkan::VkManagedRingBuffer::Reserve(VkDeviceSize frameSize)
+{
+	frameSize = AlignedSize(frameSize);
+	if (frameSize <= m_frameSize)
+		return false;
+
+	//grow geometrically so a slowly increasing object count doesn't rebuild every frame
+	m_frameSize = std::max(frameSize, m_frameSize + m_frameSize / 2);
+	m_frameSize = AlignedSize(m_frameSize);
+	Build();
+	return true;
+}
+
+VkDeviceSize Vulkan::VkManagedRingBuffer::AlignedSize(VkDeviceSize size)
+{
+	return (size + m_alignment - 1) / m_alignment * m_alignment;
+}
+
+VkDeviceSize Vulkan::VkManagedRingBuffer::FrameSize()
+{
+	return m_frameSize;
+}
+
+uint32_t Vulkan::VkManagedRingBuffer::FrameCount()
+{
+	return m_frameCount;
+}
+
+Vulkan::VkManagedRingBuffer::operator VkBuffer()
+{
+	return m_buffer;
+}
+
+void Vulkan::VkManagedRingBuffer::Build()
+{
+	m_head = 0;
+	if (m_frameSize == 0)
+		return;
+
+	try
+	{
+		m_buffer.Build(m_usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_frameSize * m_frameCount);
+	}
+	catch (...)
+	{
+		throw;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+/*=========================================================
+VkManagedRingBuffer.h - Per-frame linear allocator over one
+persistently mapped buffer. The buffer is split in one region
+per frame, each region is bump allocated from the start every
+time its frame begins, so per-draw data is written once
+straight into memory the device reads from.
+==========================================================*/
+
+#pragma once
+#include "VulkanObject.h"
+#include "VkManagedBuffer.h"
+
+namespace Vulkan
+{
+	class VkManagedDevice;
+	class VkManagedRingBuffer
+	{
+	public:
+		VkManagedRingBuffer(VkManagedDevice * device, VkBufferUsageFlags usage, VkDeviceSize frameSize, uint32_t frameCount);
+		VkManagedRingBuffer(const VkManagedRingBuffer&) = delete;
+		VkManagedRingBuffer& operator=(const VkManagedRingBuffer&) = delete;
+		///Rewind the region owned by the frame, the device must be done reading that region
+		void BeginFrame(uint32_t frameIndex);
+		///Bump allocate an aligned slice from the current frame region, offset is relative to the start of the buffer
+		void * Allocate(VkDeviceSize size, VkDeviceSize& offset);
+		///Flush everything allocated in the current frame region
+		void EndFrame();
+		///Grow every frame region to at least frameSize, only valid while the device is not using the buffer
+		bool Reserve(VkDeviceSize frameSize);
+		///Size of an aligned slice holding size bytes
+		VkDeviceSize AlignedSize(VkDeviceSize size);
+		VkDeviceSize FrameSize();
+		uint32_t FrameCount();
+		operator VkBuffer();
+
+	private:
+		void Build();
+
+	private:
+		VkManagedDevice * m_mdevice = nullptr;
+		VkManagedBuffer m_buffer;
+		VkBufferUsageFlags m_usage = 0;
+		VkDeviceSize m_alignment = 1;
+		VkDeviceSize m_frameSize = 0;
+		uint32_t m_frameCount = 0;
+		uint32_t m_frameIndex = 0;
+		VkDeviceSize m_head = 0;
+	};
+}
@@ -76,6 +76,7 @@ namespace Vulkan
 	{
 		VkPhysicalDevice device = VK_NULL_HANDLE;
 		VkPhysicalDeviceProperties deviceProperties = {};
+		VkPhysicalDeviceFeatures deviceFeatures = {};
 		std::vector<VkQueueFamilyProperties> queueFamilies;
 		std::vector<uint32_t> presentFamilies;
 		VkSurfaceData deviceSurfaceData = {};
@@ -83,9 +84,21 @@ namespace Vulkan
 
 	struct VkIndexedDraw
 	{
+		static const uint32_t k_maxDescriptorSets = 4;
+		static const uint32_t k_maxDynamicOffsets = 6;
 		uint32_t vertexOffset = 0;
 		uint32_t indexCount = 0;
 		uint32_t indexStart = 0;
+		uint32_t instanceCount = 1;
+		uint32_t firstInstance = 0;
+		//internal set index used from each bound VkManagedDescriptorSet, in bind order
+		uint32_t descriptorSets[k_maxDescriptorSets] = { 0 };
+		//one offset per dynamic descriptor in the bound sets, in set and binding order
+		uint32_t dynamicOffsets[k_maxDynamicOffsets] = { 0 };
+		uint32_t dynamicOffsetCount = 0;
+		//when set the draw parameters are read from a VkDrawIndexedIndirectCommand at the offset instead
+		VkBuffer indirectBuffer = VK_NULL_HANDLE;
+		VkDeviceSize indirectOffset = 0;
 	};
 
 	struct VkPushConstant
@@ -95,4 +108,12 @@ namespace Vulkan
 		uint32_t size = 0;
 		uint32_t offset = 0;
 	};
+
+	struct VkOcclusionQueryDraw
+	{
+		//column major matrix placing the unit cube from -1 to 1 in clip space
+		float boxToClip[16];
+		//query of the render pass pool counting the samples of the box
+		uint32_t query = 0;
+	};
 }
\ No newline at end of file
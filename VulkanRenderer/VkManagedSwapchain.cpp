@@ -104,6 +104,7 @@ Vulkan::VkManagedSwapchain::VkManagedSwapchain(VkManagedDevice * device, VkManag
 		throw std::runtime_error("Unable to create Vulkan swap chain!");
 
 	m_extent = swapChainCI.imageExtent;
+	m_format = swapChainCI.imageFormat;
 	m_imageUsage = swapChainCI.imageUsage;
 	m_usedQueueFamilies = uniqueQueues;
 
@@ -177,8 +178,8 @@ VkResult Vulkan::VkManagedSwapchain::PresentCurrentImage(uint32_t * imageIndex,
 	presentInfo.pSwapchains = --m_sc;
 	presentInfo.pImageIndices = imageIndex;
 
+	//no idle wait here, callers pace their frames with fences
 	VkResult result = vkQueuePresentKHR(queue->queue, &presentInfo);
-	vkQueueWaitIdle(queue->queue);
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || result == VK_SUCCESS)
 		return result;
 	else
@@ -190,6 +191,11 @@ Vulkan::VkManagedImage * Vulkan::VkManagedSwapchain::SwapchainImage(size_t index
 	return m_scImages[index];
 }
 
+const std::vector<Vulkan::VkManagedImage*>& Vulkan::VkManagedSwapchain::SwapchainImages()
+{
+	return m_scImages;
+}
+
 void Vulkan::VkManagedSwapchain::Remake(VkManagedDevice * device, VkManagedCommandPool * pool, VkManagedSyncMode mode, VkFormat preferedFormat)
 {
 	assert(device != nullptr);
@@ -302,6 +308,7 @@ void Vulkan::VkManagedSwapchain::Remake(VkManagedDevice * device, VkManagedComma
 	//m_sc.clear = true;
 	m_usedQueueFamilies = uniqueQueues;
 	m_extent = swapChainCI.imageExtent;
+	m_format = swapChainCI.imageFormat;
 
 	m_scImages.resize(minImageCount, nullptr);
 	std::vector<VkImage> images(minImageCount);
@@ -330,6 +337,11 @@ VkExtent2D Vulkan::VkManagedSwapchain::Extent()
 	return m_extent;
 }
 
+VkFormat Vulkan::VkManagedSwapchain::Format()
+{
+	return m_format;
+}
+
 uint32_t Vulkan::VkManagedSwapchain::ImageCount()
 {
 	return static_cast<uint32_t>(m_scImages.size());
@@ -25,8 +25,10 @@ namespace Vulkan
 		VkResult AcquireNextImage(uint32_t * imageIndex, VkSemaphore presentSemaphore);
 		VkResult PresentCurrentImage(uint32_t * imageIndex, Vulkan::VkManagedQueue * queue, std::vector<VkSemaphore> waitSemaphores);
 		Vulkan::VkManagedImage * SwapchainImage(size_t index);
+		const std::vector<Vulkan::VkManagedImage*>& SwapchainImages();
 		void Remake(VkManagedDevice * device, VkManagedCommandPool * pool, VkManagedSyncMode mode = VK_VKM_NONE, VkFormat preferedFormat = VK_FORMAT_UNDEFINED);
 		VkExtent2D Extent();
+		VkFormat Format();
 		uint32_t ImageCount();
 
 		
@@ -54,6 +56,7 @@ namespace Vulkan
 		static const uint32_t k_defaultTimeout = 100;
 		uint32_t m_timeout = k_defaultTimeout;
 		VkExtent2D m_extent;
+		VkFormat m_format = VK_FORMAT_UNDEFINED;
 
 	};
 }
\ No newline at end of file
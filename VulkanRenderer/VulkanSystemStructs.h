@@ -16,7 +16,6 @@ use them.
 #include <glm\vec3.hpp>
 #include <glm\vec4.hpp>
 #include <glm\matrix.hpp>
-#define MAX_LIGHTS_PER_FRAGMENT 6
 namespace Vulkan
 {
 
@@ -197,13 +196,25 @@ namespace Vulkan
 		VertexShaderMVP(const VertexShaderMVP& other) = delete;
 	};
 
+	//written once per camera and frame, every draw of the camera reads the same copy. The lights
+	//themselves are stored separately, these are the fields locating a fragment's light cluster
 	struct LightingUniformBuffer
 	{
-		VkLight lights[MAX_LIGHTS_PER_FRAGMENT];
 		glm::vec4 ambientLightColor;
+		glm::vec4 viewport;
+		glm::vec4 depthSlicing;
+		//tiles across, tiles down, depth slices and the directional lights leading the light list
+		glm::uvec4 grid;
+		LightingUniformBuffer(const LightingUniformBuffer& other) = delete;
+
+	};
+
+	//written once per material and frame, shared by every camera
+	struct MaterialUniformBuffer
+	{
 		glm::vec4 materialDiffuse;
 		float specularity;
-		LightingUniformBuffer(const LightingUniformBuffer& other) = delete;
+		MaterialUniformBuffer(const MaterialUniformBuffer& other) = delete;
 
 	};
 
@@ -0,0 +1,6 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//only depth testing matters, the query counts the samples that pass
+void main() {
+}
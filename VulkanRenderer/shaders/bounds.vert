@@ -0,0 +1,27 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//unit cube from -1 to 1 placed in clip space
+layout(push_constant) uniform Bounds {
+	mat4 boxToClip;
+} bounds;
+
+//corners of the 12 box triangles, bit 0 selects +x, bit 1 +y and bit 2 +z
+const int k_corners[36] = int[36](
+	0, 2, 6, 0, 6, 4,
+	1, 5, 7, 1, 7, 3,
+	0, 4, 5, 0, 5, 1,
+	2, 3, 7, 2, 7, 6,
+	0, 1, 3, 0, 3, 2,
+	4, 6, 7, 4, 7, 5);
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+void main() {
+
+	int corner = k_corners[gl_VertexIndex];
+	vec3 position = vec3((corner & 1) != 0 ? 1.0 : -1.0, (corner & 2) != 0 ? 1.0 : -1.0, (corner & 4) != 0 ? 1.0 : -1.0);
+	gl_Position = bounds.boxToClip * vec4(position, 1.0);
+}
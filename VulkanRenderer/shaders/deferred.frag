@@ -0,0 +1,192 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+struct VkLightProps
+{
+	int lightType;
+	float intensity;
+	float falloff;
+	float angle;
+};
+
+struct VkLight
+{
+	vec4 color;
+	vec4 position;
+	vec4 direction;
+	VkLightProps lightProps;
+	mat4 lightBiasedMVP;
+
+};
+
+//shared by every draw of the camera
+layout(set = 1, binding = 1) uniform FragUbo {
+
+	vec4 ambientLightColor;
+	//x, y, width and height of the camera viewport in pixels
+	vec4 viewport;
+	//slice = depth * x + y, with the logarithm of depth when z is 1
+	vec4 depthSlicing;
+	//tiles across, tiles down, depth slices and directional lights at the start of the light list
+	uvec4 grid;
+} ubo;
+
+//every light of the camera in view space, directional ones first
+layout(set = 1, binding = 3) readonly buffer LightList {
+
+	VkLight lights[];
+} lightList;
+
+//offset and count of every cluster, the offsets point at light indices further in the same array
+layout(set = 1, binding = 4) readonly buffer ClusterList {
+
+	uint data[];
+} clusters;
+
+//written by gbuffer.frag in the first subpass, read back at the same pixel
+layout(input_attachment_index = 0, set = 2, binding = 0) uniform subpassInput inAlbedo;
+layout(input_attachment_index = 1, set = 2, binding = 1) uniform subpassInput inNormal;
+layout(input_attachment_index = 2, set = 2, binding = 2) uniform subpassInput inDepth;
+
+layout(push_constant) uniform Camera {
+	mat4 invProj;
+} camera;
+
+layout(location = 0) out vec4 outColor;
+
+vec2 SignNotZero(vec2 v)
+{
+	return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec3 OctDecode(vec2 e)
+{
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if(n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * SignNotZero(n.xy);
+	return normalize(n);
+}
+
+vec3 Unproject(vec2 ndc, float z)
+{
+	vec4 p = camera.invProj * vec4(ndc, z, 1.0);
+	return p.xyz / p.w;
+}
+
+vec4 LightContribution(VkLight light, vec3 fragPos, vec3 N, float diffuseFrac, float specularity)
+{
+	float shadowCoef = 1.0f;
+	vec4 specular = vec4(0.0,0.0,0.0,0.0);
+	vec4 diffuse = vec4(0.0,0.0,0.0,0.0);
+	vec3 L; // fragment light dir
+	vec3 V; // fragment eye 
+	vec3 D; // light forward from rotation
+	float atten = 1.0f;
+	
+	D = normalize(-light.direction.xyz);
+	if(light.lightProps.lightType == 2)
+	{
+		V = normalize(-light.direction.xyz - fragPos);
+		L = D;
+	}
+	else
+	{
+		L = normalize(light.position.xyz - fragPos); 
+		V = normalize(-light.position.xyz);
+	}
+
+
+	    float intensity = light.lightProps.intensity;		
+	if(light.lightProps.lightType == 0 || light.lightProps.lightType == 1) //is point or spot
+	{
+		float dist = length(light.position.xyz - fragPos);
+		if(dist <= light.lightProps.falloff)
+		{
+			atten = clamp(1.0 - (dist*dist)/pow(light.lightProps.falloff,2), 0.0, 1.0);
+			if(light.lightProps.lightType == 1) // is spot thus extra per fragment testing
+			{
+				float coneAngle = degrees(acos(dot(L, D)));
+				if(coneAngle >= light.lightProps.angle)
+				{
+					atten = 0.0f;
+				}
+				else
+					atten = clamp(atten - coneAngle/light.lightProps.angle,0.0,1.0);
+			}
+		}
+		else
+			atten = 0.0f;
+
+	}
+	
+	if(atten > 0.0f)
+	{
+		float incidenceAngle = max(0.0,dot(L, N));
+		if(incidenceAngle > 0.0)
+		{
+			diffuse = diffuseFrac * incidenceAngle * light.color; // diffuse component		
+		}
+	
+		if(specularity > 0.0)
+		{
+		
+			vec3 H = normalize(L+V);
+			float specAngle = max(dot(H, N), 0.0);
+			if(specAngle > 0.0)
+			{
+				specular = pow(specAngle, specularity) * vec4(1.0f,1.0f,1.0f,1.0f);			
+			
+			}
+
+		}
+	}
+	
+	
+	
+	
+	
+	return atten*shadowCoef*intensity*(diffuse + specular);
+}
+
+void main() 
+{
+	float depth = subpassLoad(inDepth).x;
+	//nothing was drawn here, keep the forward clear color
+	if(depth <= 0.0)
+	{
+		outColor = vec4(0.0, 0.0, 0.0, 1.0);
+		return;
+	}
+	vec4 albedo = subpassLoad(inAlbedo);
+	vec4 packedNormal = subpassLoad(inNormal);
+	vec3 N = OctDecode(packedNormal.xy);
+	float specularity = packedNormal.z * 1023.0;
+
+	//the view position lies on the pixel's ray at the stored depth, two points of the ray work for both projections
+	vec2 viewportUV = clamp((gl_FragCoord.xy - ubo.viewport.xy) / ubo.viewport.zw, 0.0, 1.0);
+	vec3 rayNear = Unproject(viewportUV * 2.0 - 1.0, 0.0);
+	vec3 rayFar = Unproject(viewportUV * 2.0 - 1.0, 1.0);
+	vec3 fragPos = mix(rayNear, rayFar, (depth + rayNear.z) / (rayNear.z - rayFar.z));
+
+	vec4 lightColor = vec4(0.0f,0.0f,0.0f,0.0f);
+	float diffuseFrac = 1.0 - ubo.ambientLightColor.w;
+
+	for(uint i = 0;i < ubo.grid.w;i++)
+		lightColor += LightContribution(lightList.lights[i], fragPos, N, diffuseFrac, specularity);
+
+	//same cluster lookup as fragment.frag
+	uvec2 tile = min(uvec2(viewportUV * vec2(ubo.grid.xy)), ubo.grid.xy - 1);
+	float sliceDepth = max(depth, 0.0001);
+	float slice = floor((ubo.depthSlicing.z != 0.0 ? log(sliceDepth) : sliceDepth) * ubo.depthSlicing.x + ubo.depthSlicing.y);
+	uint cluster = ((uint(clamp(slice, 0.0, float(ubo.grid.z - 1))) * ubo.grid.y + tile.y) * ubo.grid.x + tile.x) * 2;
+	uint first = clusters.data[cluster];
+	uint count = clusters.data[cluster + 1];
+	for(uint i = 0;i < count;i++)
+		lightColor += LightContribution(lightList.lights[clusters.data[first + i]], fragPos, N, diffuseFrac, specularity);
+
+	outColor = albedo * (vec4(ubo.ambientLightColor.xyz,0.0f)+vec4(lightColor.xyz,1.0f));
+	outColor = vec4(clamp(outColor.xyz, 0.0f, 1.0f), outColor.w);
+}
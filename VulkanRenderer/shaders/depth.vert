@@ -0,0 +1,31 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//same instance data and camera as vertex.vert, the forward pass tests its depth for equality against this one
+layout(set = 0, binding = 0) readonly buffer InstanceBuffer {
+	
+	mat4 model[];
+} instances;
+
+layout(set = 0, binding = 1) readonly buffer VisibleBuffer {
+	
+	uint index[];
+} visible;
+
+layout(push_constant) uniform Camera {
+	mat4 view;
+	mat4 proj;
+} uboCamera;
+
+layout(location = 0) in vec3 inPosition;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+invariant gl_Position;
+
+void main() {
+
+	mat4 modelView = uboCamera.view * instances.model[visible.index[gl_InstanceIndex]];
+	gl_Position = uboCamera.proj * modelView * vec4(inPosition, 1.0);
+}
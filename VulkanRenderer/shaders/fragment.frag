@@ -30,13 +30,35 @@ struct VkLight
 
 layout(set = 1, binding = 0) uniform sampler2D texSampler;
 //layout(set = 1, binding = 1) uniform sampler2DArray depthSampler;
+//shared by every draw of the camera
 layout(set = 1, binding = 1) uniform FragUbo {
 
-	VkLight lights[6];
 	vec4 ambientLightColor;
+	//x, y, width and height of the camera viewport in pixels
+	vec4 viewport;
+	//slice = depth * x + y, with the logarithm of depth when z is 1
+	vec4 depthSlicing;
+	//tiles across, tiles down, depth slices and directional lights at the start of the light list
+	uvec4 grid;
+} ubo;
+
+layout(set = 1, binding = 2) uniform MaterialUbo {
+
 	vec4 materialDiffuse;
 	float specularity;
-} ubo;
+} material;
+
+//every light of the camera in view space, directional ones first
+layout(set = 1, binding = 3) readonly buffer LightList {
+
+	VkLight lights[];
+} lightList;
+
+//offset and count of every cluster, the offsets point at light indices further in the same array
+layout(set = 1, binding = 4) readonly buffer ClusterList {
+
+	uint data[];
+} clusters;
 
 layout(location = 0) out vec4 outColor;
 
@@ -101,99 +123,112 @@ float LinearizeDepth(float depth)
   return (2.0 * n) / (f + n - z * (f - n));	
 }
 
-void main() 
+vec4 LightContribution(VkLight light, vec3 fragPos, vec3 N, float diffuseFrac)
 {
-	vec4 vPos = inModelView*vertex;
-	vec3 fragPos = vec3(vPos)/vPos.w;
-    vec3 fragNormal = vec3(transpose(inverse(inModelView)) * vec4(inNormal,1.0));
+	float shadowCoef = 1.0f;
+	vec4 specular = vec4(0.0,0.0,0.0,0.0);
+	vec4 diffuse = vec4(0.0,0.0,0.0,0.0);
+	vec3 L; // fragment light dir
+	vec3 V; // fragment eye 
+	vec3 D; // light forward from rotation
+	float atten = 1.0f;
 	
-	outColor = vec4(inColor,1.0) * (ubo.materialDiffuse*texture(texSampler, inTexCoord));
-	vec4 lightColor = vec4(0.0f,0.0f,0.0f,0.0f);
-	float diffuseFrac = 1.0 - ubo.ambientLightColor.w;
-
-	vec3 N = normalize(fragNormal);
-
-	for(int i = 0;i < 6;i++)
+	D = normalize(-light.direction.xyz);
+	if(light.lightProps.lightType == 2)
 	{
-		float shadowCoef = 1.0f;
-		vec4 specular = vec4(0.0,0.0,0.0,0.0);
-		vec4 diffuse = vec4(0.0,0.0,0.0,0.0);
-		vec3 L; // fragment light dir
-		vec3 V; // fragment eye 
-		vec3 D; // light forward from rotation
-		float atten = 1.0f;
-		
-		D = normalize(-ubo.lights[i].direction.xyz);
-		if(ubo.lights[i].lightProps.lightType == 2)
-		{
-			V = normalize(-ubo.lights[i].direction.xyz - fragPos);
-			L = D;
-		}
-		else
-		{
-			L = normalize(ubo.lights[i].position.xyz - fragPos); 
-			V = normalize(-ubo.lights[i].position.xyz);
-		}
+		V = normalize(-light.direction.xyz - fragPos);
+		L = D;
+	}
+	else
+	{
+		L = normalize(light.position.xyz - fragPos); 
+		V = normalize(-light.position.xyz);
+	}
 
 
-	    float intensity = ubo.lights[i].lightProps.intensity;		
-		if(ubo.lights[i].lightProps.lightType == 0 || ubo.lights[i].lightProps.lightType == 1) //is point or spot
+	    float intensity = light.lightProps.intensity;		
+	if(light.lightProps.lightType == 0 || light.lightProps.lightType == 1) //is point or spot
+	{
+		float dist = length(light.position.xyz - fragPos);
+		if(dist <= light.lightProps.falloff)
 		{
-			float dist = length(ubo.lights[i].position.xyz - fragPos);
-			if(dist <= ubo.lights[i].lightProps.falloff)
+			atten = clamp(1.0 - (dist*dist)/pow(light.lightProps.falloff,2), 0.0, 1.0);
+			if(light.lightProps.lightType == 1) // is spot thus extra per fragment testing
 			{
-				atten = clamp(1.0 - (dist*dist)/pow(ubo.lights[i].lightProps.falloff,2), 0.0, 1.0);
-				if(ubo.lights[i].lightProps.lightType == 1) // is spot thus extra per fragment testing
+				float coneAngle = degrees(acos(dot(L, D)));
+				if(coneAngle >= light.lightProps.angle)
 				{
-					float coneAngle = degrees(acos(dot(L, D)));
-					if(coneAngle >= ubo.lights[i].lightProps.angle)
-					{
-						atten = 0.0f;
-					}
-					else
-						atten = clamp(atten - coneAngle/ubo.lights[i].lightProps.angle,0.0,1.0);
+					atten = 0.0f;
 				}
+				else
+					atten = clamp(atten - coneAngle/light.lightProps.angle,0.0,1.0);
 			}
-			else
-				atten = 0.0f;
+		}
+		else
+			atten = 0.0f;
 
+	}
+	
+	if(atten > 0.0f)
+	{
+		float incidenceAngle = max(0.0,dot(L, N));
+		if(incidenceAngle > 0.0)
+		{
+			diffuse = diffuseFrac * incidenceAngle * light.color; // diffuse component		
 		}
-		
-		if(atten > 0.0f)
+	
+		if(material.specularity > 0.0)
 		{
-			float incidenceAngle = max(0.0,dot(L, N));
-			if(incidenceAngle > 0.0)
-			{
-				diffuse = diffuseFrac * incidenceAngle * ubo.lights[i].color; // diffuse component		
-			}
 		
-			if(ubo.specularity > 0.0)
+			vec3 H = normalize(L+V);
+			float specAngle = max(dot(H, N), 0.0);
+			if(specAngle > 0.0)
 			{
+				specular = pow(specAngle, material.specularity) * vec4(1.0f,1.0f,1.0f,1.0f);			
 			
-				vec3 H = normalize(L+V);
-				float specAngle = max(dot(H, N), 0.0);
-				if(specAngle > 0.0)
-				{
-					specular = pow(specAngle, ubo.specularity) * vec4(1.0f,1.0f,1.0f,1.0f);			
-				
-				}
-
 			}
+
 		}
-		
-		
-		
-		
-		
-	//	if(iMat != ubo.lights[i].lightBiasedMVP)
+	}
+	
+	
+	
+	
+	
+	//	if(iMat != light.lightBiasedMVP)
 	//	{
-	//		vec4 vertPos = ubo.lights[i].lightBiasedMVP * vertexPosition;
+	//		vec4 vertPos = light.lightBiasedMVP * vertexPosition;
 	//		shadowCoef = filterPCF(vertPos,i);
 	//	}
 
-		lightColor += atten*shadowCoef*intensity*(diffuse + specular);
-		
-	}
+	return atten*shadowCoef*intensity*(diffuse + specular);
+}
+
+void main() 
+{
+	vec4 vPos = inModelView*vertex;
+	vec3 fragPos = vec3(vPos)/vPos.w;
+    vec3 fragNormal = vec3(transpose(inverse(inModelView)) * vec4(inNormal,1.0));
+	
+	outColor = vec4(inColor,1.0) * (material.materialDiffuse*texture(texSampler, inTexCoord));
+	vec4 lightColor = vec4(0.0f,0.0f,0.0f,0.0f);
+	float diffuseFrac = 1.0 - ubo.ambientLightColor.w;
+
+	vec3 N = normalize(fragNormal);
+
+	for(uint i = 0;i < ubo.grid.w;i++)
+		lightColor += LightContribution(lightList.lights[i], fragPos, N, diffuseFrac);
+
+	//only the lights binned into this fragment's cluster can reach it
+	uvec2 tile = uvec2(clamp((gl_FragCoord.xy - ubo.viewport.xy) / ubo.viewport.zw, 0.0, 1.0) * vec2(ubo.grid.xy));
+	tile = min(tile, ubo.grid.xy - 1);
+	float depth = max(-fragPos.z, 0.0001);
+	float slice = floor((ubo.depthSlicing.z != 0.0 ? log(depth) : depth) * ubo.depthSlicing.x + ubo.depthSlicing.y);
+	uint cluster = ((uint(clamp(slice, 0.0, float(ubo.grid.z - 1))) * ubo.grid.y + tile.y) * ubo.grid.x + tile.x) * 2;
+	uint first = clusters.data[cluster];
+	uint count = clusters.data[cluster + 1];
+	for(uint i = 0;i < count;i++)
+		lightColor += LightContribution(lightList.lights[clusters.data[first + i]], fragPos, N, diffuseFrac);
 
 		outColor *=vec4(ubo.ambientLightColor.xyz,0.0f)+vec4(lightColor.xyz,1.0f);
 		outColor = vec4(clamp(outColor.x,0.0f,1.0f),clamp(outColor.y,0.0f,1.0f),clamp(outColor.z,0.0f,1.0f),outColor.w);
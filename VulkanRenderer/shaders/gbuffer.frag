@@ -0,0 +1,48 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout(location = 0) in vec3 inColor;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec3 inNormal;
+layout(location = 3) in vec4 vertex;
+layout(location = 4) in mat4 inView;
+layout(location = 8) in mat4 inModelView;
+
+layout(set = 1, binding = 0) uniform sampler2D texSampler;
+
+layout(set = 1, binding = 2) uniform MaterialUbo {
+
+	vec4 materialDiffuse;
+	float specularity;
+} material;
+
+layout(location = 0) out vec4 outAlbedo;
+//octahedral view space normal in xy, specularity over 1023 in z
+layout(location = 1) out vec4 outNormal;
+//positive view depth, 0 where nothing was drawn
+layout(location = 2) out float outDepth;
+
+vec2 SignNotZero(vec2 v)
+{
+	return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+//unit vector folded onto the octahedron and mapped to 0..1, deferred.frag unfolds it
+vec2 OctEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * SignNotZero(n.xy);
+	return e * 0.5 + 0.5;
+}
+
+void main() 
+{
+	vec4 vPos = inModelView*vertex;
+	vec3 fragNormal = vec3(transpose(inverse(inModelView)) * vec4(inNormal,1.0));
+
+	outAlbedo = vec4(inColor,1.0) * (material.materialDiffuse*texture(texSampler, inTexCoord));
+	outNormal = vec4(OctEncode(normalize(fragNormal)), clamp(material.specularity, 0.0, 1023.0) / 1023.0, 0.0);
+	outDepth = -vPos.z / vPos.w;
+}
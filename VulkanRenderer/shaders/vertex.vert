@@ -1,13 +1,17 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(set = 0, binding = 0) uniform UniformBufferObject {
+//per instance transforms of the whole frame, indexed through the visible list
+layout(set = 0, binding = 0) readonly buffer InstanceBuffer {
 	
-	mat4 model;
-	//mat4 modelView;
-	//mat4 modelViewProjection;
-	//mat4 normal;
-} ubo;
+	mat4 model[];
+} instances;
+
+//instances left after culling, gl_InstanceIndex selects one of them
+layout(set = 0, binding = 1) readonly buffer VisibleBuffer {
+	
+	uint index[];
+} visible;
 
 layout(push_constant) uniform Camera {
 	mat4 view;
@@ -29,13 +33,15 @@ layout(location = 8) out mat4 outModelView;
 out gl_PerVertex {
     vec4 gl_Position;
 };
+//depth must match depth.vert bit for bit when a pre-pass ran
+invariant gl_Position;
 
 void main() {
 
 	outVertex = vec4(inPosition, 1.0);
 	outView = uboCamera.view;
 	outNormal = vec4(inNormal,1.0);
-	outModelView = uboCamera.view * ubo.model;
+	outModelView = uboCamera.view * instances.model[visible.index[gl_InstanceIndex]];
 	outColor = inColor;
     outTexCoord = inTexCoord;
     gl_Position =  uboCamera.proj * outModelView * outVertex;